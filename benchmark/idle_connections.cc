@@ -0,0 +1,124 @@
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pnrpc/net_server.h"
+
+// 建立大量空闲连接，统计服务端每个连接占用的RSS。
+// 用法：idle_connections [连接数，默认100000] [handle_io的数量，默认0]
+// 服务端运行在子进程中，因此统计结果不包含客户端的内存；连接通过unix domain socket建立，不受本地端口数量的限制。
+
+static const char* socket_path = "/tmp/pnrpc_idle_connections.sock";
+
+static size_t rss_kb(pid_t pid) {
+  std::ifstream in("/proc/" + std::to_string(pid) + "/status");
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.starts_with("VmRSS:")) {
+      return std::stoul(line.substr(6));
+    }
+  }
+  return 0;
+}
+
+static int connect_server() {
+  int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// 等待服务端的RSS稳定，即所有连接都已经被accept并且挂起
+static size_t stable_rss_kb(pid_t pid) {
+  size_t last = 0;
+  for (;;) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    size_t now = rss_kb(pid);
+    if (now == last) {
+      return now;
+    }
+    last = now;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  size_t conn_num = argc > 1 ? std::stoul(argv[1]) : 100000;
+  size_t io_num = argc > 2 ? std::stoul(argv[2]) : 0;
+  // 服务端和客户端各需要conn_num个fd
+  rlimit limit{};
+  ::getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  ::setrlimit(RLIMIT_NOFILE, &limit);
+  if (limit.rlim_cur < conn_num + 64) {
+    std::cerr << "RLIMIT_NOFILE is too small : " << limit.rlim_cur << std::endl;
+    return 1;
+  }
+
+  pid_t server = ::fork();
+  if (server == 0) {
+    pnrpc::NetServer ns(std::string(pnrpc::unix_address_prefix) + socket_path, 0, io_num);
+    ns.run();
+    return 0;
+  }
+
+  int probe = -1;
+  while ((probe = connect_server()) < 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  size_t base = stable_rss_kb(server);
+
+  std::vector<int> fds{probe};
+  fds.reserve(conn_num);
+  auto start = std::chrono::steady_clock::now();
+  while (fds.size() < conn_num) {
+    int fd = connect_server();
+    if (fd < 0) {
+      std::cerr << "connect failed after " << fds.size() << " connections : " << std::strerror(errno) << std::endl;
+      break;
+    }
+    fds.push_back(fd);
+  }
+  auto connect_ms =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+  size_t rss = stable_rss_kb(server);
+
+  std::printf("connections : %zu, connect time : %ld ms\n", fds.size(), static_cast<long>(connect_ms));
+  std::printf("server rss : %zu KB -> %zu KB\n", base, rss);
+  // 第一个连接用来探测服务端已经启动，不计入平均值
+  if (fds.size() > 1) {
+    double per_connection = (static_cast<double>(rss) - base) * 1024 / static_cast<double>(fds.size() - 1);
+    std::printf("rss per connection : %.1f bytes\n", per_connection);
+  } else {
+    std::printf("rss per connection : no idle connections established\n");
+  }
+
+  for (int fd : fds) {
+    ::close(fd);
+  }
+  ::kill(server, SIGKILL);
+  ::waitpid(server, nullptr, 0);
+  ::unlink(socket_path);
+  return 0;
+}
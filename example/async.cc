@@ -62,7 +62,9 @@ pnrpc::net::awaitable<void> RPCAsync::process() {
   };
   auto response = co_await pnrpc::async_task<std::string>(std::move(request_task));
 
-  RPCEchoSTUB echo_client(get_io_context(), "127.0.0.1", 44444);
+  // 以*this构造stub，echo请求会继承本次rpc调用的deadline，同时最多等待2秒
+  RPCEchoSTUB echo_client(*this, "127.0.0.1", 44444);
+  echo_client.set_timeout(std::chrono::seconds(2));
   co_await echo_client.async_connect();
 
   std::string resp;
@@ -71,6 +73,9 @@ pnrpc::net::awaitable<void> RPCAsync::process() {
       pnrpc::net::steady_timer(get_io_context(), std::chrono::seconds(2)).async_wait(pnrpc::net::use_awaitable));
   if (results.index() == 0 && std::get<0>(results) == RPC_OK) {
     response = response + ", " + resp;
+  } else if (results.index() == 1) {
+    // 等待超时，通知服务端放弃这次echo调用
+    co_await echo_client.cancel();
   }
   co_await set_response_arg(response, true);
   co_return;
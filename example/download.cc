@@ -1,14 +1,76 @@
 
 #include "download.h"
 
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <system_error>
+
+namespace {
+
+// 只提供该目录下的文件
+constexpr const char* serving_dir = "./download";
+
+// 文件名只能是serving_dir下的相对路径，拒绝绝对路径以及包含".."的路径；符号链接解析之后仍然需要位于serving_dir下
+std::optional<std::filesystem::path> ResolveServingPath(const std::string& filename) {
+  std::filesystem::path name(filename);
+  if (filename.empty() || name.is_absolute() || name.has_root_path()) {
+    return std::nullopt;
+  }
+  for (const auto& each : name) {
+    if (each == "..") {
+      return std::nullopt;
+    }
+  }
+  std::error_code ec;
+  auto root = std::filesystem::canonical(serving_dir, ec);
+  if (ec) {
+    return std::nullopt;
+  }
+  auto path = std::filesystem::weakly_canonical(root / name, ec);
+  if (ec) {
+    return std::nullopt;
+  }
+  auto [root_end, path_it] = std::mismatch(root.begin(), root.end(), path.begin(), path.end());
+  if (root_end != root.end()) {
+    return std::nullopt;
+  }
+  return path;
+}
+
+}  // namespace
+
+// 文件数据通过sendfile直接从page cache写入socket，不需要读取到用户态。
+// 文件不存在或者文件名不合法时回复RPC_NOT_FOUND，与空文件区分开
 pnrpc::net::awaitable<void> RPCDownload::process() {
   auto filename = co_await get_request_arg();
-  for (int i = 0; i < 10; ++i) {
-    std::string response_pkg(200, 'a');
-    co_await set_response_arg(response_pkg, i == 9);
+  auto path = ResolveServingPath(filename.value());
+  if (!path.has_value()) {
+    PNRPC_LOG_WARN("download reject file name : {}", filename.value());
+    co_await set_error_response(RPC_NOT_FOUND, "invalid file name");
+    co_return;
+  }
+  std::optional<pnrpc::FileRegion> region;
+  try {
+    region.emplace(pnrpc::FileRegion::Open(path.value().string()));
+  } catch (std::exception& e) {
+    PNRPC_LOG_WARN("download open file failed : {}", e.what());
+  }
+  if (region.has_value()) {
+    co_await set_file_response(region.value(), true);
+  } else {
+    co_await set_error_response(RPC_NOT_FOUND, "file not found");
   }
   co_return;
 }
 
 // 设置写回客户端的速率不超过1024字节/秒
-size_t RPCDownload::get_response_current_limiting(void* pkg) { return 1024; }
\ No newline at end of file
+size_t RPCDownload::get_response_current_limiting(void* pkg) { return 1024; }
+
+// 所有download请求共享不超过1MB/秒的总带宽
+std::shared_ptr<pnrpc::BandwidthBudget> RPCDownload::get_response_budget(void* pkg) {
+  static auto budget = std::make_shared<pnrpc::BandwidthBudget>(1024 * 1024);
+  return budget;
+}
@@ -5,4 +5,4 @@
 #include "pnrpc/rpc_declare.h"
 
 RPC_DECLARE(Download, std::string, std::string, 0x05, pnrpc::RpcType::ServerSideStream,
-            OVERRIDE_PROCESS OVERRIDE_RESPONSE_LIMIT)
\ No newline at end of file
+            OVERRIDE_PROCESS OVERRIDE_RESPONSE_LIMIT OVERRIDE_RESPONSE_BUDGET)
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "echo.h"
 #include "mysql_request.h"
 #include "pnrpc/net_server.h"
+#include "pnrpc/rpc_batch.h"
 #include "rpc_sleep.h"
 #include "sum.h"
 #include "sum_stream.h"
@@ -55,10 +56,12 @@ int main() {
         for (uint32_t x = 0; x < 3; ++x) {
           co_await sum_client.send_request(x);
         }
-        co_await sum_client.send_request(3, true);
+        // 多个元素打包在一个请求包中发送
+        std::vector<uint32_t> nums{3, 4, 5};
+        co_await sum_client.send_requests(nums, true);
         uint32_t resp = 0;
         int ret_code = co_await sum_client.recv_response(resp);
-        assert(resp == 0 + 1 + 2 + 3);
+        assert(resp == 0 + 1 + 2 + 3 + 4 + 5);
         assert(ret_code == RPC_OK);
       },
       pnrpc::net::detached);
@@ -95,6 +98,20 @@ int main() {
       },
       pnrpc::net::detached);
 
+  // 同一时间窗口内发起的多个Echo调用被合并成一个批量请求
+  auto batch_client = std::make_shared<pnrpc::RpcBatchStub<RPCEchoSTUB>>(io, "127.0.0.1", 44444);
+  for (int i = 0; i < 8; ++i) {
+    pnrpc::net::co_spawn(
+        io,
+        [batch_client, i]() -> pnrpc::net::awaitable<void> {
+          std::string resp;
+          int ret_code = co_await batch_client->rpc_call_coro("batch " + std::to_string(i), resp);
+          assert(ret_code == RPC_OK);
+          assert(resp == "batch " + std::to_string(i));
+        },
+        pnrpc::net::detached);
+  }
+
   io.run();
   io.stop();
 
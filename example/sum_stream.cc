@@ -1,14 +1,16 @@
 #include "sum_stream.h"
 
 pnrpc::net::awaitable<void> RPCSumStream::process() {
-  std::optional<uint32_t> request;
   uint32_t ret = 0;
   while (true) {
-    auto requeset = co_await get_request_arg();
-    if (requeset.has_value() == false) {
+    // 客户端打包发送的多个元素会被一次取出
+    auto requests = co_await get_request_args(64);
+    if (requests.empty()) {
       break;
     }
-    ret += requeset.value();
+    for (auto each : requests) {
+      ret += each;
+    }
   }
   co_await set_response_arg(ret, true);
-}
\ No newline at end of file
+}
@@ -16,11 +16,13 @@ namespace pnrpc {
 
 namespace net = ::boost::asio;
 using system_error = ::boost::system::system_error;
+using error_code = ::boost::system::error_code;
 
 #else
 
 namespace net = ::asio;
 using system_error = ::asio::system_error;
+using error_code = ::asio::error_code;
 
 #endif
 
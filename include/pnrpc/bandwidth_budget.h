@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "pnrpc/current_limiting.h"
+#include "pnrpc/exception.h"
+
+namespace pnrpc {
+
+/*
+ * 可以被多个StreamBase共享的带宽预算，用来限制一组连接的总带宽（例如某个pcode、某个io_context或者整个server）。
+ *  基于GCRA（虚拟调度时间）算法实现：tat_ns_记录预算被预定到的时间点，reserve通过CAS向后推进，无锁且可以跨线程使用；
+ *  stream按照chunk_size()分块预定，预定按照时间顺序排队，因此活跃的stream之间按块轮流、公平地分享带宽；
+ *  与CurrentLimiting一样允许透支，返回的是开始读写之前需要等待的时间。
+ */
+class BandwidthBudget {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  // rate单位 字节 / 秒，burst为0时使用默认的突发容量：100毫秒的流量
+  explicit BandwidthBudget(size_t rate, size_t burst = 0)
+      : rate_(rate),
+        burst_(burst != 0 ? burst : std::max<size_t>(rate / 10, 1)),
+        tolerance_ns_(rate != 0 ? static_cast<int64_t>(burst_ * 1e9 / rate) : 0),
+        tat_ns_(0) {
+    if (rate == 0) {
+      throw PnrpcException("bandwidth budget's rate should be greater than 0");
+    }
+  }
+
+  BandwidthBudget(const BandwidthBudget&) = delete;
+  BandwidthBudget& operator=(const BandwidthBudget&) = delete;
+
+  size_t chunk_size() const {
+    return std::clamp(burst_, CurrentLimiting::min_chunk_size, CurrentLimiting::max_chunk_size);
+  }
+
+  std::chrono::microseconds reserve(size_t bytes) {
+    int64_t cost_ns = static_cast<int64_t>(bytes * 1e9 / rate_);
+    int64_t now = now_ns();
+    int64_t tat = tat_ns_.load(std::memory_order_relaxed);
+    int64_t new_tat = 0;
+    do {
+      new_tat = std::max(tat, now) + cost_ns;
+    } while (!tat_ns_.compare_exchange_weak(tat, new_tat, std::memory_order_relaxed));
+    int64_t wait_ns = new_tat - now - tolerance_ns_;
+    if (wait_ns <= 0) {
+      return std::chrono::microseconds(0);
+    }
+    return std::chrono::microseconds(wait_ns / 1000 + 1);
+  }
+
+  size_t get_rate() const { return rate_; }
+
+ private:
+  static int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+  }
+
+  const size_t rate_;
+  const size_t burst_;
+  const int64_t tolerance_ns_;
+  std::atomic<int64_t> tat_ns_;
+};
+
+}  // namespace pnrpc
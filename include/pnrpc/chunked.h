@@ -0,0 +1,233 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "pnrpc/asio_version.h"
+#include "pnrpc/exception.h"
+#include "pnrpc/rpc_ret_code.h"
+
+namespace pnrpc {
+
+// 大消息按照这个大小分块发送
+constexpr size_t default_chunk_size = 256 * 1024;
+
+/*
+ * 超过max_package_size的大消息：
+ *  一个逻辑消息由一个流式rpc（请求或者回复的类型为std::string）中直到eof的所有包组成，每个包是消息的一块，
+ *  发送方通过ChunkWriter以字节流的方式写入，攒满chunk_size之后发送一块；接收方通过ChunkReader逐块或者按字节读取。
+ *  任意时刻只有一块数据以及流控窗口内的数据在内存中，与消息的大小无关。
+ */
+class ChunkWriter {
+ public:
+  using Sink = std::function<net::awaitable<void>(const std::string& chunk, bool eof)>;
+
+  explicit ChunkWriter(Sink sink, size_t chunk_size = default_chunk_size)
+      : sink_(std::move(sink)), chunk_size_(std::max<size_t>(chunk_size, 1)), closed_(false) {}
+
+  net::awaitable<void> Write(std::string_view data) {
+    if (closed_ == true) {
+      throw PnrpcException("write chunked message after close");
+    }
+    while (!data.empty()) {
+      size_t n = std::min(data.size(), chunk_size_ - buffer_.size());
+      buffer_.append(data.substr(0, n));
+      data.remove_prefix(n);
+      if (buffer_.size() == chunk_size_) {
+        co_await sink_(buffer_, false);
+        buffer_.clear();
+      }
+    }
+    co_return;
+  }
+
+  // 发送剩余的数据并结束消息，最后一块可能为空
+  net::awaitable<void> Close() {
+    if (closed_ == true) {
+      co_return;
+    }
+    closed_ = true;
+    co_await sink_(buffer_, true);
+    buffer_.clear();
+    co_return;
+  }
+
+ private:
+  Sink sink_;
+  size_t chunk_size_;
+  std::string buffer_;
+  bool closed_;
+};
+
+class ChunkReader {
+ public:
+  // 返回下一块，消息读取完毕时返回空
+  using Source = std::function<net::awaitable<std::optional<std::string>>()>;
+
+  explicit ChunkReader(Source source) : source_(std::move(source)), offset_(0), eof_(false) {}
+
+  // 返回下一块中还没有被读取的部分，读取完毕时返回空
+  net::awaitable<std::optional<std::string>> ReadChunk() {
+    while (offset_ == chunk_.size()) {
+      if (eof_ == true) {
+        co_return std::optional<std::string>();
+      }
+      auto next = co_await source_();
+      if (!next.has_value()) {
+        eof_ = true;
+        co_return std::optional<std::string>();
+      }
+      chunk_ = std::move(next).value();
+      offset_ = 0;
+    }
+    std::string result = offset_ == 0 ? std::move(chunk_) : chunk_.substr(offset_);
+    chunk_.clear();
+    offset_ = 0;
+    co_return result;
+  }
+
+  // 读取至多size个字节，返回0表示读取完毕
+  net::awaitable<size_t> Read(char* buf, size_t size) {
+    while (offset_ == chunk_.size() && eof_ == false) {
+      auto next = co_await source_();
+      if (!next.has_value()) {
+        eof_ = true;
+        break;
+      }
+      chunk_ = std::move(next).value();
+      offset_ = 0;
+    }
+    size_t n = std::min(size, chunk_.size() - offset_);
+    std::memcpy(buf, chunk_.data() + offset_, n);
+    offset_ += n;
+    co_return n;
+  }
+
+  bool eof() const { return eof_ && offset_ == chunk_.size(); }
+
+ private:
+  Source source_;
+  std::string chunk_;
+  size_t offset_;
+  bool eof_;
+};
+
+// 只读映射的文件，用于将大文件作为分块消息发送而不需要将其整体读入内存
+class MappedFile {
+ public:
+  static MappedFile Open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw system_error(error_code(errno, net::error::get_system_category()), "open " + path);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      int err = errno;
+      ::close(fd);
+      throw system_error(error_code(err, net::error::get_system_category()), "fstat " + path);
+    }
+    MappedFile file;
+    file.size_ = static_cast<size_t>(st.st_size);
+    if (file.size_ != 0) {
+      file.data_ = ::mmap(nullptr, file.size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (file.data_ == MAP_FAILED) {
+        int err = errno;
+        file.data_ = nullptr;
+        ::close(fd);
+        throw system_error(error_code(err, net::error::get_system_category()), "mmap " + path);
+      }
+      ::madvise(file.data_, file.size_, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+    return file;
+  }
+
+  MappedFile(MappedFile&& other) noexcept
+      : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+  MappedFile& operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+      unmap();
+      data_ = std::exchange(other.data_, nullptr);
+      size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() { unmap(); }
+
+  std::string_view view() const { return std::string_view(static_cast<const char*>(data_), size_); }
+
+  size_t size() const { return size_; }
+
+ private:
+  MappedFile() : data_(nullptr), size_(0) {}
+
+  void unmap() {
+    if (data_ != nullptr) {
+      ::munmap(data_, size_);
+      data_ = nullptr;
+    }
+  }
+
+  void* data_;
+  size_t size_;
+};
+
+// 服务端：在process()中以字节流的方式读取请求、写入回复
+template <typename Processor>
+ChunkReader ReadRequestChunks(Processor& processor) {
+  return ChunkReader([&processor]() -> net::awaitable<std::optional<std::string>> {
+    co_return co_await processor.get_request_arg();
+  });
+}
+
+template <typename Processor>
+ChunkWriter WriteResponseChunks(Processor& processor, size_t chunk_size = default_chunk_size) {
+  return ChunkWriter(
+      [&processor](const std::string& chunk, bool eof) -> net::awaitable<void> {
+        co_await processor.set_response_arg(chunk, eof);
+      },
+      chunk_size);
+}
+
+// 客户端：发送失败或者服务端回复错误时抛出异常
+template <typename Stub>
+ChunkWriter WriteRequestChunks(Stub& stub, size_t chunk_size = default_chunk_size) {
+  return ChunkWriter(
+      [&stub](const std::string& chunk, bool eof) -> net::awaitable<void> {
+        int ret_code = co_await stub.send_request(chunk, eof);
+        if (ret_code != RPC_OK) {
+          throw PnrpcException("send chunked request failed, ret_code = " + std::to_string(ret_code));
+        }
+      },
+      chunk_size);
+}
+
+template <typename Stub>
+ChunkReader ReadResponseChunks(Stub& stub) {
+  return ChunkReader([&stub]() -> net::awaitable<std::optional<std::string>> {
+    std::optional<std::string> chunk;
+    int ret_code = co_await stub.recv_response(chunk);
+    if (ret_code != RPC_OK) {
+      throw PnrpcException("recv chunked response failed, ret_code = " + std::to_string(ret_code));
+    }
+    co_return chunk;
+  });
+}
+
+}  // namespace pnrpc
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "pnrpc/asio_version.h"
+#include "pnrpc/util.h"
+
+namespace pnrpc {
+
+/*
+ * 请求合并（singleflight），用于声明为幂等的Simple类型rpc：
+ *  同一个rpc的相同请求（序列化之后的请求相同）同时到达时，只有第一个请求（leader）执行process()，
+ *  其余的请求等待leader的回复帧并直接将其写入自己的socket，避免缓存过期之后大量相同的请求同时打到后端；
+ *  leader执行失败（没有回复、被取消、抛出异常）时等待者被唤醒之后各自执行。
+ *  等待者与leader可以运行在不同的io_context上，leader通过post到等待者的executor上取消其timer来唤醒它。
+ */
+class Coalescer {
+ public:
+  using Frames = std::shared_ptr<const std::string>;
+
+ private:
+  struct Flight {
+    std::mutex mut;
+    bool done = false;
+    Frames frames;
+    std::vector<std::shared_ptr<net::steady_timer>> waiters;
+  };
+
+ public:
+  // 一次合并的凭证，leader的凭证析构时如果还没有发布结果，则唤醒等待者各自执行
+  class Ticket {
+    friend class Coalescer;
+
+   public:
+    Ticket() : coalescer_(nullptr), leader_(false) {}
+
+    Ticket(const Ticket&) = delete;
+    Ticket& operator=(const Ticket&) = delete;
+
+    ~Ticket() {
+      if (leader_ == true) {
+        publish(nullptr);
+      }
+    }
+
+    bool is_leader() const { return leader_; }
+
+    // 只有leader可以发布结果，发布之后相同的请求会重新发起一次执行
+    void publish(Frames frames) {
+      if (leader_ == false) {
+        return;
+      }
+      leader_ = false;
+      coalescer_->finish(key_, *flight_, std::move(frames));
+    }
+
+   private:
+    Coalescer* coalescer_;
+    std::string key_;
+    std::shared_ptr<Flight> flight_;
+    bool leader_;
+  };
+
+  Coalescer() = default;
+
+  Coalescer(const Coalescer&) = delete;
+  Coalescer& operator=(const Coalescer&) = delete;
+
+  // 没有相同的请求正在执行时调用者成为leader，否则调用者需要通过wait等待leader的结果
+  void join(std::string_view request, Ticket& ticket) {
+    ticket.coalescer_ = this;
+    ticket.key_ = std::string(request);
+    std::lock_guard<std::mutex> guard(mut_);
+    auto it = flights_.find(ticket.key_);
+    if (it != flights_.end()) {
+      ticket.flight_ = it->second;
+      return;
+    }
+    ticket.flight_ = std::make_shared<Flight>();
+    ticket.leader_ = true;
+    flights_.emplace(ticket.key_, ticket.flight_);
+  }
+
+  // 返回leader的回复帧，leader执行失败或者等待到deadline时返回nullptr
+  static net::awaitable<Frames> wait(Ticket& ticket, std::optional<Deadline> deadline) {
+    auto executor = co_await net::this_coro::executor;
+    auto timer = std::make_shared<net::steady_timer>(executor, deadline.value_or(Deadline::max()));
+    auto& flight = *ticket.flight_;
+    {
+      std::lock_guard<std::mutex> guard(flight.mut);
+      if (flight.done == true) {
+        co_return flight.frames;
+      }
+      flight.waiters.push_back(timer);
+    }
+    error_code ec;
+    co_await timer->async_wait(net::redirect_error(net::use_awaitable, ec));
+    std::lock_guard<std::mutex> guard(flight.mut);
+    co_return flight.frames;
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> guard(mut_);
+    return flights_.size();
+  }
+
+ private:
+  void finish(const std::string& key, Flight& flight, Frames frames) {
+    {
+      std::lock_guard<std::mutex> guard(mut_);
+      flights_.erase(key);
+    }
+    std::vector<std::shared_ptr<net::steady_timer>> waiters;
+    {
+      std::lock_guard<std::mutex> guard(flight.mut);
+      flight.done = true;
+      flight.frames = std::move(frames);
+      waiters.swap(flight.waiters);
+    }
+    for (auto& each : waiters) {
+      net::post(each->get_executor(), [timer = each]() { timer->cancel(); });
+    }
+  }
+
+  mutable std::mutex mut_;
+  std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+};
+
+}  // namespace pnrpc
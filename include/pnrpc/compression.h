@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "lz4.h"
+#include "pnrpc/asio_version.h"
+#include "pnrpc/exception.h"
+#include "pnrpc/util.h"
+
+namespace pnrpc {
+
+// 不小于这个大小的数据帧在CompressionPool中压缩/解压，避免阻塞io线程
+constexpr size_t offload_compression_size = 256 * 1024;
+
+// 压缩帧的内容为 原始长度(4字节) + 原始数据的前4个字节 + 其余数据的lz4块，见compressed_frame_bit。
+// 接收方解压之后得到原始的请求/回复包，因此压缩对packager透明。原始数据的前4个字节（请求包的pcode）不压缩，
+// 接收方在为压缩帧分配内存之前就可以按照pcode以及原始长度检查大小限制、申请内存预算。
+// 压缩之后没有变小的数据返回空，此时发送原始的数据帧
+constexpr size_t compressed_frame_prefix = 2 * sizeof(uint32_t);
+
+inline std::optional<std::string> CompressFrame(std::string_view raw) {
+  if (raw.size() >= max_package_size) {
+    throw PnrpcException("package is too large : " + std::to_string(raw.size()));
+  }
+  if (raw.size() <= sizeof(uint32_t)) {
+    return std::optional<std::string>();
+  }
+  auto rest = raw.substr(sizeof(uint32_t));
+  int bound = LZ4_compressBound(static_cast<int>(rest.size()));
+  std::string frame;
+  integralSeri<uint32_t>(static_cast<uint32_t>(raw.size()), frame);
+  frame.append(raw.data(), sizeof(uint32_t));
+  frame.resize(compressed_frame_prefix + bound);
+  int n = LZ4_compress_default(rest.data(), &frame[compressed_frame_prefix], static_cast<int>(rest.size()), bound);
+  if (n <= 0 || compressed_frame_prefix + n >= raw.size()) {
+    return std::optional<std::string>();
+  }
+  frame.resize(compressed_frame_prefix + n);
+  return frame;
+}
+
+// 压缩帧解压之后的长度，frame至少包含compressed_frame_prefix个字节
+inline size_t CompressedFrameRawSize(std::string_view frame) {
+  return integralParse<uint32_t>(frame.data(), frame.size());
+}
+
+// 原始数据的前4个字节，对于请求包而言是pcode
+inline uint32_t CompressedFrameHead(std::string_view frame) {
+  auto head = frame.substr(sizeof(uint32_t));
+  return integralParse<uint32_t>(head.data(), head.size());
+}
+
+inline std::string DecompressFrame(std::string_view frame) {
+  if (frame.size() < compressed_frame_prefix) {
+    throw PnrpcException("invalid compressed frame");
+  }
+  size_t raw_size = CompressedFrameRawSize(frame);
+  if (raw_size >= max_package_size) {
+    throw PnrpcException("package is too large : " + std::to_string(raw_size));
+  }
+  if (raw_size <= sizeof(uint32_t)) {
+    throw PnrpcException("invalid compressed frame");
+  }
+  std::string raw(raw_size, '\0');
+  std::copy_n(frame.data() + sizeof(uint32_t), sizeof(uint32_t), raw.begin());
+  auto block = frame.substr(compressed_frame_prefix);
+  size_t rest = raw_size - sizeof(uint32_t);
+  int n = LZ4_decompress_safe(block.data(), &raw[sizeof(uint32_t)], static_cast<int>(block.size()),
+                              static_cast<int>(rest));
+  if (n < 0 || static_cast<size_t>(n) != rest) {
+    throw PnrpcException("invalid compressed frame");
+  }
+  return raw;
+}
+
+// 所有连接共享的压缩线程池
+class CompressionPool {
+ public:
+  static net::thread_pool& Instance() {
+    static net::thread_pool pool(std::max(std::thread::hardware_concurrency() / 2, 1u));
+    return pool;
+  }
+};
+
+// 数据较大时在CompressionPool中执行f，完成之后回到调用者的executor上继续执行
+template <typename F>
+net::awaitable<std::invoke_result_t<F>> coro_run_compression(size_t size, F f) {
+  using R = std::invoke_result_t<F>;
+  if (size < offload_compression_size) {
+    co_return f();
+  }
+  co_return co_await net::co_spawn(
+      CompressionPool::Instance().get_executor(), [f = std::move(f)]() -> net::awaitable<R> { co_return f(); },
+      net::use_awaitable);
+}
+
+}  // namespace pnrpc
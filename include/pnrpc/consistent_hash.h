@@ -0,0 +1,252 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "pnrpc/asio_version.h"
+#include "pnrpc/endpoint.h"
+#include "pnrpc/exception.h"
+#include "pnrpc/log.h"
+#include "pnrpc/rpc_ret_code.h"
+#include "pnrpc/stub_pool.h"
+
+namespace pnrpc {
+
+// 跨进程稳定的64位hash（FNV-1a + splitmix64的混合函数），std::hash不保证不同进程、不同平台的结果一致
+inline uint64_t stableHash(std::string_view key) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (unsigned char c : key) {
+    h ^= c;
+    h *= 0x100000001b3ULL;
+  }
+  h ^= h >> 30;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 27;
+  h *= 0x94d049bb133111ebULL;
+  h ^= h >> 31;
+  return h;
+}
+
+/*
+ * 带虚拟节点和负载上限的一致性hash环：
+ *  每个后端在环上有vnodes个虚拟节点，key被映射到顺时针方向的第一个虚拟节点，后端增减时只有相邻区间的key被重新映射；
+ *  bounded load：每个后端的在途请求数不能超过 load_factor * 平均负载（向上取整），超过时key顺延到环上的下一个后端，
+ *  因此热点key不会压垮单个后端，负载恢复之后又会回到原来的后端。
+ * 后端的下标在HashRing的生命周期内保持不变（被移除的后端不会被复用为其他地址），HashRing不是线程安全的。
+ */
+class HashRing {
+ public:
+  explicit HashRing(size_t vnodes = 160, double load_factor = 1.25)
+      : vnodes_(vnodes == 0 ? 1 : vnodes), load_factor_(load_factor), total_load_(0), alive_(0) {}
+
+  // 返回后端的下标，已经存在的后端直接返回其下标
+  size_t add(const Endpoint& endpoint) {
+    size_t index = find(endpoint);
+    if (index == nodes_.size()) {
+      nodes_.push_back(Node{endpoint, 0, false});
+    }
+    if (nodes_[index].alive == false) {
+      nodes_[index].alive = true;
+      alive_ += 1;
+      rebuild();
+    }
+    return index;
+  }
+
+  void remove(const Endpoint& endpoint) {
+    size_t index = find(endpoint);
+    if (index != nodes_.size() && nodes_[index].alive == true) {
+      nodes_[index].alive = false;
+      alive_ -= 1;
+      rebuild();
+    }
+  }
+
+  size_t size() const { return alive_; }
+
+  const Endpoint& get_endpoint(size_t index) const { return nodes_[index].endpoint; }
+
+  size_t get_load(size_t index) const { return nodes_[index].load; }
+
+  // 后端是否仍然在环上（没有被移除）
+  bool is_alive(size_t index) const { return nodes_[index].alive; }
+
+  // 返回key应该被路由到的后端，excluded中的后端（例如连接失败的后端）会被跳过，没有可用的后端时返回npos
+  size_t pick(uint64_t key_hash, const std::vector<size_t>& excluded = {}) const {
+    if (ring_.empty()) {
+      return npos;
+    }
+    size_t capacity = static_cast<size_t>(std::ceil(load_factor_ * (total_load_ + 1) / alive_));
+    auto it = std::lower_bound(ring_.begin(), ring_.end(), std::make_pair(key_hash, size_t(0)));
+    size_t start = static_cast<size_t>(it - ring_.begin());
+    size_t fallback = npos;
+    for (size_t i = 0; i < ring_.size(); ++i) {
+      size_t index = ring_[(start + i) % ring_.size()].second;
+      if (std::find(excluded.begin(), excluded.end(), index) != excluded.end()) {
+        continue;
+      }
+      if (nodes_[index].load < capacity) {
+        return index;
+      }
+      if (fallback == npos) {
+        fallback = index;
+      }
+    }
+    return fallback;
+  }
+
+  size_t pick(std::string_view key, const std::vector<size_t>& excluded = {}) const {
+    return pick(stableHash(key), excluded);
+  }
+
+  void on_start(size_t index) {
+    nodes_[index].load += 1;
+    total_load_ += 1;
+  }
+
+  void on_finish(size_t index) {
+    nodes_[index].load -= 1;
+    total_load_ -= 1;
+  }
+
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+ private:
+  struct Node {
+    Endpoint endpoint;
+    size_t load;
+    bool alive;
+  };
+
+  size_t find(const Endpoint& endpoint) const {
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+      if (nodes_[i].endpoint == endpoint) {
+        return i;
+      }
+    }
+    return nodes_.size();
+  }
+
+  // 虚拟节点的位置只与后端的地址有关，因此重建之后其他后端的虚拟节点位置不变
+  void rebuild() {
+    ring_.clear();
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+      if (nodes_[i].alive == false) {
+        continue;
+      }
+      std::string name = nodes_[i].endpoint.to_string();
+      for (size_t v = 0; v < vnodes_; ++v) {
+        ring_.emplace_back(stableHash(name + "#" + std::to_string(v)), i);
+      }
+    }
+    std::sort(ring_.begin(), ring_.end());
+  }
+
+  size_t vnodes_;
+  double load_factor_;
+  std::vector<Node> nodes_;
+  std::vector<std::pair<uint64_t, size_t>> ring_;
+  size_t total_load_;
+  size_t alive_;
+};
+
+/*
+ * 按照key路由的客户端，相同key的调用会到达同一个后端（负载超过上限或者后端不可用时除外），适用于有状态、分片的服务。
+ * key由用户提供的key_func从请求中提取，Stub为RPC_DECLARE生成的stub类型，所有调用需要在同一个io_context的线程中发起。
+ * 每个后端的连接在调用成功之后被StubPool缓存并复用，后端被移除时关闭其空闲的连接。
+ */
+template <typename Stub>
+class RoutingClient {
+ public:
+  using request_t = typename Stub::request_t;
+  using response_t = typename Stub::response_t;
+  using KeyFunction = std::function<std::string(const request_t&)>;
+
+  RoutingClient(net::io_context& io, const std::vector<Endpoint>& endpoints, KeyFunction key_func,
+                size_t vnodes = 160, double load_factor = 1.25, size_t max_idle_connections = 8)
+      : ring_(vnodes, load_factor), key_func_(std::move(key_func)), pool_(io, max_idle_connections) {
+    for (const auto& each : endpoints) {
+      ring_.add(each);
+    }
+  }
+
+  // 后端的增减只会重新映射相邻区间的key
+  void add_endpoint(const Endpoint& endpoint) { ring_.add(endpoint); }
+
+  void remove_endpoint(const Endpoint& endpoint) {
+    ring_.remove(endpoint);
+    pool_.remove(endpoint);
+  }
+
+  // func的签名为 net::awaitable<int>(Stub&)，stub已经连接到key对应的后端，连接失败时按照环的顺序尝试下一个后端
+  template <typename Func>
+  net::awaitable<int> call(std::string_view key, Func&& func) {
+    uint64_t key_hash = stableHash(key);
+    std::vector<size_t> failed;
+    for (;;) {
+      size_t index = ring_.pick(key_hash, failed);
+      if (index == HashRing::npos) {
+        co_return RPC_NET_ERR;
+      }
+      // 拷贝一份endpoint，挂起期间add_endpoint可能导致nodes_重新分配
+      Endpoint ep = ring_.get_endpoint(index);
+      LoadGuard guard(ring_, index);
+      typename StubPool<Stub>::Handle stub;
+      try {
+        stub = co_await pool_.acquire(ep);
+      } catch (system_error& e) {
+        if (e.code() == net::error::operation_aborted) {
+          throw;
+        }
+        PNRPC_LOG_INFO("connect to {} failed : {}", ep.to_string(), e.what());
+        failed.push_back(index);
+        continue;
+      }
+      int ret_code = RPC_NET_ERR;
+      try {
+        ret_code = co_await func(*stub);
+      } catch (system_error& e) {
+        if (e.code() == net::error::operation_aborted) {
+          throw;
+        }
+        PNRPC_LOG_INFO("rpc call to {} failed : {}", ep.to_string(), e.what());
+      }
+      // 只有成功的调用的连接上确定没有残留的数据，可以复用；调用期间后端被移除时不再缓存其连接
+      if (ret_code == RPC_OK && ring_.is_alive(index)) {
+        pool_.release(ep, std::move(stub));
+      }
+      co_return ret_code;
+    }
+  }
+
+  net::awaitable<int> rpc_call_coro(const request_t& r, response_t& response) {
+    std::string key = key_func_(r);
+    co_return co_await call(key, [&](Stub& stub) { return stub.rpc_call_coro(r, response); });
+  }
+
+  HashRing& get_ring() { return ring_; }
+
+ private:
+  class LoadGuard {
+   public:
+    LoadGuard(HashRing& ring, size_t index) : ring_(ring), index_(index) { ring_.on_start(index_); }
+
+    ~LoadGuard() { ring_.on_finish(index_); }
+
+   private:
+    HashRing& ring_;
+    size_t index_;
+  };
+
+  HashRing ring_;
+  KeyFunction key_func_;
+  StubPool<Stub> pool_;
+};
+
+}  // namespace pnrpc
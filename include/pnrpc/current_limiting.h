@@ -1,35 +1,65 @@
 #pragma once
 
+#include <algorithm>
 #include <chrono>
-
-using namespace std;
-using namespace std::chrono;
+#include <cstddef>
 
 namespace pnrpc {
 
+/*
+ * 字节级别的令牌桶限流：
+ *  令牌按照up_water_level_字节/秒的速率持续填充（steady_clock，微秒精度），桶的容量为burst_字节；
+ *  每次读写之前通过reserve预定对应的字节数，令牌不足时允许透支，并返回需要等待的时间；
+ *  大的数据帧按照chunk_size()分块预定和读写，因此数据是被均匀地调度的，不会出现停顿整秒之后再突发的情况。
+ */
 class CurrentLimiting {
  public:
-  CurrentLimiting(size_t uwl = 0) : start_time_(system_clock::now()), up_water_level_(uwl) {}
+  using clock = std::chrono::steady_clock;
+
+  // 分块读写时块大小的上下限
+  static constexpr size_t min_chunk_size = 512;
+  static constexpr size_t max_chunk_size = 64 * 1024;
+
+  explicit CurrentLimiting(size_t uwl = 0, size_t burst = 0) { update_up_water_level(uwl, burst); }
+
+  // burst为0时使用默认的突发容量：100毫秒的流量
+  void update_up_water_level(size_t uwl, size_t burst = 0) {
+    up_water_level_ = uwl;
+    burst_ = burst != 0 ? burst : std::max<size_t>(uwl / 10, 1);
+    tokens_ = static_cast<double>(burst_);
+    last_time_ = clock::now();
+  }
+
+  bool enabled() const { return up_water_level_ != 0; }
 
-  void update_up_water_level(size_t uwl) { up_water_level_ = uwl; }
+  size_t chunk_size() const {
+    if (!enabled()) {
+      return max_chunk_size;
+    }
+    return std::clamp(burst_, min_chunk_size, max_chunk_size);
+  }
 
-  size_t calcualte_sleep_time(size_t total_bytes) {
-    if (up_water_level_ == 0) {
-      return 0;
+  // 预定bytes字节的令牌，返回开始读写之前需要等待的时间
+  std::chrono::microseconds reserve(size_t bytes) {
+    if (!enabled()) {
+      return std::chrono::microseconds(0);
     }
-    auto now = system_clock::now();
-    double seconds = std::chrono::duration_cast<std::chrono::seconds>(now - start_time_).count();
-    double max_bytes = seconds * up_water_level_;
-    // 未达到限流条件
-    if (total_bytes <= max_bytes) {
-      return 0;
+    auto now = clock::now();
+    double elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(now - last_time_).count();
+    last_time_ = now;
+    tokens_ = std::min(static_cast<double>(burst_), tokens_ + elapsed_us * up_water_level_ / 1e6);
+    tokens_ -= static_cast<double>(bytes);
+    if (tokens_ >= 0) {
+      return std::chrono::microseconds(0);
     }
-    return static_cast<size_t>((total_bytes - max_bytes) / (double)up_water_level_);
+    return std::chrono::microseconds(static_cast<int64_t>(-tokens_ * 1e6 / up_water_level_ + 1));
   }
 
  private:
-  time_point<system_clock> start_time_;
   size_t up_water_level_;  // 单位 字节 / 秒
+  size_t burst_;           // 单位 字节
+  double tokens_;
+  clock::time_point last_time_;
 };
 
-}  // namespace pnrpc
\ No newline at end of file
+}  // namespace pnrpc
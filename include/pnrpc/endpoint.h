@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace pnrpc {
+
+// 后端服务的地址，ip以"unix:"或者"shm:"开头时表示本机的unix domain socket或者共享内存通道，此时port被忽略
+struct Endpoint {
+  std::string ip;
+  uint16_t port = 0;
+
+  std::string to_string() const {
+    if (ip.starts_with("unix:") || ip.starts_with("shm:")) {
+      return ip;
+    }
+    return ip + ":" + std::to_string(port);
+  }
+
+  bool operator==(const Endpoint&) const = default;
+};
+
+}  // namespace pnrpc
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "pnrpc/asio_version.h"
+#include "pnrpc/exception.h"
+
+namespace pnrpc {
+
+// 文件回复按照这个大小分成多个回复包，小于max_package_size
+constexpr size_t file_frame_size = 1024 * 1024;
+
+/*
+ * 文件的一个区间，作为回复发送时（见RpcProcessor::set_file_response）文件数据由内核通过sendfile直接从page cache
+ * 写入socket，不经过用户态的拷贝；客户端收到的是普通的回复包，回复类型为std::string。
+ * FileRegion持有文件描述符，只能移动不能拷贝。
+ */
+class FileRegion {
+ public:
+  // size为0表示直到文件末尾
+  static FileRegion Open(const std::string& path, uint64_t offset = 0, uint64_t size = 0) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      throw system_error(error_code(errno, net::error::get_system_category()), "open " + path);
+    }
+    FileRegion region(fd, offset, size);
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      throw system_error(error_code(errno, net::error::get_system_category()), "fstat " + path);
+    }
+    auto file_size = static_cast<uint64_t>(st.st_size);
+    if (offset > file_size || (size != 0 && size > file_size - offset)) {
+      throw PnrpcException("file region out of range : " + path);
+    }
+    if (size == 0) {
+      region.size_ = file_size - offset;
+    }
+    return region;
+  }
+
+  // 接管fd的所有权
+  FileRegion(int fd, uint64_t offset, uint64_t size) : fd_(fd), offset_(offset), size_(size) {}
+
+  FileRegion(FileRegion&& other) noexcept
+      : fd_(std::exchange(other.fd_, -1)), offset_(other.offset_), size_(other.size_) {}
+
+  FileRegion& operator=(FileRegion&& other) noexcept {
+    if (this != &other) {
+      close();
+      fd_ = std::exchange(other.fd_, -1);
+      offset_ = other.offset_;
+      size_ = other.size_;
+    }
+    return *this;
+  }
+
+  FileRegion(const FileRegion&) = delete;
+  FileRegion& operator=(const FileRegion&) = delete;
+
+  ~FileRegion() { close(); }
+
+  int fd() const { return fd_; }
+
+  uint64_t offset() const { return offset_; }
+
+  uint64_t size() const { return size_; }
+
+  // 将文件的[offset, offset + size)读取到用户态，用于无法使用sendfile的场景（例如共享内存通道）
+  std::string Read(uint64_t offset, size_t size) const {
+    std::string buf(size, '\0');
+    size_t done = 0;
+    while (done < size) {
+      ssize_t n = ::pread(fd_, &buf[done], size - done, static_cast<off_t>(offset + done));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        throw system_error(error_code(errno, net::error::get_system_category()), "pread");
+      }
+      if (n == 0) {
+        throw PnrpcException("file is truncated while reading");
+      }
+      done += static_cast<size_t>(n);
+    }
+    return buf;
+  }
+
+ private:
+  void close() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  int fd_;
+  uint64_t offset_;
+  uint64_t size_;
+};
+
+}  // namespace pnrpc
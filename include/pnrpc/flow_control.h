@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "pnrpc/asio_version.h"
+
+namespace pnrpc {
+
+// 流式rpc每个方向的默认接收窗口，单位字节
+constexpr size_t default_stream_window = 256 * 1024;
+
+/*
+ * 基于credit的流控，同一个socket上一读一写两个stream共享一个FlowControl对象：
+ *  发送方：send_credit_为对端授予的可发送字节数，初始为default_stream_window，每发送一个数据帧消耗对应的credit，
+ *          credit耗尽时等待对端的Credit控制帧（允许透支一帧，因此大于窗口的帧也可以发送）；
+ *  接收方：应用每消费一个数据帧就累计consumed_，超过接收窗口的一半时通过Credit控制帧归还给对端，
+ *          接收方可以通过enlarge_recv_window授予额外的credit来扩大窗口。
+ * 这样每个stream在途以及缓存的数据不会超过窗口大小加一帧，生产者会按照消费者的速度发送。
+ * 读写socket的协程之间通过reading_、writing_标记协调，FlowControl不是线程安全的，同一个socket上的读写协程需要
+ * 运行在同一个线程中（pnrpc的线程模型保证了这一点）。
+ */
+class FlowControl {
+ public:
+  struct Waiter {
+    net::steady_timer* timer;
+    bool notified;
+  };
+
+  FlowControl()
+      : send_credit_(default_stream_window),
+        recv_window_(default_stream_window),
+        consumed_(0),
+        pending_grant_(0),
+        reading_(false),
+        writing_(false) {}
+
+  FlowControl(const FlowControl&) = delete;
+  FlowControl& operator=(const FlowControl&) = delete;
+
+  // 服务端为每个请求创建新的FlowControl，复用连接的stub在每次调用开始时重置：上一次调用中没有被归还的credit
+  // （例如请求被服务端拒绝、不足半个窗口的消费）不会累积，扩大的接收窗口重新授予新的请求
+  void reset() {
+    send_credit_ = default_stream_window;
+    consumed_ = 0;
+    pending_grant_ = recv_window_ - default_stream_window;
+  }
+
+  // 发送方是否可以继续发送数据帧。如果对端在我们等待credit的时候发送了数据帧（例如提前回复了错误信息），
+  // 说明对端已经不再读取请求，此时不再等待credit，避免死锁
+  bool can_send() const { return send_credit_ > 0 || stashed_.has_value(); }
+
+  void on_send(size_t bytes) { send_credit_ -= static_cast<int64_t>(bytes); }
+
+  void on_credit(uint32_t credit) {
+    send_credit_ += credit;
+    notify();
+  }
+
+  void on_consume(size_t bytes) {
+    consumed_ += bytes;
+    if (consumed_ >= recv_window_ / 2) {
+      pending_grant_ += consumed_;
+      consumed_ = 0;
+    }
+  }
+
+  // 接收窗口只能扩大，扩大的部分作为额外的credit授予对端
+  void enlarge_recv_window(size_t window) {
+    if (window > recv_window_) {
+      pending_grant_ += window - recv_window_;
+      recv_window_ = window;
+    }
+  }
+
+  uint32_t take_pending_grant() {
+    auto grant = static_cast<uint32_t>(std::min<size_t>(pending_grant_, UINT32_MAX));
+    pending_grant_ -= grant;
+    return grant;
+  }
+
+  bool has_pending_grant() const { return pending_grant_ != 0; }
+
+  // 发送方在等待credit时读取到的数据帧暂存在这里，由接收方读取
+  void stash(std::string&& frame) {
+    stashed_ = std::move(frame);
+    notify();
+  }
+
+  bool has_stashed() const { return stashed_.has_value(); }
+
+  std::string take_stashed() {
+    std::string frame = std::move(stashed_).value();
+    stashed_.reset();
+    return frame;
+  }
+
+  bool is_reading() const { return reading_; }
+
+  bool is_writing() const { return writing_; }
+
+  void set_reading(bool reading) {
+    reading_ = reading;
+    notify();
+  }
+
+  void set_writing(bool writing) {
+    writing_ = writing;
+    notify();
+  }
+
+  void add_waiter(Waiter* waiter) { waiters_.push_back(waiter); }
+
+  void remove_waiter(Waiter* waiter) {
+    waiters_.erase(std::remove(waiters_.begin(), waiters_.end(), waiter), waiters_.end());
+  }
+
+ private:
+  // 状态发生变化时唤醒所有等待的协程，由它们重新检查自己等待的条件
+  void notify() {
+    auto waiters = std::move(waiters_);
+    waiters_.clear();
+    for (auto each : waiters) {
+      each->notified = true;
+      each->timer->cancel();
+    }
+  }
+
+  int64_t send_credit_;
+  size_t recv_window_;
+  size_t consumed_;
+  size_t pending_grant_;
+  bool reading_;
+  bool writing_;
+  std::optional<std::string> stashed_;
+  std::vector<Waiter*> waiters_;
+};
+
+}  // namespace pnrpc
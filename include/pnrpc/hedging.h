@@ -0,0 +1,236 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "pnrpc/asio_version.h"
+#include "pnrpc/endpoint.h"
+#include "pnrpc/exception.h"
+#include "pnrpc/load_balance.h"
+#include "pnrpc/log.h"
+#include "pnrpc/rpc_ret_code.h"
+#include "pnrpc/stub_pool.h"
+
+namespace pnrpc {
+
+// 记录最近capacity次调用的延迟，用来计算对冲请求的等待时间
+class LatencyTracker {
+ public:
+  explicit LatencyTracker(size_t capacity = 1024) : capacity_(capacity == 0 ? 1 : capacity), next_(0), dirty_(0) {}
+
+  void record(std::chrono::microseconds latency) {
+    if (samples_.size() < capacity_) {
+      samples_.push_back(latency);
+    } else {
+      samples_[next_] = latency;
+      next_ = (next_ + 1) % capacity_;
+    }
+    dirty_ += 1;
+  }
+
+  size_t size() const { return samples_.size(); }
+
+  // q取值范围(0, 1)，每记录64个样本重新计算一次分位数
+  std::chrono::microseconds quantile(double q) {
+    if (samples_.empty()) {
+      return std::chrono::microseconds(0);
+    }
+    if (dirty_ >= 64 || q != cached_q_ || cached_ == std::chrono::microseconds(0)) {
+      auto tmp = samples_;
+      size_t k = std::min(static_cast<size_t>(q * tmp.size()), tmp.size() - 1);
+      std::nth_element(tmp.begin(), tmp.begin() + k, tmp.end());
+      cached_ = tmp[k];
+      cached_q_ = q;
+      dirty_ = 0;
+    }
+    return cached_;
+  }
+
+ private:
+  size_t capacity_;
+  std::vector<std::chrono::microseconds> samples_;
+  size_t next_;
+  size_t dirty_;
+  double cached_q_ = 0;
+  std::chrono::microseconds cached_ = std::chrono::microseconds(0);
+};
+
+/*
+ * 基于令牌的重试预算：每个正常的请求存入ratio个令牌（最多max_tokens个），每个对冲或者重试请求消耗一个令牌，
+ * 令牌不足时不再发起额外的请求，因此额外的请求最多占正常请求的ratio，后端过载时不会因为重试被进一步放大。
+ */
+class RetryBudget {
+ public:
+  explicit RetryBudget(double ratio = 0.1, double max_tokens = 100)
+      : ratio_(std::llround(ratio * unit)), max_tokens_(std::llround(max_tokens * unit)), tokens_(0) {}
+
+  void deposit() { tokens_ = std::min(max_tokens_, tokens_ + ratio_); }
+
+  bool try_withdraw() {
+    if (tokens_ < unit) {
+      return false;
+    }
+    tokens_ -= unit;
+    return true;
+  }
+
+  double get_tokens() const { return static_cast<double>(tokens_) / unit; }
+
+ private:
+  // 令牌以千分之一为单位计数，避免浮点误差
+  static constexpr int64_t unit = 1000;
+
+  int64_t ratio_;
+  int64_t max_tokens_;
+  int64_t tokens_;
+};
+
+struct HedgingOptions {
+  // 第一次请求超过该分位数的延迟仍未返回时发起对冲请求
+  double quantile = 0.95;
+  // 对冲等待时间的下限，以及样本不足时使用的等待时间
+  std::chrono::microseconds min_delay = std::chrono::milliseconds(1);
+  std::chrono::microseconds default_delay = std::chrono::milliseconds(50);
+  size_t min_samples = 100;
+  // 第一次请求因为后端故障失败时，在预算允许的情况下重试的次数
+  size_t max_retries = 1;
+  double budget_ratio = 0.1;
+  double budget_max_tokens = 100;
+  // 每个后端最多缓存的空闲连接数
+  size_t max_idle_connections = 8;
+};
+
+/*
+ * 对冲请求客户端，只能用于幂等的Simple类型rpc：
+ *  第一次请求在p95（可配置）延迟之后仍未返回时，向另一个后端（只有一个后端时是另一个连接）发起对冲请求，
+ *  两个请求中先返回的一个作为结果，另一个通过cancellation slot被取消，其连接被关闭，服务端会随之取消对应的处理函数；
+ *  请求因为后端故障失败时换一个后端重试；
+ *  对冲和重试请求受RetryBudget的限制；
+ *  连接在调用成功之后被StubPool缓存并复用，被取消的请求的连接不会被复用；
+ *  计算对冲等待时间的样本只来自第一次请求本身的耗时（不包括建立连接的时间），对冲和重试请求的耗时不计入，
+ *  第一次请求因为对冲请求先返回而被取消时，记录其被取消时已经等待的时间（真实延迟的下限），避免对冲缩短的延迟拉低分位数。
+ * 所有调用需要在同一个io_context的线程中发起。
+ */
+template <typename Stub>
+class HedgedClient {
+ public:
+  using request_t = typename Stub::request_t;
+  using response_t = typename Stub::response_t;
+
+  HedgedClient(net::io_context& io, std::vector<Endpoint> endpoints, HedgingOptions options = HedgingOptions())
+      : io_(io),
+        endpoints_(std::move(endpoints)),
+        options_(options),
+        budget_(options.budget_ratio, options.budget_max_tokens),
+        pool_(io, options.max_idle_connections),
+        next_(0) {
+    if (endpoints_.empty()) {
+      throw PnrpcException("hedged client needs at least one endpoint");
+    }
+  }
+
+  net::awaitable<int> rpc_call_coro(const request_t& r, response_t& response) {
+    budget_.deposit();
+    int ret_code = co_await hedged_call(r, response);
+    for (size_t i = 0; i < options_.max_retries && is_endpoint_failure(ret_code); ++i) {
+      if (budget_.try_withdraw() == false) {
+        break;
+      }
+      ret_code = co_await attempt(next_endpoint(), r, response, false);
+    }
+    co_return ret_code;
+  }
+
+  // 当前的对冲等待时间
+  std::chrono::microseconds hedge_delay() {
+    if (tracker_.size() < options_.min_samples) {
+      return options_.default_delay;
+    }
+    return std::max(tracker_.quantile(options_.quantile), options_.min_delay);
+  }
+
+  RetryBudget& get_budget() { return budget_; }
+
+ private:
+  net::awaitable<int> hedged_call(const request_t& r, response_t& response) {
+    using namespace net::experimental::awaitable_operators;
+    response_t first_response;
+    response_t hedge_response;
+    const Endpoint& first = next_endpoint();
+    const Endpoint& second = next_endpoint();
+    auto result =
+        co_await (attempt(first, r, first_response, true) || hedge(hedge_delay(), second, r, hedge_response));
+    if (result.index() == 0) {
+      response = std::move(first_response);
+      co_return std::get<0>(result);
+    }
+    response = std::move(hedge_response);
+    co_return std::get<1>(result);
+  }
+
+  // 等待delay之后发起对冲请求，预算不足时一直等待，直到被第一次请求的完成取消
+  net::awaitable<int> hedge(std::chrono::microseconds delay, const Endpoint& ep, const request_t& r,
+                            response_t& response) {
+    net::steady_timer timer(io_, delay);
+    co_await timer.async_wait(net::use_awaitable);
+    if (budget_.try_withdraw() == false) {
+      timer.expires_at(net::steady_timer::time_point::max());
+      co_await timer.async_wait(net::use_awaitable);
+    }
+    PNRPC_LOG_DEBUG("send hedged request to {} after {} us", ep.to_string(), delay.count());
+    co_return co_await attempt(ep, r, response, false);
+  }
+
+  // 网络错误转换为RPC_NET_ERR，取消（operation_aborted）继续向外抛出。primary为true表示第一次请求，其耗时计入延迟样本
+  net::awaitable<int> attempt(const Endpoint& ep, const request_t& r, response_t& response, bool primary) {
+    std::optional<std::chrono::steady_clock::time_point> start;
+    try {
+      auto stub = co_await pool_.acquire(ep);
+      start = std::chrono::steady_clock::now();
+      int ret_code = co_await stub->rpc_call_coro(r, response);
+      if (ret_code == RPC_OK) {
+        if (primary == true) {
+          record_latency(start.value());
+        }
+        pool_.release(ep, std::move(stub));
+      }
+      co_return ret_code;
+    } catch (system_error& e) {
+      if (e.code() == net::error::operation_aborted) {
+        if (primary == true && start.has_value()) {
+          record_latency(start.value());
+        }
+        throw;
+      }
+      PNRPC_LOG_INFO("rpc call to {} failed : {}", ep.to_string(), e.what());
+    }
+    co_return RPC_NET_ERR;
+  }
+
+  void record_latency(std::chrono::steady_clock::time_point start) {
+    tracker_.record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start));
+  }
+
+  const Endpoint& next_endpoint() {
+    const Endpoint& ep = endpoints_[next_];
+    next_ = (next_ + 1) % endpoints_.size();
+    return ep;
+  }
+
+  net::io_context& io_;
+  std::vector<Endpoint> endpoints_;
+  HedgingOptions options_;
+  RetryBudget budget_;
+  LatencyTracker tracker_;
+  StubPool<Stub> pool_;
+  size_t next_;
+};
+
+}  // namespace pnrpc
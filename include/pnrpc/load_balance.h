@@ -0,0 +1,283 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "pnrpc/asio_version.h"
+#include "pnrpc/endpoint.h"
+#include "pnrpc/exception.h"
+#include "pnrpc/log.h"
+#include "pnrpc/rpc_ret_code.h"
+#include "pnrpc/stub_pool.h"
+
+namespace pnrpc {
+
+struct BalanceOptions {
+  // 延迟EWMA的衰减时间常数
+  std::chrono::milliseconds decay = std::chrono::seconds(10);
+  // 连续失败max_failures次的后端被摘除
+  size_t max_failures = 3;
+  // 单次调用的延迟超过max_latency视为失败，0表示不按延迟摘除
+  std::chrono::milliseconds max_latency = std::chrono::milliseconds(0);
+  // 摘除时间，同一个后端被反复摘除时摘除时间线性增加，最多为max_eject_time
+  std::chrono::milliseconds eject_time = std::chrono::seconds(5);
+  std::chrono::milliseconds max_eject_time = std::chrono::seconds(60);
+  // 被摘除的后端最多占全部后端的比例，避免故障时摘除所有后端
+  double max_eject_ratio = 0.5;
+  // BalancedClient为每个后端最多缓存的空闲连接数
+  size_t max_idle_connections = 8;
+};
+
+/*
+ * 多个后端之间的负载均衡：
+ *  每次调用通过power of two choices选择后端：随机选取两个可用的后端，选择 (在途请求数 + 1) * 延迟EWMA 较小的一个，
+ *  延迟EWMA使用peak EWMA：延迟升高时立即生效，降低时按照decay衰减，因此慢的后端会迅速被避开；
+ *  连续失败或者过慢的后端会被摘除一段时间，摘除到期之后重新参与选择。
+ * LoadBalancer不是线程安全的，需要在同一个线程中使用。
+ */
+class LoadBalancer {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  explicit LoadBalancer(std::vector<Endpoint> endpoints, BalanceOptions options = BalanceOptions())
+      : options_(options), rand_(std::random_device()()) {
+    if (endpoints.empty()) {
+      throw PnrpcException("load balancer needs at least one endpoint");
+    }
+    for (auto& each : endpoints) {
+      backends_.push_back(Backend{std::move(each)});
+    }
+  }
+
+  size_t size() const { return backends_.size(); }
+
+  const Endpoint& get_endpoint(size_t index) const { return backends_[index].endpoint; }
+
+  size_t get_inflight(size_t index) const { return backends_[index].inflight; }
+
+  bool is_ejected(size_t index) const { return backends_[index].ejected_until > clock::now(); }
+
+  // 选择本次调用使用的后端，所有后端都被摘除时在全部后端中选择
+  size_t pick() {
+    auto now = clock::now();
+    std::vector<size_t> candidates;
+    for (size_t i = 0; i < backends_.size(); ++i) {
+      if (backends_[i].ejected_until <= now) {
+        candidates.push_back(i);
+      }
+    }
+    if (candidates.empty()) {
+      for (size_t i = 0; i < backends_.size(); ++i) {
+        candidates.push_back(i);
+      }
+    }
+    if (candidates.size() == 1) {
+      return candidates[0];
+    }
+    std::uniform_int_distribution<size_t> dist(0, candidates.size() - 1);
+    size_t a = dist(rand_);
+    size_t b = dist(rand_);
+    while (b == a) {
+      b = dist(rand_);
+    }
+    return score(candidates[a], now) <= score(candidates[b], now) ? candidates[a] : candidates[b];
+  }
+
+  void on_start(size_t index) { backends_[index].inflight += 1; }
+
+  // 调用被取消，只归还在途计数
+  void on_abort(size_t index) { backends_[index].inflight -= 1; }
+
+  void on_finish(size_t index, clock::duration latency, bool success) {
+    auto now = clock::now();
+    auto& backend = backends_[index];
+    backend.inflight -= 1;
+    update_ewma(backend, latency, now);
+    bool slow = options_.max_latency.count() != 0 && latency > options_.max_latency;
+    if (success == true && slow == false) {
+      backend.failures = 0;
+      backend.eject_count = 0;
+      return;
+    }
+    on_failure(backend, now);
+  }
+
+  // 没有延迟样本的失败（例如建立连接失败），只计入失败次数，不影响延迟EWMA
+  void on_error(size_t index) {
+    backends_[index].inflight -= 1;
+    on_failure(backends_[index], clock::now());
+  }
+
+ private:
+  struct Backend {
+    Endpoint endpoint;
+    size_t inflight = 0;
+    // 单位纳秒
+    double ewma = 0;
+    clock::time_point last_update = clock::time_point();
+    size_t failures = 0;
+    size_t eject_count = 0;
+    clock::time_point ejected_until = clock::time_point();
+  };
+
+  double score(size_t index, clock::time_point now) const {
+    const auto& backend = backends_[index];
+    return (decayed_ewma(backend, now) + 1.0) * static_cast<double>(backend.inflight + 1);
+  }
+
+  double decayed_ewma(const Backend& backend, clock::time_point now) const {
+    double elapsed = std::chrono::duration<double>(now - backend.last_update).count();
+    double decay = std::chrono::duration<double>(options_.decay).count();
+    return backend.ewma * std::exp(-elapsed / decay);
+  }
+
+  void update_ewma(Backend& backend, clock::duration latency, clock::time_point now) {
+    double rtt = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+    double ewma = decayed_ewma(backend, now);
+    if (rtt > ewma) {
+      backend.ewma = rtt;
+    } else {
+      double elapsed = std::chrono::duration<double>(now - backend.last_update).count();
+      double w = std::exp(-elapsed / std::chrono::duration<double>(options_.decay).count());
+      backend.ewma = backend.ewma * w + rtt * (1 - w);
+    }
+    backend.last_update = now;
+  }
+
+  void on_failure(Backend& backend, clock::time_point now) {
+    backend.failures += 1;
+    if (backend.failures >= options_.max_failures) {
+      eject(backend, now);
+    }
+  }
+
+  void eject(Backend& backend, clock::time_point now) {
+    size_t ejected = 0;
+    for (const auto& each : backends_) {
+      if (each.ejected_until > now) {
+        ejected += 1;
+      }
+    }
+    if (static_cast<double>(ejected + 1) > options_.max_eject_ratio * static_cast<double>(backends_.size())) {
+      return;
+    }
+    backend.eject_count += 1;
+    backend.failures = 0;
+    auto duration = std::min<std::chrono::milliseconds>(options_.eject_time * static_cast<int64_t>(backend.eject_count),
+                                                        options_.max_eject_time);
+    backend.ejected_until = now + duration;
+    PNRPC_LOG_WARN("eject endpoint {} for {} ms", backend.endpoint.to_string(), duration.count());
+  }
+
+  BalanceOptions options_;
+  std::vector<Backend> backends_;
+  std::minstd_rand rand_;
+};
+
+// 这些返回码说明后端不可用或者过载，计入失败次数
+inline bool is_endpoint_failure(int ret_code) {
+  return ret_code == RPC_NET_ERR || ret_code == RPC_OVERFLOW || ret_code == RPC_DEADLINE_EXCEEDED ||
+         ret_code == RPC_INVALID_PCODE || ret_code == RPC_NO_RESPONSE;
+}
+
+/*
+ * 在多个后端之间做负载均衡的客户端，Stub为RPC_DECLARE生成的stub类型。
+ * 每次调用从StubPool中取出LoadBalancer选择的后端的连接（没有空闲连接时建立新的连接），连接失败时换一个后端重试，
+ * 网络错误返回RPC_NET_ERR。计入延迟EWMA的只有调用本身的耗时，不包括建立连接的时间。
+ * 所有调用需要在同一个io_context的线程中发起。
+ */
+template <typename Stub>
+class BalancedClient {
+ public:
+  using request_t = typename Stub::request_t;
+  using response_t = typename Stub::response_t;
+
+  BalancedClient(net::io_context& io, std::vector<Endpoint> endpoints, BalanceOptions options = BalanceOptions())
+      : balancer_(std::move(endpoints), options), pool_(io, options.max_idle_connections) {}
+
+  // func的签名为 net::awaitable<int>(Stub&)，stub已经建立了连接，返回值为本次调用的返回码
+  template <typename Func>
+  net::awaitable<int> call(Func&& func) {
+    for (size_t attempt = 0; attempt < balancer_.size(); ++attempt) {
+      size_t index = balancer_.pick();
+      const Endpoint& ep = balancer_.get_endpoint(index);
+      InflightGuard guard(balancer_, index);
+      typename StubPool<Stub>::Handle stub;
+      try {
+        stub = co_await pool_.acquire(ep);
+      } catch (system_error& e) {
+        if (e.code() == net::error::operation_aborted) {
+          throw;
+        }
+        PNRPC_LOG_INFO("connect to {} failed : {}", ep.to_string(), e.what());
+        guard.fail();
+        continue;
+      }
+      int ret_code = RPC_NET_ERR;
+      auto start = LoadBalancer::clock::now();
+      try {
+        ret_code = co_await func(*stub);
+      } catch (system_error& e) {
+        if (e.code() == net::error::operation_aborted) {
+          throw;
+        }
+        PNRPC_LOG_INFO("rpc call to {} failed : {}", ep.to_string(), e.what());
+      }
+      guard.finish(LoadBalancer::clock::now() - start, !is_endpoint_failure(ret_code));
+      // 只有成功的调用的连接上确定没有残留的数据，可以复用
+      if (ret_code == RPC_OK) {
+        pool_.release(ep, std::move(stub));
+      }
+      co_return ret_code;
+    }
+    co_return RPC_NET_ERR;
+  }
+
+  // Simple类型rpc的便捷接口
+  net::awaitable<int> rpc_call_coro(const request_t& r, response_t& response) {
+    co_return co_await call([&](Stub& stub) { return stub.rpc_call_coro(r, response); });
+  }
+
+  LoadBalancer& get_balancer() { return balancer_; }
+
+ private:
+  // 保证调用被取消（协程被销毁）时也会归还在途计数
+  class InflightGuard {
+   public:
+    InflightGuard(LoadBalancer& balancer, size_t index) : balancer_(balancer), index_(index), finished_(false) {
+      balancer_.on_start(index_);
+    }
+
+    void finish(LoadBalancer::clock::duration latency, bool success) {
+      finished_ = true;
+      balancer_.on_finish(index_, latency, success);
+    }
+
+    void fail() {
+      finished_ = true;
+      balancer_.on_error(index_);
+    }
+
+    ~InflightGuard() {
+      if (finished_ == false) {
+        balancer_.on_abort(index_);
+      }
+    }
+
+   private:
+    LoadBalancer& balancer_;
+    size_t index_;
+    bool finished_;
+  };
+
+  LoadBalancer balancer_;
+  StubPool<Stub> pool_;
+};
+
+}  // namespace pnrpc
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace pnrpc {
+
+/*
+ * 带过期时间的LRU缓存，可以跨线程使用：
+ *  每个条目有一个代价（charge），所有条目的代价之和不超过capacity，超过时淘汰最久没有被访问的条目，
+ *  按条目个数限制时charge为1，按内存限制时charge为条目占用的字节数；
+ *  条目在ttl之内是新鲜的，之后的stale时间内是陈旧的（stale-while-revalidate：可以返回给调用者，同时由一个调用者负责刷新），
+ *  再之后被视为不存在。
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class LruCache {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  enum class State {
+    Miss,
+    Fresh,
+    Stale,
+  };
+
+  explicit LruCache(size_t capacity) : capacity_(capacity), charge_(0) {}
+
+  LruCache(const LruCache&) = delete;
+  LruCache& operator=(const LruCache&) = delete;
+
+  // 条目陈旧时，第一个获取到它的调用者的refresh被设置为true，由其负责刷新
+  State get(const Key& key, Value& value, bool* refresh = nullptr) {
+    std::lock_guard<std::mutex> guard(mut_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return State::Miss;
+    }
+    auto now = clock::now();
+    auto& entry = *it->second;
+    if (now >= entry.stale_until) {
+      erase(it);
+      return State::Miss;
+    }
+    entries_.splice(entries_.begin(), entries_, it->second);
+    value = entry.value;
+    if (now < entry.expire) {
+      return State::Fresh;
+    }
+    if (refresh != nullptr) {
+      *refresh = !entry.refreshing;
+    }
+    entry.refreshing = true;
+    return State::Stale;
+  }
+
+  void put(const Key& key, Value value, std::chrono::milliseconds ttl, std::chrono::milliseconds stale = {},
+           size_t charge = 1) {
+    std::lock_guard<std::mutex> guard(mut_);
+    if (charge > capacity_) {
+      return;
+    }
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      erase(it);
+    }
+    auto now = clock::now();
+    entries_.push_front(Entry{key, std::move(value), now + ttl, now + ttl + stale, charge, false});
+    index_.emplace(key, entries_.begin());
+    charge_ += charge;
+    while (charge_ > capacity_) {
+      erase(index_.find(entries_.back().key));
+    }
+  }
+
+  // 刷新失败时调用，允许下一个调用者重新刷新
+  void refresh_failed(const Key& key) {
+    std::lock_guard<std::mutex> guard(mut_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+      it->second->refreshing = false;
+    }
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> guard(mut_);
+    return index_.size();
+  }
+
+  size_t charge() const {
+    std::lock_guard<std::mutex> guard(mut_);
+    return charge_;
+  }
+
+ private:
+  struct Entry {
+    Key key;
+    Value value;
+    clock::time_point expire;
+    clock::time_point stale_until;
+    size_t charge;
+    bool refreshing;
+  };
+
+  using Iterator = typename std::list<Entry>::iterator;
+
+  void erase(typename std::unordered_map<Key, Iterator, Hash>::iterator it) {
+    charge_ -= it->second->charge;
+    entries_.erase(it->second);
+    index_.erase(it);
+  }
+
+  mutable std::mutex mut_;
+  size_t capacity_;
+  size_t charge_;
+  std::list<Entry> entries_;
+  std::unordered_map<Key, Iterator, Hash> index_;
+};
+
+}  // namespace pnrpc
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "pnrpc/asio_version.h"
+#include "pnrpc/exception.h"
+
+namespace pnrpc {
+
+/*
+ * 服务端正在处理的请求占用的内存预算（单位字节），可以被多个io_context上的连接共享：
+ *  读取请求包之前按照其长度申请预算，预算不足时暂停读取（不再从socket读取数据，由TCP对客户端形成背压），
+ *  直到其他请求释放预算；等待者按照先来先服务的顺序被满足，避免大请求被小请求饿死；
+ *  单个请求超过总预算时按照总预算计算，因此总能被满足。
+ *  等待者可能运行在其他线程中，释放预算时通过post到其executor上取消其timer来唤醒它。
+ */
+class MemoryBudget {
+ public:
+  // 持有的预算在析构时归还
+  class Reservation {
+   public:
+    Reservation() : budget_(nullptr), bytes_(0) {}
+
+    Reservation(MemoryBudget* budget, size_t bytes) : budget_(budget), bytes_(bytes) {}
+
+    Reservation(Reservation&& other) noexcept
+        : budget_(std::exchange(other.budget_, nullptr)), bytes_(std::exchange(other.bytes_, 0)) {}
+
+    Reservation& operator=(Reservation&& other) noexcept {
+      if (this != &other) {
+        release();
+        budget_ = std::exchange(other.budget_, nullptr);
+        bytes_ = std::exchange(other.bytes_, 0);
+      }
+      return *this;
+    }
+
+    Reservation(const Reservation&) = delete;
+    Reservation& operator=(const Reservation&) = delete;
+
+    ~Reservation() { release(); }
+
+    size_t bytes() const { return bytes_; }
+
+    void release() {
+      if (budget_ != nullptr) {
+        budget_->release(bytes_);
+        budget_ = nullptr;
+        bytes_ = 0;
+      }
+    }
+
+   private:
+    MemoryBudget* budget_;
+    size_t bytes_;
+  };
+
+  explicit MemoryBudget(size_t capacity) : capacity_(capacity), used_(0) {
+    if (capacity == 0) {
+      throw PnrpcException("memory budget's capacity should be greater than 0");
+    }
+  }
+
+  MemoryBudget(const MemoryBudget&) = delete;
+  MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+  // 等待直到预算足够，等待期间协程被取消时抛出异常
+  net::awaitable<Reservation> Acquire(size_t bytes) {
+    bytes = std::min(bytes, capacity_);
+    auto waiter = std::make_shared<Waiter>();
+    {
+      std::lock_guard<std::mutex> guard(mut_);
+      if (waiters_.empty() && used_ + bytes <= capacity_) {
+        used_ += bytes;
+        co_return Reservation(this, bytes);
+      }
+      waiter->bytes = bytes;
+      waiter->timer = std::make_shared<net::steady_timer>(co_await net::this_coro::executor,
+                                                          net::steady_timer::time_point::max());
+      waiters_.push_back(waiter);
+    }
+    error_code ec;
+    co_await waiter->timer->async_wait(net::redirect_error(net::use_awaitable, ec));
+    std::lock_guard<std::mutex> guard(mut_);
+    if (waiter->granted == false) {
+      std::erase(waiters_, waiter);
+      // 排在队首的等待者被取消之后，后面的等待者可能已经可以被满足
+      wake_waiters();
+      throw system_error(net::error::operation_aborted, "memory budget acquire cancelled");
+    }
+    co_return Reservation(this, bytes);
+  }
+
+  size_t capacity() const { return capacity_; }
+
+  size_t in_use() const {
+    std::lock_guard<std::mutex> guard(mut_);
+    return used_;
+  }
+
+  size_t waiting() const {
+    std::lock_guard<std::mutex> guard(mut_);
+    return waiters_.size();
+  }
+
+ private:
+  struct Waiter {
+    size_t bytes = 0;
+    bool granted = false;
+    std::shared_ptr<net::steady_timer> timer;
+  };
+
+  void release(size_t bytes) {
+    std::lock_guard<std::mutex> guard(mut_);
+    used_ -= bytes;
+    wake_waiters();
+  }
+
+  // 调用者需要持有mut_
+  void wake_waiters() {
+    while (!waiters_.empty() && used_ + waiters_.front()->bytes <= capacity_) {
+      auto waiter = std::move(waiters_.front());
+      waiters_.pop_front();
+      used_ += waiter->bytes;
+      waiter->granted = true;
+      net::post(waiter->timer->get_executor(), [timer = waiter->timer]() { timer->cancel(); });
+    }
+  }
+
+  const size_t capacity_;
+  mutable std::mutex mut_;
+  size_t used_;
+  std::deque<std::shared_ptr<Waiter>> waiters_;
+};
+
+}  // namespace pnrpc
@@ -10,12 +10,17 @@
 #include "pnrpc/log.h"
 #include "pnrpc/rebind_ctx.h"
 #include "pnrpc/rpc_server.h"
+#include "pnrpc/shm_channel.h"
+#include "pnrpc/transport.h"
 #include "pnrpc/util.h"
 
 namespace pnrpc {
 
-net::awaitable<void> work(net::ip::tcp::socket socket, net::io_context& io);
+// shm为true时首先与客户端握手建立共享内存通道，之后的数据都通过该通道传输
+net::awaitable<void> work(Socket socket, net::io_context& io, bool shm = false);
 
+// ip以"unix:"开头时监听unix domain socket，以"shm:"开头时在unix domain socket上与客户端建立共享内存通道，
+// 此时port被忽略
 net::awaitable<void> listener(const std::string& ip, uint16_t port, net::io_context& io,
                               std::vector<std::unique_ptr<net::io_context>>& handle_io);
 
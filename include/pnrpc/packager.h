@@ -1,8 +1,11 @@
 #pragma once
 
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "bridge/object.h"
 #include "pnrpc/log.h"
@@ -12,34 +15,70 @@
 
 namespace pnrpc {
 
+// 多个元素打包在一个包中时，数据部分由多个 长度(4字节) + 元素 组成
+template <typename RpcType>
+void elementsSeri(std::span<const RpcType> packages, std::string& appender) {
+  std::string tmp;
+  for (const auto& each : packages) {
+    tmp.clear();
+    RpcCreator<RpcType>::to_raw_bytes(each, tmp);
+    subFrameSeri(tmp, appender);
+  }
+}
+
+template <typename RpcType>
+std::vector<RpcType> ParseElements(std::string_view data) {
+  std::vector<RpcType> packages;
+  for (auto each : ParseSubFrames(data)) {
+    packages.push_back(RpcCreator<RpcType>::create(each.data(), each.size()));
+  }
+  return packages;
+}
+
 template <typename RpcType>
 class RequestPackager {
  public:
-  void seri_request_package(const RpcType& package, std::string& appender, uint32_t pcode, bool eof) {
-    pcodeSeri(pcode, appender);
-    eofSeri(eof, appender);
+  void seri_request_package(const RpcType& package, std::string& appender, const RequestHeader& header) {
+    requestHeaderSeri(header, appender);
     RpcCreator<RpcType>::to_raw_bytes(package, appender);
   }
 
-  RpcType parse_request_package(const std::string& msg, uint32_t& pcode, bool& eof) {
+  RpcType parse_request_package(const std::string& msg, RequestHeader& header) {
     const char* ptr = &msg[0];
     size_t buf_len = msg.size();
-    pcode = ParsePcode(ptr, buf_len);
-    eof = ParseEofFlag(ptr, buf_len);
+    header = ParseRequestHeader(ptr, buf_len);
     auto pkg = RpcCreator<RpcType>::create(ptr, buf_len);
     return pkg;
   }
+
+  void seri_request_packages(std::span<const RpcType> packages, std::string& appender, RequestHeader header) {
+    header.elements = true;
+    requestHeaderSeri(header, appender);
+    elementsSeri(packages, appender);
+  }
+
+  // 同时支持单个元素和多个元素的请求包
+  std::vector<RpcType> parse_request_packages(std::string_view msg, RequestHeader& header) {
+    const char* ptr = msg.data();
+    size_t buf_len = msg.size();
+    header = ParseRequestHeader(ptr, buf_len);
+    if (header.elements == true) {
+      return ParseElements<RpcType>(std::string_view(ptr, buf_len));
+    }
+    std::vector<RpcType> packages;
+    packages.push_back(RpcCreator<RpcType>::create(ptr, buf_len));
+    return packages;
+  }
 };
 
 // 这个特化用来在不知道请求参数类型的时候解析基本格式
 template <>
 class RequestPackager<void> {
  public:
-  std::string_view parse_request_package(const std::string& msg, uint32_t& pcode, bool& eof) {
+  std::string_view parse_request_package(std::string_view msg, RequestHeader& header) {
     const char* ptr = &msg[0];
     size_t buf_len = msg.size();
-    pcode = ParsePcode(ptr, buf_len);
-    eof = ParseEofFlag(ptr, buf_len);
+    header = ParseRequestHeader(ptr, buf_len);
     std::string_view request_view(ptr, buf_len);
     return request_view;
   }
@@ -60,8 +99,24 @@ class ResponsePackager {
     appender.append(response);
   }
 
+  // 多个元素打包在一个回复包中，elements字段记录元素个数
+  void seri_response_packages(std::span<const RpcType> packages, std::string& appender, uint32_t ret_code, bool eof) {
+    bridge::BridgePool bp;
+    auto root = bp.map();
+    root->Insert("ret_code", bp.data(ret_code));
+    root->Insert("eof", bp.data(eof == true ? uint32_t(0) : uint32_t(1)));
+    root->Insert("elements", bp.data(static_cast<uint32_t>(packages.size())));
+    std::string pkg_binary;
+    elementsSeri(packages, pkg_binary);
+    root->Insert("response", bp.data(std::move(pkg_binary)));
+    auto response = bridge::Serialize(std::move(root), bp);
+    appender.append(response);
+  }
+
   struct ResponseInfo {
     RpcType response;
+    // 回复包中打包了多个元素时存储在这里，此时response无效
+    std::optional<std::vector<RpcType>> elements;
     uint32_t ret_code;
     std::string err_msg;
     bool eof;
@@ -77,7 +132,15 @@ class ResponsePackager {
     if (ri.ret_code != RPC_OK) {
       ri.err_msg = response;
     } else {
-      ri.response = RpcCreator<RpcType>::create(&response[0], response.size());
+      auto elements = ow["elements"].Get<uint32_t>();
+      if (elements.has_value()) {
+        ri.elements = ParseElements<RpcType>(response);
+        if (ri.elements->size() != elements.value()) {
+          throw PnrpcException("invalid response elements count : " + std::to_string(elements.value()));
+        }
+      } else {
+        ri.response = RpcCreator<RpcType>::create(&response[0], response.size());
+      }
       ri.eof = ow["eof"].Get<uint32_t>().value() == 0;
     }
     return ri;
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "pnrpc/asio_version.h"
+#include "pnrpc/packager.h"
+#include "pnrpc/rpc_concept.h"
+#include "pnrpc/rpc_ret_code.h"
+
+namespace pnrpc {
+
+/*
+ * 服务端推送的发布/订阅：
+ *  客户端通过一个ServerSideStream类型的rpc订阅，该rpc在process()中调用Serve，之后发布的事件会作为回复流推送给客户端，
+ *  直到客户端取消订阅（取消调用或者关闭连接）或者topic被关闭（此时发送一个默认构造的、eof为true的事件）；
+ *  每个事件在Publish时只序列化一次，得到的回复包被所有订阅者共享，写入各自的socket时只需要加上长度字段；
+ *  订阅者可以运行在不同的io_context上，每个订阅者有一个有界的队列，消费过慢时丢弃最旧的事件。
+ *  topic需要比订阅它的rpc活得更久，通常作为全局对象使用。
+ */
+template <typename EventType>
+requires RpcTypeConcept<EventType>
+class Topic {
+ public:
+  using Frame = std::shared_ptr<const std::string>;
+
+  explicit Topic(size_t max_pending = 1024) : max_pending_(max_pending), closed_(false), dropped_(0) {}
+
+  Topic(const Topic&) = delete;
+  Topic& operator=(const Topic&) = delete;
+
+  // 在订阅rpc的process()中调用，processor需要提供set_serialized_response和set_response_arg
+  template <typename Processor>
+  net::awaitable<void> Serve(Processor& processor) {
+    auto executor = co_await net::this_coro::executor;
+    auto subscriber = std::make_shared<Subscriber>();
+    subscriber->timer = std::make_shared<net::steady_timer>(executor);
+    if (subscribe(subscriber) == true) {
+      SubscriberGuard guard(this, subscriber);
+      while (true) {
+        Frame frame;
+        bool closed = false;
+        {
+          std::lock_guard<std::mutex> lock(mut_);
+          if (!subscriber->pending.empty()) {
+            frame = std::move(subscriber->pending.front());
+            subscriber->pending.pop_front();
+          } else if (closed_ == true) {
+            closed = true;
+          } else {
+            subscriber->waiting = true;
+            subscriber->timer->expires_at(net::steady_timer::time_point::max());
+          }
+        }
+        if (frame != nullptr) {
+          co_await processor.set_serialized_response(*frame, false);
+          continue;
+        }
+        if (closed == true) {
+          break;
+        }
+        error_code ec;
+        co_await subscriber->timer->async_wait(net::redirect_error(net::use_awaitable, ec));
+        std::lock_guard<std::mutex> lock(mut_);
+        // 不是被发布者唤醒的，说明订阅rpc被取消
+        if (subscriber->waiting == true) {
+          subscriber->waiting = false;
+          co_return;
+        }
+      }
+    }
+    co_await processor.set_response_arg(EventType(), true);
+    co_return;
+  }
+
+  // 返回事件被投递给的订阅者个数
+  size_t Publish(const EventType& event) {
+    std::string buf;
+    ResponsePackager<EventType> rp;
+    rp.seri_response_package(event, buf, RPC_OK, false);
+    auto frame = std::make_shared<const std::string>(std::move(buf));
+    std::lock_guard<std::mutex> lock(mut_);
+    if (closed_ == true) {
+      return 0;
+    }
+    for (auto& each : subscribers_) {
+      if (each->pending.size() >= max_pending_) {
+        each->pending.pop_front();
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+      }
+      each->pending.push_back(frame);
+      wake(*each);
+    }
+    return subscribers_.size();
+  }
+
+  // 关闭之后不再接受新的订阅，已有的订阅者在推送完队列中的事件之后结束
+  void Close() {
+    std::lock_guard<std::mutex> lock(mut_);
+    closed_ = true;
+    for (auto& each : subscribers_) {
+      wake(*each);
+    }
+  }
+
+  size_t subscriber_count() const {
+    std::lock_guard<std::mutex> lock(mut_);
+    return subscribers_.size();
+  }
+
+  // 由于订阅者消费过慢而被丢弃的事件个数
+  size_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  struct Subscriber {
+    std::shared_ptr<net::steady_timer> timer;
+    std::deque<Frame> pending;
+    bool waiting = false;
+  };
+
+  class SubscriberGuard {
+   public:
+    SubscriberGuard(Topic* topic, std::shared_ptr<Subscriber> subscriber)
+        : topic_(topic), subscriber_(std::move(subscriber)) {}
+
+    ~SubscriberGuard() { topic_->unsubscribe(subscriber_); }
+
+   private:
+    Topic* topic_;
+    std::shared_ptr<Subscriber> subscriber_;
+  };
+
+  bool subscribe(std::shared_ptr<Subscriber> subscriber) {
+    std::lock_guard<std::mutex> lock(mut_);
+    if (closed_ == true) {
+      return false;
+    }
+    subscribers_.push_back(std::move(subscriber));
+    return true;
+  }
+
+  void unsubscribe(const std::shared_ptr<Subscriber>& subscriber) {
+    std::lock_guard<std::mutex> lock(mut_);
+    std::erase(subscribers_, subscriber);
+  }
+
+  // 订阅者可能运行在其他线程中，通过post到其executor上取消timer来唤醒它
+  void wake(Subscriber& subscriber) {
+    if (subscriber.waiting == false) {
+      return;
+    }
+    subscriber.waiting = false;
+    net::post(subscriber.timer->get_executor(), [timer = subscriber.timer]() { timer->cancel(); });
+  }
+
+  const size_t max_pending_;
+  mutable std::mutex mut_;
+  bool closed_;
+  std::atomic<size_t> dropped_;
+  std::vector<std::shared_ptr<Subscriber>> subscribers_;
+};
+
+}  // namespace pnrpc
@@ -1,13 +1,15 @@
 #pragma once
 
 #include "pnrpc/asio_version.h"
+#include "pnrpc/transport.h"
 
 namespace pnrpc {
 
-inline net::ip::tcp::socket rebind_ctx(net::ip::tcp::socket s, net::io_context& io) {
+inline Socket rebind_ctx(Socket s, net::io_context& io) {
+  auto protocol = s.local_endpoint().protocol();
   auto fd = s.release();
-  net::ip::tcp::socket s2(io);
-  s2.assign(net::ip::tcp::v4(), fd);
+  Socket s2(io);
+  s2.assign(protocol, fd);
   return s2;
 }
 
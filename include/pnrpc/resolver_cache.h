@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "pnrpc/asio_version.h"
+#include "pnrpc/log.h"
+
+namespace pnrpc {
+
+/*
+ * 所有stub共享的域名解析缓存：
+ *  数字形式的ip地址直接构造endpoint，不经过resolver；
+ *  解析结果缓存ttl_时间，过期之后协程接口先返回旧的结果，同时在后台异步刷新，不会阻塞io线程；
+ *  没有缓存时协程接口使用async_resolve，只有同步接口会同步解析；
+ *  刷新失败时继续使用旧的结果，并按照指数退避推迟下一次刷新（最多推迟ttl_和refresh_backoff_中较大的一个），不会每次调用都重新解析。
+ * 可以跨线程使用。
+ */
+class ResolverCache {
+ public:
+  using Endpoints = std::vector<net::ip::tcp::endpoint>;
+  using clock = std::chrono::steady_clock;
+  // 自定义的解析函数，失败时抛出system_error
+  using Resolver = std::function<Endpoints(const std::string& host, uint16_t port)>;
+
+  static ResolverCache& Instance() {
+    static ResolverCache obj;
+    return obj;
+  }
+
+  void set_ttl(std::chrono::milliseconds ttl) {
+    std::lock_guard<std::mutex> guard(mut_);
+    ttl_ = ttl;
+  }
+
+  // 刷新失败之后第一次重试的间隔，之后每次失败翻倍
+  void set_refresh_backoff(std::chrono::milliseconds backoff) {
+    std::lock_guard<std::mutex> guard(mut_);
+    refresh_backoff_ = backoff;
+  }
+
+  // 替换系统的解析（例如接入服务发现或者在测试中注入解析结果），为空时恢复系统的解析
+  void set_resolver(Resolver resolver) {
+    std::lock_guard<std::mutex> guard(mut_);
+    resolver_ = std::move(resolver);
+  }
+
+  Endpoints resolve(const std::string& host, uint16_t port) {
+    Endpoints endpoints;
+    if (numeric(host, port, endpoints) == true) {
+      return endpoints;
+    }
+    bool expired = false;
+    bool cached = lookup(host, port, endpoints, expired);
+    if (cached == true && expired == false) {
+      return endpoints;
+    }
+    try {
+      if (auto custom = get_resolver(); custom != nullptr) {
+        endpoints = custom(host, port);
+      } else {
+        net::ip::tcp::resolver resolver(sync_io_);
+        endpoints = to_endpoints(resolver.resolve(host, std::to_string(port)));
+      }
+    } catch (system_error& e) {
+      if (cached == false) {
+        throw;
+      }
+      PNRPC_LOG_WARN("refresh {}:{} failed : {}", host, port, e.what());
+      back_off(host, port);
+      return endpoints;
+    }
+    update(host, port, endpoints);
+    return endpoints;
+  }
+
+  net::awaitable<Endpoints> async_resolve(const std::string& host, uint16_t port) {
+    Endpoints endpoints;
+    if (numeric(host, port, endpoints) == true) {
+      co_return endpoints;
+    }
+    bool expired = false;
+    if (lookup(host, port, endpoints, expired) == true) {
+      if (expired == true && start_refresh(host, port) == true) {
+        net::co_spawn(co_await net::this_coro::executor, refresh(host, port), net::detached);
+      }
+      co_return endpoints;
+    }
+    endpoints = co_await do_async_resolve(host, port);
+    update(host, port, endpoints);
+    co_return endpoints;
+  }
+
+  void clear() {
+    std::lock_guard<std::mutex> guard(mut_);
+    cache_.clear();
+  }
+
+ private:
+  struct Entry {
+    Endpoints endpoints;
+    clock::time_point expire;
+    bool refreshing = false;
+    // 连续刷新失败的次数
+    uint32_t failures = 0;
+  };
+
+  ResolverCache() : ttl_(std::chrono::seconds(30)), refresh_backoff_(std::chrono::seconds(1)) {}
+
+  Resolver get_resolver() {
+    std::lock_guard<std::mutex> guard(mut_);
+    return resolver_;
+  }
+
+  net::awaitable<Endpoints> do_async_resolve(const std::string& host, uint16_t port) {
+    if (auto custom = get_resolver(); custom != nullptr) {
+      co_return custom(host, port);
+    }
+    net::ip::tcp::resolver resolver(co_await net::this_coro::executor);
+    auto results = co_await resolver.async_resolve(host, std::to_string(port), net::use_awaitable);
+    co_return to_endpoints(results);
+  }
+
+  static std::string make_key(const std::string& host, uint16_t port) { return host + ":" + std::to_string(port); }
+
+  static bool numeric(const std::string& host, uint16_t port, Endpoints& endpoints) {
+    error_code ec;
+    auto address = net::ip::make_address(host, ec);
+    if (ec) {
+      return false;
+    }
+    endpoints.emplace_back(address, port);
+    return true;
+  }
+
+  static Endpoints to_endpoints(const net::ip::tcp::resolver::results_type& results) {
+    Endpoints endpoints;
+    for (const auto& each : results) {
+      endpoints.push_back(each.endpoint());
+    }
+    return endpoints;
+  }
+
+  bool lookup(const std::string& host, uint16_t port, Endpoints& endpoints, bool& expired) {
+    std::lock_guard<std::mutex> guard(mut_);
+    auto it = cache_.find(make_key(host, port));
+    if (it == cache_.end()) {
+      return false;
+    }
+    endpoints = it->second.endpoints;
+    expired = it->second.expire <= clock::now();
+    return true;
+  }
+
+  // 同一个地址同时只有一个刷新任务
+  bool start_refresh(const std::string& host, uint16_t port) {
+    std::lock_guard<std::mutex> guard(mut_);
+    auto& entry = cache_[make_key(host, port)];
+    if (entry.refreshing == true) {
+      return false;
+    }
+    entry.refreshing = true;
+    return true;
+  }
+
+  void update(const std::string& host, uint16_t port, const Endpoints& endpoints) {
+    std::lock_guard<std::mutex> guard(mut_);
+    cache_[make_key(host, port)] = Entry{endpoints, clock::now() + ttl_, false};
+  }
+
+  // 刷新失败时保留旧的结果，推迟下一次刷新
+  void back_off(const std::string& host, uint16_t port) {
+    std::lock_guard<std::mutex> guard(mut_);
+    auto& entry = cache_[make_key(host, port)];
+    auto backoff = refresh_backoff_ * (uint64_t(1) << std::min<uint32_t>(entry.failures, 16));
+    entry.expire = clock::now() + std::min<std::chrono::milliseconds>(backoff, std::max(ttl_, refresh_backoff_));
+    entry.failures += 1;
+    entry.refreshing = false;
+  }
+
+  net::awaitable<void> refresh(std::string host, uint16_t port) {
+    try {
+      update(host, port, co_await do_async_resolve(host, port));
+    } catch (system_error& e) {
+      PNRPC_LOG_WARN("refresh {}:{} failed : {}", host, port, e.what());
+      back_off(host, port);
+    }
+    co_return;
+  }
+
+  std::mutex mut_;
+  std::chrono::milliseconds ttl_;
+  std::chrono::milliseconds refresh_backoff_;
+  Resolver resolver_;
+  std::unordered_map<std::string, Entry> cache_;
+  // 同步解析只需要一个executor来构造resolver，不需要运行
+  net::io_context sync_io_;
+};
+
+}  // namespace pnrpc
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "pnrpc/asio_version.h"
+#include "pnrpc/log.h"
+#include "pnrpc/packager.h"
+#include "pnrpc/rpc_client.h"
+#include "pnrpc/rpc_ret_code.h"
+#include "pnrpc/stream.h"
+#include "pnrpc/transport.h"
+#include "pnrpc/util.h"
+
+namespace pnrpc {
+
+template <typename RequestType, typename ResponseType, uint32_t pcode, typename Traits>
+std::true_type is_simple_stub(RpcStub<RequestType, ResponseType, pcode, RpcType::Simple, Traits>*);
+
+std::false_type is_simple_stub(...);
+
+/*
+ * 批量调用Simple类型rpc的客户端：
+ *  在window时间内（或者凑满max_batch个）发起的调用被打包成一个批量请求，通过一个数据帧发送给服务端，服务端并发执行
+ *  这些调用之后通过一个数据帧返回所有的回复（见RpcServer::HandleBatch），因此大量的小请求只需要一次往返；
+ *  同一时刻连接上只有一个批量请求在途，在途期间发起的调用被收集到下一批中；
+ *  Stub为RPC_DECLARE生成的Simple类型rpc的stub，所有调用需要在同一个io_context的线程中发起。
+ */
+template <typename Stub>
+class RpcBatchStub {
+ public:
+  using request_t = typename Stub::request_t;
+  using response_t = typename Stub::response_t;
+  static constexpr uint32_t pcode = Stub::rpc_pcode;
+
+  static_assert(decltype(is_simple_stub(std::declval<Stub*>()))::value, "only simple rpc can be batched");
+
+  RpcBatchStub(net::io_context& io, const std::string& ip, uint16_t port, size_t max_batch = 64,
+               std::chrono::microseconds window = std::chrono::microseconds(500))
+      : io_(io),
+        socket_(io_),
+        ip_(ip),
+        port_(port),
+        max_batch_(max_batch == 0 ? 1 : max_batch),
+        window_(window),
+        collecting_(nullptr),
+        in_flight_(nullptr) {}
+
+  // 与RpcStub::rpc_call_coro的语义相同，连接在第一次发送批量请求时建立，出错之后在下一批重新建立
+  net::awaitable<int> rpc_call_coro(const request_t& r, response_t& response) {
+    Call call{&response, RPC_OK};
+    bool leader = false;
+    if (collecting_ == nullptr) {
+      collecting_ = std::make_shared<Batch>(io_);
+      leader = true;
+    }
+    auto batch = collecting_;
+    batch->add(r, &call);
+    if (batch->calls.size() >= max_batch_) {
+      close_collecting(*batch);
+    }
+    // 每一批的第一个调用者负责发送这一批请求并分发回复，其余调用者等待结果
+    if (leader == true) {
+      co_await run(batch);
+    } else {
+      co_await wait_finished(*batch);
+    }
+    co_return call.ret_code;
+  }
+
+  net::awaitable<void> async_connect() {
+    co_await async_connect_to(socket_, ip_, port_);
+    co_return;
+  }
+
+ private:
+  struct Call {
+    response_t* response;
+    uint32_t ret_code;
+  };
+
+  struct Batch {
+    explicit Batch(net::io_context& io) : window(io), done(io), closed(false), finished(false) {
+      RequestHeader header;
+      header.pcode = batch_pcode;
+      header.eof = true;
+      requestHeaderSeri(header, payload);
+      done.expires_at(net::steady_timer::time_point::max());
+    }
+
+    void add(const request_t& r, Call* call) {
+      std::string frame;
+      RequestHeader header;
+      header.pcode = pcode;
+      header.eof = true;
+      RequestPackager<request_t> rp;
+      rp.seri_request_package(r, frame, header);
+      subFrameSeri(frame, payload);
+      calls.push_back(call);
+    }
+
+    void finish() {
+      finished = true;
+      done.cancel();
+    }
+
+    std::string payload;
+    std::vector<Call*> calls;
+    net::steady_timer window;
+    net::steady_timer done;
+    bool closed;
+    bool finished;
+  };
+
+  void close_collecting(Batch& batch) {
+    batch.closed = true;
+    batch.window.cancel();
+    collecting_ = nullptr;
+  }
+
+  net::awaitable<void> run(std::shared_ptr<Batch> batch) {
+    if (batch->closed == false) {
+      error_code ec;
+      batch->window.expires_after(window_);
+      co_await batch->window.async_wait(net::redirect_error(net::use_awaitable, ec));
+      if (batch->closed == false) {
+        close_collecting(*batch);
+      }
+    }
+    // 等待上一批请求返回
+    auto prev = std::exchange(in_flight_, batch);
+    if (prev != nullptr) {
+      co_await wait_finished(*prev);
+    }
+    try {
+      co_await send_and_recv(*batch);
+    } catch (std::exception& e) {
+      PNRPC_LOG_WARN("rpc {} batch call failed : {}", pcode, e.what());
+      // 连接上可能残留未读取的数据，关闭连接之后由下一批重新建立
+      error_code ec;
+      socket_.close(ec);
+      for (auto each : batch->calls) {
+        each->ret_code = RPC_NET_ERR;
+      }
+    }
+    if (in_flight_ == batch) {
+      in_flight_ = nullptr;
+    }
+    batch->finish();
+    co_return;
+  }
+
+  net::awaitable<void> send_and_recv(Batch& batch) {
+    if (!socket_.is_open()) {
+      co_await async_connect();
+    }
+    RawStream rs;
+    rs.update_bind_socket(&socket_);
+    co_await rs.Send(batch.payload);
+    std::string buf = co_await rs.Read();
+    auto frames = ParseSubFrames(buf);
+    if (frames.size() != batch.calls.size()) {
+      throw PnrpcException("batch response count mismatch : " + std::to_string(frames.size()) +
+                           " != " + std::to_string(batch.calls.size()));
+    }
+    for (size_t i = 0; i < frames.size(); ++i) {
+      ResponsePackager<response_t> rp;
+      auto ri = rp.parse_response_package(std::string(frames[i]));
+      batch.calls[i]->ret_code = ri.ret_code;
+      if (ri.ret_code != RPC_OK) {
+        PNRPC_LOG_INFO("rpc call failed, ret_code = {}, err_msg = {}", ri.ret_code, ri.err_msg);
+      } else {
+        *batch.calls[i]->response = std::move(ri.response);
+      }
+    }
+    co_return;
+  }
+
+  static net::awaitable<void> wait_finished(Batch& batch) {
+    while (batch.finished == false) {
+      error_code ec;
+      co_await batch.done.async_wait(net::redirect_error(net::use_awaitable, ec));
+    }
+    co_return;
+  }
+
+  net::io_context& io_;
+  Socket socket_;
+  std::string ip_;
+  uint16_t port_;
+  size_t max_batch_;
+  std::chrono::microseconds window_;
+  // 正在收集调用的批次
+  std::shared_ptr<Batch> collecting_;
+  // 已经发送、等待回复的批次
+  std::shared_ptr<Batch> in_flight_;
+};
+
+}  // namespace pnrpc
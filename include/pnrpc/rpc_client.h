@@ -1,14 +1,27 @@
 #pragma once
 
+#include <poll.h>
+
+#include <chrono>
+#include <concepts>
 #include <cstdint>
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
+#include <vector>
 
 #include "pnrpc/asio_version.h"
+#include "pnrpc/exception.h"
 #include "pnrpc/log.h"
+#include "pnrpc/lru_cache.h"
 #include "pnrpc/rpc_concept.h"
 #include "pnrpc/rpc_ret_code.h"
+#include "pnrpc/rpc_server.h"
+#include "pnrpc/rpc_type_creator.h"
+#include "pnrpc/shm_channel.h"
 #include "pnrpc/stream.h"
+#include "pnrpc/transport.h"
 #include "pnrpc/util.h"
 
 namespace pnrpc {
@@ -20,45 +33,268 @@ class RpcStubBase {
   using request_t = RequestType;
   using response_t = ResponseType;
 
+  static constexpr uint32_t rpc_pcode = pcode;
+
   RpcStubBase(net::io_context& io, const std::string& ip, uint16_t port)
-      : io_(io), socket_(io_), ip_(ip), port_(port), request_stream(pcode), response_stream() {
+      : io_(io),
+        socket_(io_),
+        shm_(),
+        ip_(ip),
+        port_(port),
+        deadline_(),
+        deadline_sent_(false),
+        flow_control_(),
+        request_stream(pcode),
+        response_stream() {
     request_stream.update_bind_socket(&socket_);
     response_stream.update_bind_socket(&socket_);
+    request_stream.bind_flow_control(&flow_control_);
+    response_stream.bind_flow_control(&flow_control_);
+  }
+
+  // 在rpc处理函数中访问其他rpc时使用这个构造函数，stub会使用parent的io_context并继承parent的deadline
+  RpcStubBase(RpcProcessorBase& parent, const std::string& ip, uint16_t port)
+      : RpcStubBase(parent.get_io_context(), ip, port) {
+    deadline_ = parent.get_deadline();
+  }
+
+  // 设置本次调用的deadline，如果已经存在更早的deadline（例如继承自parent）则保持不变
+  void set_deadline(Deadline deadline) {
+    if (!deadline_.has_value() || deadline < deadline_.value()) {
+      deadline_ = deadline;
+    }
+  }
+
+  void set_timeout(std::chrono::milliseconds timeout) { set_deadline(std::chrono::steady_clock::now() + timeout); }
+
+  const std::optional<Deadline>& get_deadline() const { return deadline_; }
+
+  // 连接被复用给下一次调用之前清除本次调用设置的deadline
+  void clear_deadline() {
+    deadline_.reset();
+    deadline_sent_ = false;
+  }
+
+  // 空闲的连接是否可以继续发起调用：连接已经关闭、对端关闭了连接（例如服务端的空闲超时）或者连接上有残留的数据时返回false
+  bool is_reusable() {
+    if (is_local()) {
+      return true;
+    }
+    if (!socket_.is_open()) {
+      return false;
+    }
+    pollfd pfd{socket_.native_handle(), POLLIN, 0};
+    return ::poll(&pfd, 1, 0) == 0;
+  }
+
+  // 不小于threshold字节的请求包压缩之后发送，并允许服务端压缩回复（服务端的rpc同样需要开启压缩），0表示不压缩
+  void enable_compression(size_t threshold) {
+    request_stream.enable_compression(threshold);
+    request_stream.set_accept_compressed(threshold != 0);
   }
 
-  net::awaitable<net::ip::tcp::endpoint> async_connect() {
-    net::ip::tcp::resolver resolver(io_);
-    auto ep = resolver.resolve(ip_, std::to_string(port_));
-    co_return co_await net::async_connect(socket_, ep, net::use_awaitable);
+  // 扩大服务器到客户端方向流式回复的接收窗口（单位字节），额外的credit随第一个请求包发送给服务端
+  void set_response_window(size_t window) { flow_control_.enlarge_recv_window(window); }
+
+  // 放弃本次调用（例如客户端等待超时），服务端会取消正在执行的rpc处理函数以及其中等待的异步操作。
+  // 调用之后本stub不能再发送请求。
+  net::awaitable<void> cancel() {
+    if (socket_.is_open()) {
+      co_await request_stream.Cancel();
+    }
+    co_return;
+  }
+
+  void cancel_sync() {
+    if (socket_.is_open()) {
+      request_stream.CancelSync();
+    }
+  }
+
+  // ip以"unix:"开头时连接unix domain socket，以"shm:"开头时建立共享内存通道，为"inproc:"时不建立连接，
+  // 否则地址解析经过ResolverCache，见transport.h
+  net::awaitable<Socket::endpoint_type> async_connect() {
+    if (is_local()) {
+      co_return Socket::endpoint_type();
+    }
+    auto ep = co_await async_connect_to(socket_, ip_, port_);
+    if (is_shm_address(ip_)) {
+      bind_shm(co_await ShmChannel::Connect(socket_));
+    }
+    co_return ep;
   }
 
-  net::ip::tcp::endpoint connect() {
-    net::ip::tcp::resolver resolver(io_);
-    auto ep = resolver.resolve(ip_, std::to_string(port_));
-    return net::connect(socket_, ep);
+  Socket::endpoint_type connect() {
+    if (is_local()) {
+      return Socket::endpoint_type();
+    }
+    auto ep = connect_to(socket_, ip_, port_);
+    if (is_shm_address(ip_)) {
+      bind_shm(ShmChannel::ConnectSync(socket_));
+    }
+    return ep;
   }
 
  private:
+  void bind_shm(std::shared_ptr<ShmChannel> shm) {
+    shm_ = std::move(shm);
+    request_stream.update_bind_socket(&socket_, shm_.get());
+    response_stream.update_bind_socket(&socket_, shm_.get());
+  }
+
   net::io_context& io_;
-  net::ip::tcp::socket socket_;
+  Socket socket_;
+  std::shared_ptr<ShmChannel> shm_;
   std::string ip_;
   uint16_t port_;
+  std::optional<Deadline> deadline_;
+  bool deadline_sent_;
+  FlowControl flow_control_;
 
  protected:
+  // 每次发送请求之前调用：已经超时则返回RPC_DEADLINE_EXCEEDED，否则在第一个请求包中携带剩余的超时时间
+  int check_deadline() {
+    if (!deadline_.has_value()) {
+      return RPC_OK;
+    }
+    uint32_t remaining = remainingMs(deadline_.value());
+    if (remaining == 0) {
+      PNRPC_LOG_INFO("rpc {} deadline exceeded before send", pcode);
+      return RPC_DEADLINE_EXCEEDED;
+    }
+    if (deadline_sent_ == false) {
+      request_stream.set_timeout(remaining);
+      deadline_sent_ = true;
+    }
+    return RPC_OK;
+  }
+
+  // 同一个stub上的每次调用开始时调用（Simple类型的stub可以复用连接发起多次调用）：
+  // 服务端为每个请求使用新的流控状态，剩余的超时时间在每次调用的第一个请求包中重新携带
+  void begin_call() {
+    flow_control_.reset();
+    deadline_sent_ = false;
+    request_stream.reset();
+    response_stream.reset();
+  }
+
+  // 流式rpc不支持进程内调用，在构造时拒绝"inproc:"地址，避免之后在没有连接的socket上读写
+  void reject_local() const {
+    if (is_local()) {
+      throw PnrpcException("rpc " + std::to_string(pcode) + " is a stream rpc, inproc address is not supported");
+    }
+  }
+
+  net::io_context& get_io() { return io_; }
+
+  const std::string& get_ip() const { return ip_; }
+
+  uint16_t get_port() const { return port_; }
+
+  // 进程内调用，只有Simple和OneWay类型的rpc支持
+  bool is_local() const { return is_inproc_address(ip_); }
+
   ClientToServerStream<request_t> request_stream;
   ServerToClientStream<response_t> response_stream;
 };
 
-template <typename RequestType, typename ResponseType, uint32_t pcode, RpcType rpc_type>
+// 客户端缓存的配置，单位毫秒，stale_ms为0表示不使用stale-while-revalidate
+struct ClientCacheOptions {
+  int64_t ttl_ms;
+  int64_t stale_ms;
+  size_t capacity;
+};
+
+// Traits为RPC_DECLARE生成的processor类型，通过ENABLE_CLIENT_CACHE声明的rpc开启客户端缓存
+template <typename Traits>
+concept ClientCacheTraits = requires {
+  { Traits::client_cache } -> std::convertible_to<ClientCacheOptions>;
+};
+
+// 按照RPC_DECLARE中声明的选项配置stub，由RPC_DECLARE生成的stub在构造时调用
+template <typename Traits, typename Stub>
+void ApplyStubOptions(Stub& stub) {
+  if constexpr (requires { Traits::compress_threshold; }) {
+    stub.enable_compression(Traits::compress_threshold);
+  }
+}
+
+template <typename RequestType, typename ResponseType, uint32_t pcode, RpcType rpc_type, typename Traits = void>
 class RpcStub : public RpcStubBase<RequestType, ResponseType, pcode> {
  public:
   using request_t = typename RpcStubBase<RequestType, ResponseType, pcode>::request_t;
   using response_t = typename RpcStubBase<RequestType, ResponseType, pcode>::response_t;
 
+  // 同一个stub可以依次发起多次调用，见StubPool
+  static constexpr bool reusable = true;
+
   RpcStub(net::io_context& io, const std::string& ip, uint16_t port)
       : RpcStubBase<RequestType, ResponseType, pcode>(io, ip, port) {}
 
+  RpcStub(RpcProcessorBase& parent, const std::string& ip, uint16_t port)
+      : RpcStubBase<RequestType, ResponseType, pcode>(parent, ip, port) {}
+
+  // 开启了客户端缓存时，命中缓存的调用不会发送请求；陈旧的缓存直接返回，同时在后台刷新
   net::awaitable<int> rpc_call_coro(const request_t& r, response_t& response) {
+    if constexpr (ClientCacheTraits<Traits>) {
+      std::string key = cache_key(r);
+      bool refresh = false;
+      auto state = client_cache().get(key, response, &refresh);
+      if (state == ClientCache::State::Stale && refresh == true) {
+        net::co_spawn(this->get_io(), revalidate(this->get_io(), this->get_ip(), this->get_port(), r, std::move(key)),
+                      net::detached);
+      }
+      if (state != ClientCache::State::Miss) {
+        co_return RPC_OK;
+      }
+      int ret_code = co_await remote_call(r, response);
+      if (ret_code == RPC_OK) {
+        cache_put(key, response);
+      }
+      co_return ret_code;
+    } else {
+      co_return co_await remote_call(r, response);
+    }
+  }
+
+  // 进程内调用（地址为"inproc:"）时请求被移动给处理函数，不需要拷贝
+  net::awaitable<int> rpc_call_coro(request_t&& r, response_t& response) {
+    if constexpr (!ClientCacheTraits<Traits>) {
+      if (this->is_local()) {
+        co_return co_await local_call(std::move(r), response);
+      }
+    }
+    co_return co_await rpc_call_coro(static_cast<const request_t&>(r), response);
+  }
+
+  // 同步接口只使用新鲜的缓存
+  int rpc_call(const request_t& r, response_t& response) {
+    if constexpr (ClientCacheTraits<Traits>) {
+      std::string key = cache_key(r);
+      response_t tmp;
+      if (client_cache().get(key, tmp) == ClientCache::State::Fresh) {
+        response = std::move(tmp);
+        return RPC_OK;
+      }
+      int ret_code = remote_call_sync(r, response);
+      if (ret_code == RPC_OK) {
+        cache_put(key, response);
+      }
+      return ret_code;
+    } else {
+      return remote_call_sync(r, response);
+    }
+  }
+
+ private:
+  net::awaitable<int> remote_call(const request_t& r, response_t& response) {
+    if (this->is_local()) {
+      co_return co_await local_call(request_t(r), response);
+    }
+    this->begin_call();
+    if (int ret = this->check_deadline(); ret != RPC_OK) {
+      co_return ret;
+    }
     co_await this->request_stream.Send(r, true);
     uint32_t ret_code = 0;
     std::string err_msg;
@@ -74,7 +310,20 @@ class RpcStub : public RpcStubBase<RequestType, ResponseType, pcode> {
     co_return ret_code;
   }
 
-  int rpc_call(const request_t& r, response_t& response) {
+  int remote_call_sync(const request_t& r, response_t& response) {
+    // 同步的进程内调用在一个临时的io_context中执行处理函数
+    if (this->is_local()) {
+      net::io_context io;
+      auto result = net::co_spawn(io, RpcServer::Instance().CallLocal(io, pcode, request_t(r), response,
+                                                                      this->get_deadline()),
+                                  net::use_future);
+      io.run();
+      return result.get();
+    }
+    this->begin_call();
+    if (int ret = this->check_deadline(); ret != RPC_OK) {
+      return ret;
+    }
     this->request_stream.SendSync(r, true);
     uint32_t ret_code = 0;
     std::string err_msg;
@@ -89,22 +338,129 @@ class RpcStub : public RpcStubBase<RequestType, ResponseType, pcode> {
     }
     return ret_code;
   }
+
+  net::awaitable<int> local_call(request_t&& r, response_t& response) {
+    co_return co_await RpcServer::Instance().CallLocal(this->get_io(), pcode, std::move(r), response,
+                                                       this->get_deadline());
+  }
+
+  using ClientCache = LruCache<std::string, response_t>;
+
+  // 同一个rpc的所有stub共享一个缓存
+  static ClientCache& client_cache() requires ClientCacheTraits<Traits> {
+    static ClientCache cache(Traits::client_cache.capacity);
+    return cache;
+  }
+
+  // 缓存的key为 pcode + 序列化之后的请求
+  static std::string cache_key(const request_t& r) {
+    std::string key;
+    pcodeSeri(pcode, key);
+    RpcCreator<request_t>::to_raw_bytes(r, key);
+    return key;
+  }
+
+  static void cache_put(const std::string& key, const response_t& response) requires ClientCacheTraits<Traits> {
+    client_cache().put(key, response, std::chrono::milliseconds(Traits::client_cache.ttl_ms),
+                       std::chrono::milliseconds(Traits::client_cache.stale_ms));
+  }
+
+  static net::awaitable<void> revalidate(net::io_context& io, std::string ip, uint16_t port, request_t r,
+                                         std::string key) requires ClientCacheTraits<Traits> {
+    try {
+      RpcStub stub(io, ip, port);
+      co_await stub.async_connect();
+      response_t response;
+      if (co_await stub.remote_call(r, response) == RPC_OK) {
+        cache_put(key, response);
+        co_return;
+      }
+    } catch (std::exception& e) {
+      PNRPC_LOG_INFO("rpc {} revalidate failed : {}", pcode, e.what());
+    }
+    client_cache().refresh_failed(key);
+    co_return;
+  }
 };
 
-template <typename RequestType, typename ResponseType, uint32_t pcode>
-class RpcStub<RequestType, ResponseType, pcode, RpcType::ClientSideStream>
+// 单向rpc：请求写入socket之后立即返回，不等待服务端执行，也不会收到任何回复（包括错误信息）。
+// 与其他类型的stub不同，同一个stub可以连续发送多个请求，服务端在同一个连接上依次执行。
+template <typename RequestType, typename ResponseType, uint32_t pcode, typename Traits>
+class RpcStub<RequestType, ResponseType, pcode, RpcType::OneWay, Traits>
+    : public RpcStubBase<RequestType, ResponseType, pcode> {
+ public:
+  using request_t = typename RpcStubBase<RequestType, ResponseType, pcode>::request_t;
+  using response_t = typename RpcStubBase<RequestType, ResponseType, pcode>::response_t;
+
+  RpcStub(net::io_context& io, const std::string& ip, uint16_t port)
+      : RpcStubBase<RequestType, ResponseType, pcode>(io, ip, port) {}
+
+  RpcStub(RpcProcessorBase& parent, const std::string& ip, uint16_t port)
+      : RpcStubBase<RequestType, ResponseType, pcode>(parent, ip, port) {}
+
+  // 返回RPC_OK只表示请求已经发送（进程内调用时表示处理函数已经被调度），不表示服务端执行成功
+  net::awaitable<int> rpc_call_coro(const request_t& r) {
+    if (this->is_local()) {
+      net::co_spawn(this->get_io(), local_call(this->get_io(), r, this->get_deadline()), net::detached);
+      co_return RPC_OK;
+    }
+    if (int ret = this->check_deadline(); ret != RPC_OK) {
+      co_return ret;
+    }
+    co_await this->request_stream.SendOneWay(r);
+    co_return RPC_OK;
+  }
+
+  int rpc_call(const request_t& r) {
+    // 同步的进程内调用在一个临时的io_context中执行处理函数，执行完毕之后返回
+    if (this->is_local()) {
+      net::io_context io;
+      net::co_spawn(io, local_call(io, r, this->get_deadline()), net::detached);
+      io.run();
+      return RPC_OK;
+    }
+    if (int ret = this->check_deadline(); ret != RPC_OK) {
+      return ret;
+    }
+    this->request_stream.SendOneWaySync(r);
+    return RPC_OK;
+  }
+
+ private:
+  static net::awaitable<void> local_call(net::io_context& io, request_t r, std::optional<Deadline> deadline) {
+    response_t response;
+    int ret_code = co_await RpcServer::Instance().CallLocal(io, pcode, std::move(r), response, deadline);
+    if (ret_code != RPC_OK) {
+      PNRPC_LOG_INFO("rpc {} local one way call failed, ret_code = {}", pcode, ret_code);
+    }
+    co_return;
+  }
+};
+
+template <typename RequestType, typename ResponseType, uint32_t pcode, typename Traits>
+class RpcStub<RequestType, ResponseType, pcode, RpcType::ClientSideStream, Traits>
     : public RpcStubBase<RequestType, ResponseType, pcode> {
  public:
   using request_t = typename RpcStubBase<RequestType, ResponseType, pcode>::request_t;
   using response_t = typename RpcStubBase<RequestType, ResponseType, pcode>::response_t;
 
   RpcStub(net::io_context& io, const std::string& ip, uint16_t port)
-      : RpcStubBase<RequestType, ResponseType, pcode>(io, ip, port), send_eof_(false), recved_(false) {}
+      : RpcStubBase<RequestType, ResponseType, pcode>(io, ip, port), send_eof_(false), recved_(false) {
+    this->reject_local();
+  }
+
+  RpcStub(RpcProcessorBase& parent, const std::string& ip, uint16_t port)
+      : RpcStubBase<RequestType, ResponseType, pcode>(parent, ip, port), send_eof_(false), recved_(false) {
+    this->reject_local();
+  }
 
   net::awaitable<int> send_request(const request_t& request, bool eof = false) {
     if (send_eof_ == true) {
       co_return RPC_SEND_AFTER_EOF;
     }
+    if (int ret = this->check_deadline(); ret != RPC_OK) {
+      co_return ret;
+    }
     co_await this->request_stream.Send(request, eof);
     send_eof_ = eof;
     co_return RPC_OK;
@@ -114,11 +470,45 @@ class RpcStub<RequestType, ResponseType, pcode, RpcType::ClientSideStream>
     if (send_eof_ == true) {
       return RPC_SEND_AFTER_EOF;
     }
+    if (int ret = this->check_deadline(); ret != RPC_OK) {
+      return ret;
+    }
     this->request_stream.SendSync(request, eof);
     send_eof_ = eof;
     return RPC_OK;
   }
 
+  // 将多个元素打包在一个请求包中发送，eof作用于最后一个元素
+  net::awaitable<int> send_requests(std::span<const request_t> requests, bool eof = false) {
+    if (send_eof_ == true) {
+      co_return RPC_SEND_AFTER_EOF;
+    }
+    if (requests.empty()) {
+      co_return RPC_UNSUPPORTED;
+    }
+    if (int ret = this->check_deadline(); ret != RPC_OK) {
+      co_return ret;
+    }
+    co_await this->request_stream.SendMany(requests, eof);
+    send_eof_ = eof;
+    co_return RPC_OK;
+  }
+
+  int send_requests_sync(std::span<const request_t> requests, bool eof = false) {
+    if (send_eof_ == true) {
+      return RPC_SEND_AFTER_EOF;
+    }
+    if (requests.empty()) {
+      return RPC_UNSUPPORTED;
+    }
+    if (int ret = this->check_deadline(); ret != RPC_OK) {
+      return ret;
+    }
+    this->request_stream.SendManySync(requests, eof);
+    send_eof_ = eof;
+    return RPC_OK;
+  }
+
   net::awaitable<int> recv_response(response_t& response) {
     if (send_eof_ == false) {
       co_return RPC_RECV_BEFORE_EOF;
@@ -166,20 +556,30 @@ class RpcStub<RequestType, ResponseType, pcode, RpcType::ClientSideStream>
   bool recved_;
 };
 
-template <typename RequestType, typename ResponseType, uint32_t pcode>
-class RpcStub<RequestType, ResponseType, pcode, RpcType::ServerSideStream>
+template <typename RequestType, typename ResponseType, uint32_t pcode, typename Traits>
+class RpcStub<RequestType, ResponseType, pcode, RpcType::ServerSideStream, Traits>
     : public RpcStubBase<RequestType, ResponseType, pcode> {
  public:
   using request_t = typename RpcStubBase<RequestType, ResponseType, pcode>::request_t;
   using response_t = typename RpcStubBase<RequestType, ResponseType, pcode>::response_t;
 
   RpcStub(net::io_context& io, const std::string& ip, uint16_t port)
-      : RpcStubBase<RequestType, ResponseType, pcode>(io, ip, port), send_eof_(false) {}
+      : RpcStubBase<RequestType, ResponseType, pcode>(io, ip, port), send_eof_(false) {
+    this->reject_local();
+  }
+
+  RpcStub(RpcProcessorBase& parent, const std::string& ip, uint16_t port)
+      : RpcStubBase<RequestType, ResponseType, pcode>(parent, ip, port), send_eof_(false) {
+    this->reject_local();
+  }
 
   net::awaitable<int> send_request(const request_t& request) {
     if (send_eof_ == true) {
       co_return RPC_SEND_AFTER_EOF;
     }
+    if (int ret = this->check_deadline(); ret != RPC_OK) {
+      co_return ret;
+    }
     send_eof_ = true;
     co_await this->request_stream.Send(request, send_eof_);
     co_return RPC_OK;
@@ -189,6 +589,9 @@ class RpcStub<RequestType, ResponseType, pcode, RpcType::ServerSideStream>
     if (send_eof_ == true) {
       return RPC_SEND_AFTER_EOF;
     }
+    if (int ret = this->check_deadline(); ret != RPC_OK) {
+      return ret;
+    }
     send_eof_ = true;
     this->request_stream.SendSync(request, send_eof_);
     return RPC_OK;
@@ -220,24 +623,62 @@ class RpcStub<RequestType, ResponseType, pcode, RpcType::ServerSideStream>
     return ret_code;
   }
 
+  // 一次接收至少一个、至多n个回复元素，服务端通过set_response_args打包在一个回复包中的元素会被一起取出，
+  // responses为空表示回复接收完毕
+  net::awaitable<int> recv_responses(std::vector<response_t>& responses, size_t n) {
+    if (send_eof_ == false) {
+      co_return RPC_RECV_BEFORE_EOF;
+    }
+    uint32_t ret_code = 0;
+    std::string err_msg;
+    responses = co_await this->response_stream.ReadMany(n, ret_code, err_msg);
+    if (ret_code != RPC_OK) {
+      PNRPC_LOG_WARN("rpc response error : {}, {}", ret_code, err_msg);
+    }
+    co_return ret_code;
+  }
+
+  int recv_responses_sync(std::vector<response_t>& responses, size_t n) {
+    if (send_eof_ == false) {
+      return RPC_RECV_BEFORE_EOF;
+    }
+    uint32_t ret_code = 0;
+    std::string err_msg;
+    responses = this->response_stream.ReadManySync(n, ret_code, err_msg);
+    if (ret_code != RPC_OK) {
+      PNRPC_LOG_WARN("rpc response error : {}, {}", ret_code, err_msg);
+    }
+    return ret_code;
+  }
+
  private:
   bool send_eof_;
 };
 
-template <typename RequestType, typename ResponseType, uint32_t pcode>
-class RpcStub<RequestType, ResponseType, pcode, RpcType::BidirectStream>
+template <typename RequestType, typename ResponseType, uint32_t pcode, typename Traits>
+class RpcStub<RequestType, ResponseType, pcode, RpcType::BidirectStream, Traits>
     : public RpcStubBase<RequestType, ResponseType, pcode> {
  public:
   using request_t = typename RpcStubBase<RequestType, ResponseType, pcode>::request_t;
   using response_t = typename RpcStubBase<RequestType, ResponseType, pcode>::response_t;
 
   RpcStub(net::io_context& io, const std::string& ip, uint16_t port)
-      : RpcStubBase<RequestType, ResponseType, pcode>(io, ip, port), send_eof_(false) {}
+      : RpcStubBase<RequestType, ResponseType, pcode>(io, ip, port), send_eof_(false) {
+    this->reject_local();
+  }
+
+  RpcStub(RpcProcessorBase& parent, const std::string& ip, uint16_t port)
+      : RpcStubBase<RequestType, ResponseType, pcode>(parent, ip, port), send_eof_(false) {
+    this->reject_local();
+  }
 
   net::awaitable<int> send_request(const request_t& request, bool eof = false) {
     if (send_eof_ == true) {
       co_return RPC_SEND_AFTER_EOF;
     }
+    if (int ret = this->check_deadline(); ret != RPC_OK) {
+      co_return ret;
+    }
     send_eof_ = eof;
     co_await this->request_stream.Send(request, eof);
     co_return RPC_OK;
@@ -247,11 +688,45 @@ class RpcStub<RequestType, ResponseType, pcode, RpcType::BidirectStream>
     if (send_eof_ == true) {
       return RPC_SEND_AFTER_EOF;
     }
+    if (int ret = this->check_deadline(); ret != RPC_OK) {
+      return ret;
+    }
     send_eof_ = eof;
     this->request_stream.SendSync(request, eof);
     return RPC_OK;
   }
 
+  // 将多个元素打包在一个请求包中发送，eof作用于最后一个元素
+  net::awaitable<int> send_requests(std::span<const request_t> requests, bool eof = false) {
+    if (send_eof_ == true) {
+      co_return RPC_SEND_AFTER_EOF;
+    }
+    if (requests.empty()) {
+      co_return RPC_UNSUPPORTED;
+    }
+    if (int ret = this->check_deadline(); ret != RPC_OK) {
+      co_return ret;
+    }
+    send_eof_ = eof;
+    co_await this->request_stream.SendMany(requests, eof);
+    co_return RPC_OK;
+  }
+
+  int send_requests_sync(std::span<const request_t> requests, bool eof = false) {
+    if (send_eof_ == true) {
+      return RPC_SEND_AFTER_EOF;
+    }
+    if (requests.empty()) {
+      return RPC_UNSUPPORTED;
+    }
+    if (int ret = this->check_deadline(); ret != RPC_OK) {
+      return ret;
+    }
+    send_eof_ = eof;
+    this->request_stream.SendManySync(requests, eof);
+    return RPC_OK;
+  }
+
   net::awaitable<int> recv_response(std::optional<response_t>& response) {
     if (send_eof_ == false) {
       co_return RPC_RECV_BEFORE_EOF;
@@ -278,6 +753,34 @@ class RpcStub<RequestType, ResponseType, pcode, RpcType::BidirectStream>
     return ret_code;
   }
 
+  // 一次接收至少一个、至多n个回复元素，服务端通过set_response_args打包在一个回复包中的元素会被一起取出，
+  // responses为空表示回复接收完毕
+  net::awaitable<int> recv_responses(std::vector<response_t>& responses, size_t n) {
+    if (send_eof_ == false) {
+      co_return RPC_RECV_BEFORE_EOF;
+    }
+    uint32_t ret_code = 0;
+    std::string err_msg;
+    responses = co_await this->response_stream.ReadMany(n, ret_code, err_msg);
+    if (ret_code != RPC_OK) {
+      PNRPC_LOG_WARN("rpc response error : {}, {}", ret_code, err_msg);
+    }
+    co_return ret_code;
+  }
+
+  int recv_responses_sync(std::vector<response_t>& responses, size_t n) {
+    if (send_eof_ == false) {
+      return RPC_RECV_BEFORE_EOF;
+    }
+    uint32_t ret_code = 0;
+    std::string err_msg;
+    responses = this->response_stream.ReadManySync(n, ret_code, err_msg);
+    if (ret_code != RPC_OK) {
+      PNRPC_LOG_WARN("rpc response error : {}, {}", ret_code, err_msg);
+    }
+    return ret_code;
+  }
+
  private:
   bool send_eof_;
 };
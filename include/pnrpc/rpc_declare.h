@@ -3,19 +3,49 @@
 #include "pnrpc/rpc_client.h"
 #include "pnrpc/rpc_server.h"
 
-#define RPC_DECLARE_INNER(funcname, request_t, response_t, pcode, rpc_type, ...)              \
-  class RPC##funcname : public pnrpc::RpcProcessor<request_t, response_t, pcode, rpc_type> {  \
-   public:                                                                                    \
-    RPC##funcname() : pnrpc::RpcProcessor<request_t, response_t, pcode, rpc_type>() {}        \
-    __VA_ARGS__                                                                               \
-  };                                                                                          \
-                                                                                              \
-  class RPC##funcname##STUB : public pnrpc::RpcStub<request_t, response_t, pcode, rpc_type> { \
-   public:                                                                                    \
-    RPC##funcname##STUB(pnrpc::net::io_context& io, const std::string& ip, uint16_t port)     \
-        : pnrpc::RpcStub<request_t, response_t, pcode, rpc_type>(io, ip, port) {}             \
+#define RPC_DECLARE_INNER(funcname, request_t, response_t, pcode, rpc_type, ...)                             \
+  class RPC##funcname : public pnrpc::RpcProcessor<request_t, response_t, pcode, rpc_type> {                 \
+   public:                                                                                                   \
+    RPC##funcname() : pnrpc::RpcProcessor<request_t, response_t, pcode, rpc_type>() {}                       \
+    __VA_ARGS__                                                                                              \
+  };                                                                                                         \
+                                                                                                             \
+  class RPC##funcname##STUB : public pnrpc::RpcStub<request_t, response_t, pcode, rpc_type, RPC##funcname> { \
+   public:                                                                                                   \
+    RPC##funcname##STUB(pnrpc::net::io_context& io, const std::string& ip, uint16_t port)                    \
+        : pnrpc::RpcStub<request_t, response_t, pcode, rpc_type, RPC##funcname>(io, ip, port) {              \
+      pnrpc::ApplyStubOptions<RPC##funcname>(*this);                                                         \
+    }                                                                                                        \
+    RPC##funcname##STUB(pnrpc::RpcProcessorBase& parent, const std::string& ip, uint16_t port)               \
+        : pnrpc::RpcStub<request_t, response_t, pcode, rpc_type, RPC##funcname>(parent, ip, port) {          \
+      pnrpc::ApplyStubOptions<RPC##funcname>(*this);                                                         \
+    }                                                                                                        \
   };
 
+// 开启客户端缓存：stub以 pcode + 序列化之后的请求 为key缓存调用结果ttl_ms毫秒，之后stale_ms毫秒内返回陈旧的结果并在后台刷新，
+// 最多缓存capacity个结果。只能用于幂等的Simple类型rpc
+#define ENABLE_CLIENT_CACHE(ttl_ms, stale_ms, capacity) \
+  static constexpr pnrpc::ClientCacheOptions client_cache{ttl_ms, stale_ms, capacity};
+
+// 开启服务端缓存：以序列化之后的请求为key缓存回复帧ttl_ms毫秒，缓存占用的内存不超过max_bytes字节，
+// 命中时直接回复，不执行process()。只能用于幂等的Simple类型rpc
+#define ENABLE_SERVER_CACHE(ttl_ms, max_bytes)                                            \
+  static_assert(type == pnrpc::RpcType::Simple, "server cache only supports simple rpc"); \
+  static constexpr pnrpc::ServerCacheOptions server_cache{ttl_ms, max_bytes};
+
+// 开启请求合并：相同的请求同时到达时只执行一次process()，其余的请求共享其回复。只能用于幂等的Simple类型rpc
+#define ENABLE_COALESCING                                                               \
+  static_assert(type == pnrpc::RpcType::Simple, "coalescing only supports simple rpc"); \
+  static constexpr bool coalescing = true;
+
+// 限制本rpc每个请求包的大小（单位字节，不超过max_package_size），服务端读取到请求包的长度之后、分配内存之前检查，
+// 第一个请求包超过限制时回复RPC_REQUEST_TOO_LARGE并关闭连接，流式请求的后续请求包超过限制时关闭连接
+#define MAX_REQUEST_SIZE(bytes) static constexpr size_t max_request_size = bytes;
+
+// 开启压缩：不小于threshold字节的请求包和回复包使用lz4压缩之后发送，回复只在客户端的stub同样开启了压缩时压缩。
+// 用于较大的、可压缩的（例如文本）消息，较大的数据帧在CompressionPool中压缩，不阻塞io线程
+#define ENABLE_COMPRESSION(threshold) static constexpr size_t compress_threshold = threshold;
+
 #define OVERRIDE_BIND pnrpc::net::io_context* bind_io_context(void*) override;
 
 #define OVERRIDE_PROCESS pnrpc::net::awaitable<void> process() override;
@@ -26,10 +56,16 @@
 
 #define OVERRIDE_RESPONSE_LIMIT size_t get_response_current_limiting(void*) override;
 
+#define OVERRIDE_REQUEST_WINDOW size_t get_request_window(void*) override;
+
+#define OVERRIDE_REQUEST_BUDGET std::shared_ptr<pnrpc::BandwidthBudget> get_request_budget(void*) override;
+
+#define OVERRIDE_RESPONSE_BUDGET std::shared_ptr<pnrpc::BandwidthBudget> get_response_budget(void*) override;
+
 #define RPC_DECLARE(funcname, request_t, response_t, pcode, rpc_type, ...) \
   RPC_DECLARE_INNER(funcname, request_t, response_t, pcode, rpc_type, __VA_ARGS__)
 
 #define REGISTER_RPC(funcname)                                                                                      \
   pnrpc::RpcServer::Instance().RegisterRpc(RPC##funcname::pcode, []() -> std::unique_ptr<pnrpc::RpcProcessorBase> { \
     return std::make_unique<RPC##funcname>();                                                                       \
-  });
\ No newline at end of file
+  }, pnrpc::MakeRpcOptions<RPC##funcname>());
\ No newline at end of file
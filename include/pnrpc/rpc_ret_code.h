@@ -6,4 +6,10 @@
 #define RPC_OVERFLOW 0x03
 #define RPC_SEND_AFTER_EOF 0x04
 #define RPC_RECV_BEFORE_EOF 0x05
-#define RPC_RECV_DUPLICATE 0x06
\ No newline at end of file
+#define RPC_RECV_DUPLICATE 0x06
+#define RPC_DEADLINE_EXCEEDED 0x07
+#define RPC_CANCELLED 0x08
+#define RPC_UNSUPPORTED 0x09
+#define RPC_NO_RESPONSE 0x0A
+#define RPC_REQUEST_TOO_LARGE 0x0B
+#define RPC_NOT_FOUND 0x0C
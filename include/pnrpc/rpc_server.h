@@ -1,22 +1,36 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <typeinfo>
 #include <unordered_map>
 #include <vector>
 
 #include "bridge/object.h"
 #include "pnrpc/asio_version.h"
+#include "pnrpc/bandwidth_budget.h"
+#include "pnrpc/coalescing.h"
+#include "pnrpc/file_region.h"
+#include "pnrpc/flow_control.h"
 #include "pnrpc/log.h"
+#include "pnrpc/memory_budget.h"
 #include "pnrpc/rebind_ctx.h"
 #include "pnrpc/rpc_concept.h"
 #include "pnrpc/rpc_ret_code.h"
 #include "pnrpc/rpc_type_creator.h"
+#include "pnrpc/server_cache.h"
+#include "pnrpc/shm_channel.h"
 #include "pnrpc/stream.h"
+#include "pnrpc/timer_wheel.h"
+#include "pnrpc/transport.h"
 #include "pnrpc/util.h"
 
 namespace pnrpc {
@@ -28,7 +42,8 @@ class RpcProcessorBase {
   friend class RpcServer;
 
  public:
-  RpcProcessorBase(size_t pcode, RpcType rt) : code(pcode), rpc_type_(rt), running_io_(nullptr) {}
+  RpcProcessorBase(size_t pcode, RpcType rt)
+      : code(pcode), rpc_type_(rt), running_io_(nullptr), deadline_(), cancelled_(false), error_code_(RPC_OK) {}
 
   net::io_context& get_io_context() {
     assert(running_io_ != nullptr);
@@ -39,14 +54,34 @@ class RpcProcessorBase {
 
   RpcType get_rpc_type() const { return rpc_type_; }
 
+  // 客户端在请求中携带了超时时间时，返回本次rpc调用的deadline。
+  // 在process()中以本对象构造的stub会自动继承该deadline。
+  const std::optional<Deadline>& get_deadline() const { return deadline_; }
+
+  bool deadline_exceeded() const {
+    return deadline_.has_value() && std::chrono::steady_clock::now() >= deadline_.value();
+  }
+
+  // 客户端取消了本次调用（发送cancel帧或者关闭连接）或者deadline到期时，process()协程会被取消
+  bool is_cancelled() const { return cancelled_; }
+
+  // process()通过set_error_response回复的错误码，没有回复错误时为RPC_OK
+  uint32_t get_error_code() const { return error_code_; }
+
  protected:
   void set_io_context(net::io_context& io) { running_io_ = &io; }
 
-  virtual void* create_request_from_raw_bytes(std::string_view request_view, bool eof) = 0;
+  void set_deadline(Deadline deadline) { deadline_ = deadline; }
+
+  void set_cancelled() { cancelled_ = true; }
+
+  void set_error_code(uint32_t ret_code) { error_code_ = ret_code; }
+
+  virtual void* create_request_from_raw_bytes(std::string_view request_view, const RequestHeader& header) = 0;
 
   virtual net::awaitable<void> process() = 0;
 
-  virtual void bind_net(net::ip::tcp::socket& s, net::io_context& io_context) = 0;
+  virtual void bind_net(Socket& s, ShmChannel* shm, net::io_context& io_context) = 0;
 
   // 用户可以通过重写此方法将本rpc分配给自定义的handle_io处理
   virtual net::io_context* bind_io_context(void* pkg_ptr) { return nullptr; }
@@ -57,6 +92,15 @@ class RpcProcessorBase {
   // 用户可以通过重写此方法对向客户端写回数据做限流, 单位 字节 / 秒
   virtual size_t get_response_current_limiting(void* pkg_ptr) { return 0; }
 
+  // 用户可以通过重写此方法为本rpc绑定与其他连接共享的带宽预算（例如同一个pcode的所有请求共享一个预算），
+  // 返回的预算对象需要被多个rpc共享，因此一般存储在静态变量中。
+  virtual std::shared_ptr<BandwidthBudget> get_request_budget(void* pkg_ptr) { return nullptr; }
+
+  virtual std::shared_ptr<BandwidthBudget> get_response_budget(void* pkg_ptr) { return nullptr; }
+
+  // 用户可以通过重写此方法扩大客户端到服务器方向流式请求的接收窗口，单位字节，小于default_stream_window时不生效
+  virtual size_t get_request_window(void* pkg_ptr) { return default_stream_window; }
+
   // 用户可以通过重写此方法实现限流算法。注意：
   // 每个RpcProcessorBase对象只负责处理一次rpc请求，因此需要将限流信息存储在生命周期更长的对象中而不是RpcProcessorBase对象中。
   virtual bool restrictor(void* pkg_ptr) { return true; }
@@ -65,12 +109,75 @@ class RpcProcessorBase {
 
   virtual void update_response_current_limiting(size_t uwl) = 0;
 
+  // 第一个请求包由RpcServer读取，需要计入请求流的接收窗口
+  virtual net::awaitable<void> init_request_window(size_t first_frame_bytes, size_t window) = 0;
+
+  virtual net::awaitable<void> watch_cancel() = 0;
+
+  // watch_cancel()结束时请求流上残留了不完整的帧，需要关闭连接
+  virtual bool watch_interrupted() const = 0;
+
+  virtual void add_request_budget(std::shared_ptr<BandwidthBudget> budget) = 0;
+
+  virtual void add_response_budget(std::shared_ptr<BandwidthBudget> budget) = 0;
+
+  // 限制后续读取的请求包的大小，并在为请求包分配内存之前从budget中申请预算。
+  // 第一个请求包占用的预算交给请求流，在读取下一个请求包时归还，因此一个流式请求同时只占用一个请求包的预算。
+  // accept_compressed为false时收到压缩的请求包抛出异常
+  virtual void limit_request(size_t max_request_size, std::shared_ptr<MemoryBudget> budget,
+                             MemoryBudget::Reservation first_frame, bool accept_compressed) = 0;
+
+  // 进程内调用：请求对象被移动给本对象，回复写入response。请求、回复的类型与本rpc不一致时返回nullptr
+  virtual void* bind_local(void* request, const std::type_info& request_type, void* response,
+                           const std::type_info& response_type) = 0;
+
+  virtual bool has_local_response() const = 0;
+
+  // 回复帧被追加到out中：批量请求中的rpc不直接写入socket，开启了服务端缓存的rpc在写入socket的同时保留一份用于缓存
+  virtual void capture_response(std::string* out, bool write_through) = 0;
+
+  // 不小于threshold字节的回复包压缩之后发送
+  virtual void enable_response_compression(size_t threshold) = 0;
+
+  // 请求流以及回复流的每次读写在timeout内没有完成时关闭连接，见StreamBase::set_io_timeout
+  virtual void set_io_timeout(TimerWheel& wheel, std::chrono::milliseconds timeout) = 0;
+
  private:
   size_t code;
   RpcType rpc_type_;
   net::io_context* running_io_;
+  std::optional<Deadline> deadline_;
+  bool cancelled_;
+  uint32_t error_code_;
 };
 
+// 注册rpc时的可选项，由RPC_DECLARE中声明的选项生成，见MakeRpcOptions
+struct RpcOptions {
+  std::optional<ServerCacheOptions> server_cache;
+  bool coalescing = false;
+  size_t max_request_size = max_package_size;
+  // 0表示不压缩回复
+  size_t compress_threshold = 0;
+};
+
+template <typename Processor>
+RpcOptions MakeRpcOptions() {
+  RpcOptions options;
+  if constexpr (requires { Processor::server_cache; }) {
+    options.server_cache = Processor::server_cache;
+  }
+  if constexpr (requires { Processor::coalescing; }) {
+    options.coalescing = Processor::coalescing;
+  }
+  if constexpr (requires { Processor::max_request_size; }) {
+    options.max_request_size = Processor::max_request_size;
+  }
+  if constexpr (requires { Processor::compress_threshold; }) {
+    options.compress_threshold = Processor::compress_threshold;
+  }
+  return options;
+}
+
 class RpcServer {
  public:
   using CreatorFunction = std::function<std::unique_ptr<RpcProcessorBase>()>;
@@ -81,7 +188,10 @@ class RpcServer {
     uint32_t pcode = 0;
     double process_ms = 0.0;
     net::io_context* bind_ctx = nullptr;
-    std::unique_ptr<net::ip::tcp::socket> socket;
+    // 本次rpc被取消，连接上可能残留未完整发送的数据，需要关闭连接
+    bool close_connection = false;
+    // 直接存放在HandleInfo中，避免每个请求在堆上分配一次socket对象
+    std::optional<Socket> socket;
   };
 
   static RpcServer& Instance() {
@@ -89,74 +199,504 @@ class RpcServer {
     return obj;
   }
 
-  void RegisterRpc(size_t pcode, CreatorFunction cf) {
+  // 整个server共享的带宽预算，需要在server启动之前设置
+  void SetBudget(std::shared_ptr<BandwidthBudget> request_budget, std::shared_ptr<BandwidthBudget> response_budget) {
+    server_budget_.request = std::move(request_budget);
+    server_budget_.response = std::move(response_budget);
+  }
+
+  // 在io上执行的所有rpc共享的带宽预算，需要在server启动之前设置
+  void SetBudget(net::io_context& io, std::shared_ptr<BandwidthBudget> request_budget,
+                 std::shared_ptr<BandwidthBudget> response_budget) {
+    auto& config = io_budgets_[&io];
+    config.request = std::move(request_budget);
+    config.response = std::move(response_budget);
+  }
+
+  // 整个server共享的内存预算：读取请求包之前按照其长度申请，预算不足时暂停读取，需要在server启动之前设置
+  void SetMemoryBudget(std::shared_ptr<MemoryBudget> budget) { memory_budget_ = std::move(budget); }
+
+  // 连接在idle_timeout内没有发送完整的请求包，或者处理请求时的某次读写（流式请求的读取、回复的写入）在idle_timeout内
+  // 没有完成时被关闭，0表示不设置超时，需要在server启动之前设置
+  void SetIdleTimeout(std::chrono::milliseconds idle_timeout) { idle_timeout_ = idle_timeout; }
+
+  std::chrono::milliseconds GetIdleTimeout() const { return idle_timeout_; }
+
+  void RegisterRpc(size_t pcode, CreatorFunction cf, const RpcOptions& options = {}) {
+    if (pcode == batch_pcode) {
+      PNRPC_LOG_ERROR("rpc code {} is reserved for batch request", pcode);
+      return;
+    }
     if (funcs_.count(pcode) != 0) {
       PNRPC_LOG_WARN("duplicate rpc code : {}", pcode);
     }
-    funcs_[pcode] = std::move(cf);
+    RpcEntry entry;
+    entry.creator = std::move(cf);
+    entry.max_request_size = std::min(options.max_request_size, max_package_size);
+    entry.compress_threshold = options.compress_threshold;
+    if (options.server_cache.has_value()) {
+      entry.cache = std::make_shared<ServerCache>(options.server_cache.value());
+    }
+    if (options.coalescing == true) {
+      entry.coalescer = std::make_shared<Coalescer>();
+    }
+    funcs_[pcode] = std::move(entry);
   }
 
-  net::awaitable<HandleInfo> HandleRequest(net::io_context& io, net::ip::tcp::socket socket) {
+  // shm不为空时连接的数据通过共享内存通道传输，socket只用来感知对端关闭连接。
+  // idle_timer不为空时在读取到完整的请求包之后取消，见work()
+  net::awaitable<HandleInfo> HandleRequest(net::io_context& io, Socket socket, ShmChannel* shm = nullptr,
+                                           TimerWheel::Timer* idle_timer = nullptr) {
     HandleInfo handle_info;
     ClientToServerStream<void> ctss;
-    ctss.update_bind_socket(&socket);
+    ctss.update_bind_socket(&socket, shm);
     std::string buf;
-    auto request_view = co_await ctss.Read(buf);
-    auto processor = GetProcessor(ctss.get_pcode());
-    handle_info.pcode = ctss.get_pcode();
+    // 读取到pcode和长度之后、分配请求包的内存之前检查该rpc的请求大小限制、是否开启了压缩并申请内存预算，
+    // 预算在本次rpc处理完毕之后归还
+    MemoryBudget::Reservation reservation;
+    int rejected = RPC_OK;
+    StreamBase::Admission admit = [&](uint32_t pcode, size_t length, size_t compressed_length) -> net::awaitable<void> {
+      handle_info.pcode = pcode;
+      if (pcode != batch_pcode && length > GetMaxRequestSize(pcode)) {
+        rejected = RPC_REQUEST_TOO_LARGE;
+        handle_info.err_msg = "request is too large, pcode == " + std::to_string(pcode);
+        throw PnrpcException(handle_info.err_msg);
+      }
+      if (compressed_length != 0 && GetCompressThreshold(pcode) == 0) {
+        rejected = RPC_UNSUPPORTED;
+        handle_info.err_msg = "compressed request for rpc without compression, pcode == " + std::to_string(pcode);
+        throw PnrpcException(handle_info.err_msg);
+      }
+      if (memory_budget_ != nullptr) {
+        reservation = co_await memory_budget_->Acquire(length + compressed_length);
+      }
+      co_return;
+    };
+    std::string_view request_view;
+    try {
+      request_view = co_await ctss.Read(buf, admit);
+    } catch (PnrpcException&) {
+      if (rejected == RPC_OK) {
+        throw;
+      }
+    }
+    if (idle_timer != nullptr) {
+      TimerWheel::Of(io).Cancel(*idle_timer);
+    }
+    handle_info.bind_ctx = &io;
+    if (rejected != RPC_OK) {
+      // 请求包的剩余部分没有被读取，回复错误之后关闭连接
+      handle_info.ret_code = rejected;
+      handle_info.close_connection = true;
+      ErrorStream es;
+      es.update_bind_socket(&socket, shm);
+      ApplyIoTimeout(es, io);
+      co_await es.SendErrorMsg(handle_info.err_msg, handle_info.ret_code);
+      handle_info.socket.emplace(std::move(socket));
+      co_return handle_info;
+    }
+    // deadline从读到请求的时刻开始计算，这样可以覆盖请求在服务端排队的时间
+    auto recv_time = std::chrono::steady_clock::now();
+    if (handle_info.pcode == batch_pcode) {
+      Timer timer;
+      timer.Start();
+      co_await HandleBatch(io, socket, shm, request_view, recv_time);
+      handle_info.process_ms = timer.End();
+      handle_info.socket.emplace(std::move(socket));
+      co_return handle_info;
+    }
+    // 单向请求不回复任何数据，包括错误信息
+    bool one_way = ctss.get_header().one_way;
+    // 命中服务端缓存或者合并到正在执行的相同请求时直接回复得到的回复帧，不构造processor。
+    // 只有一次性发送完毕的请求可以被缓存和合并
+    std::shared_ptr<ServerCache> cache;
+    std::shared_ptr<Coalescer> coalescer;
+    if (ctss.get_eof() == true && ctss.get_header().elements == false && one_way == false) {
+      cache = GetCache(handle_info.pcode);
+      coalescer = GetCoalescer(handle_info.pcode);
+    }
+    std::optional<Deadline> deadline;
+    if (ctss.get_timeout_ms() != 0) {
+      deadline = recv_time + std::chrono::milliseconds(ctss.get_timeout_ms());
+    }
+    auto deadline_exceeded = [&deadline]() {
+      return deadline.has_value() && std::chrono::steady_clock::now() >= deadline.value();
+    };
+    // 缓存命中和合并的请求同样需要在deadline之内回复，已经超时的请求不再查找缓存。
+    // 命中缓存或者合并到相同请求的调用不执行process()，因此有意不经过restrictor：
+    // 限流保护的是执行rpc的资源，这些请求只消耗发送回复帧的开销
+    Coalescer::Frames frames;
+    if (cache != nullptr && deadline_exceeded() == false) {
+      frames = cache->get(request_view);
+    }
+    Coalescer::Ticket ticket;
+    if (frames == nullptr && coalescer != nullptr && deadline_exceeded() == false) {
+      coalescer->join(request_view, ticket);
+      if (ticket.is_leader() == false) {
+        frames = co_await Coalescer::wait(ticket, deadline);
+      }
+    }
+    if (frames != nullptr && deadline_exceeded() == false) {
+      RawStream rs;
+      rs.update_bind_socket(&socket, shm);
+      ApplyIoTimeout(rs, io);
+      co_await rs.SendFrames(*frames);
+      handle_info.socket.emplace(std::move(socket));
+      co_return handle_info;
+    }
+    auto processor = GetProcessor(handle_info.pcode);
     if (processor == nullptr) {
       handle_info.ret_code = RPC_INVALID_PCODE;
       handle_info.err_msg = "not found rpc request, pcode == " + std::to_string(handle_info.pcode);
+    } else if (one_way != (processor->get_rpc_type() == RpcType::OneWay)) {
+      handle_info.ret_code = RPC_UNSUPPORTED;
+      handle_info.err_msg = "one way request mismatch with rpc type, pcode == " + std::to_string(handle_info.pcode);
     } else {
       // 首先解析请求，因此定制功能可以根据请求信息动态设置
-      void* pkg = processor->create_request_from_raw_bytes(request_view, ctss.get_eof());
+      void* pkg = processor->create_request_from_raw_bytes(request_view, ctss.get_header());
+      if (deadline.has_value()) {
+        processor->set_deadline(deadline.value());
+      }
       // 设置socket限流
       processor->update_request_current_limiting(processor->get_request_current_limiting(pkg));
       processor->update_response_current_limiting(processor->get_response_current_limiting(pkg));
-      processor->bind_net(socket, io);
-      handle_info.bind_ctx = &io;
+      processor->bind_net(socket, shm, io);
+      // 只有客户端声明可以解压时才压缩回复
+      if (ctss.get_header().accept_compressed == true) {
+        processor->enable_response_compression(GetCompressThreshold(handle_info.pcode));
+      }
       auto bind_ctx = processor->bind_io_context(pkg);
       // 如果用户给该rpc绑定了io_context，则将本协程调度给该io_context执行，注意，需要将socket绑定的ctx和processor注册的ctx同步修改
       if (bind_ctx != nullptr) {
         handle_info.bind_ctx = bind_ctx;
         socket = rebind_ctx(std::move(socket), *bind_ctx);
-        processor->bind_net(socket, *bind_ctx);
+        processor->bind_net(socket, shm, *bind_ctx);
         co_await net::dispatch(net::bind_executor(*bind_ctx, net::use_awaitable));
       }
+      AttachBudgets(*processor, pkg, *handle_info.bind_ctx);
+      if (idle_timeout_.count() != 0) {
+        processor->set_io_timeout(TimerWheel::Of(*handle_info.bind_ctx), idle_timeout_);
+      }
       // 在调度到执行本rpc的io_context上之后进行限流判定，这意味着可以通过请求信息、io_context信息等做更细粒度的限流
-      bool overload = !processor->restrictor(pkg);
-      if (overload) {
+      // 已经超时的请求直接丢弃，客户端已经不再等待其结果，也不应该消耗限流配额
+      if (processor->deadline_exceeded()) {
+        handle_info.ret_code = RPC_DEADLINE_EXCEEDED;
+        handle_info.err_msg = "rpc request deadline exceeded before dispatch";
+      } else if (!processor->restrictor(pkg)) {
         handle_info.ret_code = RPC_OVERFLOW;
         handle_info.err_msg = "rpc request overflow";
       } else {
+        if (ctss.get_eof() == false) {
+          processor->limit_request(GetMaxRequestSize(handle_info.pcode), memory_budget_, std::move(reservation),
+                                   GetCompressThreshold(handle_info.pcode) != 0);
+          co_await processor->init_request_window(sizeof(uint32_t) + buf.size(), processor->get_request_window(pkg));
+        }
+        std::string response_frames;
+        if (cache != nullptr || ticket.is_leader()) {
+          processor->capture_response(&response_frames, true);
+        }
         Timer timer;
         timer.Start();
-        co_await processor->process();
+        bool cancelled = false;
+        if (one_way == true) {
+          // 单向请求之后连接上紧跟着的是下一个请求，不能在执行的同时读取socket监听cancel帧
+          co_await processor->process();
+        } else if (ctss.get_eof() == true) {
+          // 请求已经读取完毕，执行rpc的同时监听客户端的cancel帧、连接关闭以及deadline，任意一个发生都会通过
+          // cancellation slot取消process()协程以及其中正在等待的异步操作（例如嵌套的rpc调用、数据库查询）。
+          // 请求没有读取完毕的情况下，cancel帧和连接关闭会在process()读取请求时以异常的形式抛出。
+          using namespace net::experimental::awaitable_operators;
+          auto result = co_await (processor->process() || WatchCancel(*processor));
+          cancelled = result.index() == 1;
+          if (processor->watch_interrupted()) {
+            handle_info.close_connection = true;
+          }
+        } else {
+          co_await processor->process();
+        }
         handle_info.process_ms = timer.End();
-        handle_info.ret_code = RPC_OK;
-        handle_info.err_msg = "";
+        if (cancelled == true) {
+          processor->set_cancelled();
+          handle_info.ret_code = RPC_CANCELLED;
+          handle_info.err_msg = "rpc cancelled";
+          handle_info.close_connection = true;
+        } else {
+          handle_info.ret_code = RPC_OK;
+          handle_info.err_msg = "";
+          // Simple类型的rpc只有一个回复帧，没有回复（process()没有调用set_response）或者回复了错误时不缓存、不共享
+          if (!response_frames.empty() && processor->get_error_code() == RPC_OK &&
+              ParseSubFrames(response_frames).size() == 1) {
+            auto result = std::make_shared<const std::string>(std::move(response_frames));
+            if (cache != nullptr) {
+              cache->put(request_view, result);
+            }
+            ticket.publish(std::move(result));
+          }
+        }
       }
     }
-    if (handle_info.ret_code != RPC_OK) {
+    if (handle_info.ret_code != RPC_OK && handle_info.close_connection == false && one_way == false) {
       ErrorStream es;
-      es.update_bind_socket(&socket);
+      es.update_bind_socket(&socket, shm);
+      ApplyIoTimeout(es, *handle_info.bind_ctx);
       co_await es.SendErrorMsg(handle_info.err_msg, handle_info.ret_code);
     }
-    handle_info.socket = std::make_unique<net::ip::tcp::socket>(std::move(socket));
+    handle_info.socket.emplace(std::move(socket));
     co_return handle_info;
   }
 
+  // 进程内调用：请求对象被直接移动给本进程中注册的处理函数，回复直接写入response，不经过序列化和socket。
+  // 只支持Simple和OneWay类型的rpc，绑定了io_context的rpc在对应的io_context上执行，执行完毕之后回到调用者的io上。
+  template <typename Request, typename Response>
+  net::awaitable<int> CallLocal(net::io_context& io, uint32_t pcode, Request request, Response& response,
+                                std::optional<Deadline> deadline) {
+    auto processor = GetProcessor(pcode);
+    if (processor == nullptr) {
+      co_return RPC_INVALID_PCODE;
+    }
+    if (processor->get_rpc_type() != RpcType::Simple && processor->get_rpc_type() != RpcType::OneWay) {
+      PNRPC_LOG_WARN("rpc {} local call only supports simple and one way rpc", pcode);
+      co_return RPC_UNSUPPORTED;
+    }
+    void* pkg = processor->bind_local(&request, typeid(Request), &response, typeid(Response));
+    if (pkg == nullptr) {
+      PNRPC_LOG_WARN("rpc {} local call with mismatched request or response type", pcode);
+      co_return RPC_UNSUPPORTED;
+    }
+    if (deadline.has_value()) {
+      processor->set_deadline(deadline.value());
+    }
+    processor->set_io_context(io);
+    auto bind_ctx = processor->bind_io_context(pkg);
+    if (bind_ctx != nullptr && bind_ctx != &io) {
+      processor->set_io_context(*bind_ctx);
+      co_return co_await net::co_spawn(*bind_ctx, RunLocal(*processor, pkg), net::use_awaitable);
+    }
+    co_return co_await RunLocal(*processor, pkg);
+  }
+
+  // 批量请求：请求包的内容由多个 长度(4字节) + 请求包 组成，每个子请求必须属于Simple类型的rpc。
+  // 子请求并发执行（绑定了io_context的rpc被调度到对应的io_context上），回复帧被捕获之后按照请求的顺序
+  // 拼接成一个回复包返回，客户端见RpcBatchStub。
+  net::awaitable<void> HandleBatch(net::io_context& io, Socket& socket, ShmChannel* shm, std::string_view payload,
+                                   Deadline recv_time) {
+    auto entries = ParseSubFrames(payload);
+    // 子请求在其他io_context上执行时，完成回调通过bind_executor回到io上执行，因此state只在io上被访问
+    struct BatchState {
+      std::vector<std::string> responses;
+      size_t remaining;
+      net::steady_timer done;
+    };
+    auto state = std::make_shared<BatchState>(
+        BatchState{std::vector<std::string>(entries.size()), entries.size(), net::steady_timer(io)});
+    state->done.expires_at(net::steady_timer::time_point::max());
+    for (size_t i = 0; i < entries.size(); ++i) {
+      std::string& out = state->responses[i];
+      RequestPackager<void> rp;
+      RequestHeader header;
+      auto request_view = rp.parse_request_package(entries[i], header);
+      auto processor = GetProcessor(header.pcode);
+      if (processor == nullptr) {
+        AppendErrorFrame(out, "not found rpc request, pcode == " + std::to_string(header.pcode), RPC_INVALID_PCODE);
+      } else if (entries[i].size() > GetMaxRequestSize(header.pcode)) {
+        AppendErrorFrame(out, "request is too large, pcode == " + std::to_string(header.pcode),
+                         RPC_REQUEST_TOO_LARGE);
+      } else if (processor->get_rpc_type() != RpcType::Simple || header.eof == false) {
+        AppendErrorFrame(out, "only simple rpc can be batched, pcode == " + std::to_string(header.pcode),
+                         RPC_UNSUPPORTED);
+      } else {
+        void* pkg = processor->create_request_from_raw_bytes(request_view, header);
+        if (header.timeout_ms != 0) {
+          processor->set_deadline(recv_time + std::chrono::milliseconds(header.timeout_ms));
+        }
+        auto bind_ctx = processor->bind_io_context(pkg);
+        net::io_context& ctx = bind_ctx != nullptr ? *bind_ctx : io;
+        // 子请求不会读写socket，这里绑定socket只是为了设置processor的io_context
+        processor->bind_net(socket, shm, ctx);
+        processor->capture_response(&out, false);
+        AttachBudgets(*processor, pkg, ctx);
+        net::co_spawn(ctx, HandleBatchEntry(std::move(processor), pkg, out),
+                      net::bind_executor(io, [state, i](std::exception_ptr e) {
+                        if (e) {
+                          try {
+                            std::rethrow_exception(e);
+                          } catch (std::exception& ex) {
+                            PNRPC_LOG_WARN("batch entry {} exception : {}", i, ex.what());
+                            state->responses[i].clear();
+                            AppendErrorFrame(state->responses[i], ex.what(), RPC_NO_RESPONSE);
+                          }
+                        }
+                        if (--state->remaining == 0) {
+                          state->done.cancel();
+                        }
+                      }));
+        continue;
+      }
+      state->remaining -= 1;
+    }
+    if (state->remaining != 0) {
+      error_code ec;
+      co_await state->done.async_wait(net::redirect_error(net::use_awaitable, ec));
+    }
+    std::string response;
+    for (auto& each : state->responses) {
+      response.append(each);
+    }
+    RawStream rs;
+    rs.update_bind_socket(&socket, shm);
+    ApplyIoTimeout(rs, io);
+    co_await rs.Send(response);
+    co_return;
+  }
+
+  static net::awaitable<void> HandleBatchEntry(std::unique_ptr<RpcProcessorBase> processor, void* pkg,
+                                               std::string& out) {
+    if (processor->deadline_exceeded()) {
+      AppendErrorFrame(out, "rpc request deadline exceeded before dispatch", RPC_DEADLINE_EXCEEDED);
+    } else if (!processor->restrictor(pkg)) {
+      AppendErrorFrame(out, "rpc request overflow", RPC_OVERFLOW);
+    } else {
+      co_await processor->process();
+      // Simple类型的rpc只能回复一个包
+      auto frames = ParseSubFrames(out);
+      if (frames.empty()) {
+        AppendErrorFrame(out, "rpc didn't send response", RPC_NO_RESPONSE);
+      } else if (frames.size() > 1) {
+        out.resize(sizeof(uint32_t) + frames[0].size());
+      }
+    }
+    co_return;
+  }
+
+  // 开启了空闲超时时，连接上的每次读写同样需要在idle_timeout内完成
+  void ApplyIoTimeout(StreamBase& stream, net::io_context& io) {
+    if (idle_timeout_.count() != 0) {
+      stream.set_io_timeout(TimerWheel::Of(io), idle_timeout_);
+    }
+  }
+
+  static void AppendErrorFrame(std::string& out, const std::string& err_msg, uint32_t ret_code) {
+    std::string frame;
+    ResponsePackager<void> rp;
+    rp.seri_error_package(err_msg, ret_code, frame);
+    subFrameSeri(frame, out);
+  }
+
+  // 按照pcode、io_context、server三个级别为processor的读写绑定带宽预算
+  void AttachBudgets(RpcProcessorBase& processor, void* pkg, net::io_context& io) {
+    processor.add_request_budget(processor.get_request_budget(pkg));
+    processor.add_response_budget(processor.get_response_budget(pkg));
+    auto it = io_budgets_.find(&io);
+    if (it != io_budgets_.end()) {
+      processor.add_request_budget(it->second.request);
+      processor.add_response_budget(it->second.response);
+    }
+    processor.add_request_budget(server_budget_.request);
+    processor.add_response_budget(server_budget_.response);
+  }
+
+  // 客户端发送了cancel帧、关闭了连接或者deadline到期时返回
+  static net::awaitable<void> WatchCancel(RpcProcessorBase& processor) {
+    auto deadline = processor.get_deadline();
+    if (deadline.has_value()) {
+      using namespace net::experimental::awaitable_operators;
+      auto& wheel = TimerWheel::Of(processor.get_io_context());
+      co_await (processor.watch_cancel() || wheel.Wait(deadline.value()));
+    } else {
+      co_await processor.watch_cancel();
+    }
+    co_return;
+  }
+
   std::unique_ptr<RpcProcessorBase> GetProcessor(size_t pcode) {
     auto it = funcs_.find(pcode);
     if (it == funcs_.end()) {
       PNRPC_LOG_INFO("get processor failed, pcode = {}", pcode);
       return nullptr;
     }
-    return it->second();
+    return it->second.creator();
+  }
+
+  std::shared_ptr<ServerCache> GetCache(size_t pcode) {
+    auto it = funcs_.find(pcode);
+    if (it == funcs_.end()) {
+      return nullptr;
+    }
+    return it->second.cache;
+  }
+
+  std::shared_ptr<Coalescer> GetCoalescer(size_t pcode) {
+    auto it = funcs_.find(pcode);
+    if (it == funcs_.end()) {
+      return nullptr;
+    }
+    return it->second.coalescer;
+  }
+
+  // 未注册的pcode返回max_package_size，由后续的流程回复RPC_INVALID_PCODE
+  size_t GetMaxRequestSize(size_t pcode) {
+    auto it = funcs_.find(pcode);
+    if (it == funcs_.end()) {
+      return max_package_size;
+    }
+    return it->second.max_request_size;
+  }
+
+  size_t GetCompressThreshold(size_t pcode) {
+    auto it = funcs_.find(pcode);
+    if (it == funcs_.end()) {
+      return 0;
+    }
+    return it->second.compress_threshold;
   }
 
  private:
-  std::unordered_map<size_t, CreatorFunction> funcs_;
+  static net::awaitable<int> RunLocal(RpcProcessorBase& processor, void* pkg) {
+    if (processor.deadline_exceeded()) {
+      co_return RPC_DEADLINE_EXCEEDED;
+    }
+    if (!processor.restrictor(pkg)) {
+      co_return RPC_OVERFLOW;
+    }
+    auto deadline = processor.get_deadline();
+    if (deadline.has_value()) {
+      using namespace net::experimental::awaitable_operators;
+      auto& wheel = TimerWheel::Of(processor.get_io_context());
+      auto result = co_await (processor.process() || wheel.Wait(deadline.value()));
+      if (result.index() == 1) {
+        processor.set_cancelled();
+        co_return RPC_DEADLINE_EXCEEDED;
+      }
+    } else {
+      co_await processor.process();
+    }
+    if (processor.get_error_code() != RPC_OK) {
+      co_return processor.get_error_code();
+    }
+    if (processor.get_rpc_type() == RpcType::OneWay || processor.has_local_response()) {
+      co_return RPC_OK;
+    }
+    co_return RPC_NO_RESPONSE;
+  }
+
+  struct RpcEntry {
+    CreatorFunction creator;
+    std::shared_ptr<ServerCache> cache;
+    std::shared_ptr<Coalescer> coalescer;
+    size_t max_request_size = max_package_size;
+    size_t compress_threshold = 0;
+  };
+
+  struct BudgetConfig {
+    std::shared_ptr<BandwidthBudget> request;
+    std::shared_ptr<BandwidthBudget> response;
+  };
+
+  std::unordered_map<size_t, RpcEntry> funcs_;
+  BudgetConfig server_budget_;
+  std::unordered_map<net::io_context*, BudgetConfig> io_budgets_;
+  std::shared_ptr<MemoryBudget> memory_budget_;
+  std::chrono::milliseconds idle_timeout_{0};
 
   RpcServer() {}
 };
@@ -168,18 +708,28 @@ class RpcProcessor : public RpcProcessorBase {
   using response_t = ResponseType;
 
  protected:
-  void* create_request_from_raw_bytes(std::string_view request_view, bool eof) override {
-    auto request = RpcCreator<request_t>::create(&request_view[0], request_view.size());
-    first_requset_pkg_.reset(new request_t(std::move(request)));
-    first_read_eof_ = eof;
+  // 第一个请求包中打包了多个元素时，除第一个元素之外的部分交给request_stream
+  void* create_request_from_raw_bytes(std::string_view request_view, const RequestHeader& header) override {
+    std::vector<request_t> requests;
+    if (header.elements == true) {
+      requests = ParseElements<request_t>(request_view);
+      if (requests.empty()) {
+        throw PnrpcException("rpc " + std::to_string(pcode) + " first request package has no element");
+      }
+    } else {
+      requests.push_back(RpcCreator<request_t>::create(&request_view[0], request_view.size()));
+    }
+    first_requset_pkg_.reset(new request_t(std::move(requests.front())));
+    requests.erase(requests.begin());
+    request_stream.PushPending(std::move(requests), header.eof);
     return first_requset_pkg_.get();
   }
 
   virtual net::awaitable<void> process() = 0;
 
-  void bind_net(net::ip::tcp::socket& s, net::io_context& io_context) override {
-    request_stream.update_bind_socket(&s);
-    response_stream.update_bind_socket(&s);
+  void bind_net(Socket& s, ShmChannel* shm, net::io_context& io_context) override {
+    request_stream.update_bind_socket(&s, shm);
+    response_stream.update_bind_socket(&s, shm);
     set_io_context(io_context);
   }
 
@@ -187,21 +737,76 @@ class RpcProcessor : public RpcProcessorBase {
 
   void update_response_current_limiting(size_t uwl) override { response_stream.update_write_limiting(uwl); }
 
+  net::awaitable<void> init_request_window(size_t first_frame_bytes, size_t window) override {
+    request_stream.on_consume(first_frame_bytes);
+    co_await request_stream.enlarge_recv_window(window);
+    co_return;
+  }
+
+  net::awaitable<void> watch_cancel() override {
+    co_await request_stream.coro_watch_cancel();
+    co_return;
+  }
+
+  bool watch_interrupted() const override { return request_stream.partial_read(); }
+
+  void add_request_budget(std::shared_ptr<BandwidthBudget> budget) override {
+    request_stream.add_read_budget(std::move(budget));
+  }
+
+  void add_response_budget(std::shared_ptr<BandwidthBudget> budget) override {
+    response_stream.add_write_budget(std::move(budget));
+  }
+
+  void limit_request(size_t max_request_size, std::shared_ptr<MemoryBudget> budget,
+                     MemoryBudget::Reservation first_frame, bool accept_compressed) override {
+    request_stream.limit_read_frame(max_request_size, std::move(budget), std::move(first_frame));
+    request_stream.reject_compressed_frames(!accept_compressed);
+  }
+
+  void capture_response(std::string* out, bool write_through) override {
+    response_stream.capture_to(out, write_through);
+  }
+
+  void enable_response_compression(size_t threshold) override { response_stream.enable_compression(threshold); }
+
+  void set_io_timeout(TimerWheel& wheel, std::chrono::milliseconds timeout) override {
+    request_stream.set_io_timeout(wheel, timeout);
+    response_stream.set_io_timeout(wheel, timeout);
+  }
+
+  void* bind_local(void* request, const std::type_info& request_type, void* response,
+                   const std::type_info& response_type) override {
+    if (request_type != typeid(request_t) || response_type != typeid(response_t)) {
+      return nullptr;
+    }
+    first_requset_pkg_.reset(new request_t(std::move(*static_cast<request_t*>(request))));
+    local_response_ = static_cast<response_t*>(response);
+    return first_requset_pkg_.get();
+  }
+
+  bool has_local_response() const override { return response_count_ != 0; }
+
  public:
   static constexpr uint32_t pcode = c;
+  static constexpr RpcType type = rpc_type;
 
   explicit RpcProcessor()
       : RpcProcessorBase(pcode, rpc_type),
+        flow_control_(),
         request_stream(pcode),
         response_stream(),
         request_count_(0),
         response_eof_(false),
         response_count_(0),
         first_requset_pkg_(nullptr),
-        first_read_eof_(false) {}
+        local_response_(nullptr) {
+    request_stream.bind_flow_control(&flow_control_);
+    response_stream.bind_flow_control(&flow_control_);
+  }
 
   net::awaitable<std::optional<request_t>> get_request_arg() {
-    if (get_rpc_type() == RpcType::Simple || get_rpc_type() == RpcType::ServerSideStream) {
+    if (single_request()) {
       if (request_count_ >= 1) {
         PNRPC_LOG_WARN("rpc {} request_count_ == {}", pcode, request_count_);
         co_return std::optional<request_t>();
@@ -212,32 +817,149 @@ class RpcProcessor : public RpcProcessorBase {
       auto tmp = std::move(first_requset_pkg_);
       co_return std::optional<request_t>(std::move(*tmp));
     }
-    if (first_read_eof_ == true) {
-      co_return std::optional<request_t>();
-    }
     co_return co_await get_request_stream().Read();
   }
 
+  // 一次获取至少一个、至多n个请求元素，客户端通过send_requests打包在一个请求包中的元素会被一起取出，
+  // 只有在没有已经解析出来的元素时才会读取socket。返回空表示请求读取完毕
+  net::awaitable<std::vector<request_t>> get_request_args(size_t n) {
+    std::vector<request_t> args;
+    if (n == 0) {
+      co_return args;
+    }
+    if (single_request()) {
+      auto arg = co_await get_request_arg();
+      if (arg.has_value()) {
+        args.push_back(std::move(arg).value());
+      }
+      co_return args;
+    }
+    if (first_requset_pkg_ != nullptr) {
+      auto tmp = std::move(first_requset_pkg_);
+      args.push_back(std::move(*tmp));
+      get_request_stream().TakePending(n - 1, args);
+    } else {
+      args = co_await get_request_stream().ReadMany(n);
+    }
+    request_count_ += args.size();
+    co_return args;
+  }
+
   net::awaitable<void> set_response_arg(const response_t& r, bool eof) {
+    if (check_response(eof) == false) {
+      co_return;
+    }
+    if (local_response_ != nullptr) {
+      *local_response_ = r;
+      co_return;
+    }
+    co_await get_response_stream().Send(r, RPC_OK, eof);
+    co_return;
+  }
+
+  // 进程内调用时回复被移动给调用者的response，不需要拷贝
+  net::awaitable<void> set_response_arg(response_t&& r, bool eof) {
+    if (check_response(eof) == false) {
+      co_return;
+    }
+    if (local_response_ != nullptr) {
+      *local_response_ = std::move(r);
+      co_return;
+    }
+    co_await get_response_stream().Send(r, RPC_OK, eof);
+    co_return;
+  }
+
+  // 回复错误码以及错误信息并结束回复（相当于eof），客户端读取回复时得到ret_code和err_msg，进程内调用返回ret_code
+  net::awaitable<void> set_error_response(uint32_t ret_code, const std::string& err_msg) {
+    if (get_rpc_type() == RpcType::OneWay) {
+      PNRPC_LOG_WARN("rpc {} is one way, response is ignored", pcode);
+      co_return;
+    }
+    if (response_eof_ == true) {
+      PNRPC_LOG_WARN("rpc {} repeatedly set eof", pcode);
+      co_return;
+    }
+    response_eof_ = true;
+    response_count_ += 1;
+    set_error_code(ret_code);
+    if (local_response_ != nullptr) {
+      co_return;
+    }
+    std::string package;
+    ResponsePackager<void> rp;
+    rp.seri_error_package(err_msg, ret_code, package);
+    co_await get_response_stream().SendSerialized(package, true);
+    co_return;
+  }
+
+  // 将多个回复元素打包在一个回复包中发送，eof作用于最后一个元素
+  net::awaitable<void> set_response_args(std::span<const response_t> rs, bool eof) {
+    if (get_rpc_type() == RpcType::OneWay) {
+      PNRPC_LOG_WARN("rpc {} is one way, response is ignored", pcode);
+      co_return;
+    }
     if (response_eof_ == true) {
       PNRPC_LOG_WARN("rpc {} repeatedly set eof", pcode);
       co_return;
     }
     if (get_rpc_type() == RpcType::Simple || get_rpc_type() == RpcType::ClientSideStream) {
-      if (response_count_ >= 1) {
-        PNRPC_LOG_WARN("rpc {} response_count_ == {}", pcode, response_count_);
+      if (response_count_ + rs.size() > 1) {
+        PNRPC_LOG_WARN("rpc {} response_count_ == {}", pcode, response_count_ + rs.size());
       }
     }
     response_eof_ = eof;
+    response_count_ += rs.size();
+    if (local_response_ != nullptr) {
+      if (!rs.empty()) {
+        *local_response_ = rs.back();
+      }
+      co_return;
+    }
+    co_await get_response_stream().SendMany(rs, RPC_OK, eof);
+    co_return;
+  }
+
+  // 发送已经通过ResponsePackager序列化好的回复包，同一个回复发送给多个客户端时只需要序列化一次，见Topic
+  net::awaitable<void> set_serialized_response(const std::string& package, bool eof) {
+    if (response_eof_ == true) {
+      PNRPC_LOG_WARN("rpc {} repeatedly set eof", pcode);
+      co_return;
+    }
+    response_eof_ = eof;
     response_count_ += 1;
-    co_await get_response_stream().Send(r, RPC_OK, eof);
+    co_await get_response_stream().SendSerialized(package, eof);
+    co_return;
+  }
+
+  // 将文件区间作为回复发送，文件数据通过sendfile直接从page cache写入socket，按照file_frame_size分成多个回复包，
+  // 因此一般用于ServerSideStream类型的rpc，回复类型需要为std::string
+  net::awaitable<void> set_file_response(const FileRegion& region,
+                                         bool eof) requires std::is_same_v<response_t, std::string> {
+    if (get_rpc_type() == RpcType::OneWay) {
+      PNRPC_LOG_WARN("rpc {} is one way, response is ignored", pcode);
+      co_return;
+    }
+    if (response_eof_ == true) {
+      PNRPC_LOG_WARN("rpc {} repeatedly set eof", pcode);
+      co_return;
+    }
+    size_t frames = std::max<uint64_t>((region.size() + file_frame_size - 1) / file_frame_size, 1);
+    if (get_rpc_type() == RpcType::Simple || get_rpc_type() == RpcType::ClientSideStream) {
+      if (response_count_ + frames > 1) {
+        PNRPC_LOG_WARN("rpc {} response_count_ == {}", pcode, response_count_ + frames);
+      }
+    }
+    response_eof_ = eof;
+    response_count_ += frames;
+    co_await get_response_stream().SendFile(region, eof);
     co_return;
   }
 
   const request_t& cast_to_request_pkg(void* ptr) { return *static_cast<request_t*>(ptr); }
 
   ~RpcProcessor() {
-    if (response_eof_ == false) {
+    if (response_eof_ == false && is_cancelled() == false && get_rpc_type() != RpcType::OneWay) {
       PNRPC_LOG_WARN("rpc {} diden't send eof response", pcode);
     }
   }
@@ -248,6 +970,33 @@ class RpcProcessor : public RpcProcessorBase {
   ServerToClientStream<response_t>& get_response_stream() { return response_stream; }
 
  private:
+  bool single_request() const {
+    return get_rpc_type() == RpcType::Simple || get_rpc_type() == RpcType::ServerSideStream ||
+           get_rpc_type() == RpcType::OneWay;
+  }
+
+  // 检查是否可以继续回复，并更新回复的计数以及eof标记
+  bool check_response(bool eof) {
+    if (get_rpc_type() == RpcType::OneWay) {
+      PNRPC_LOG_WARN("rpc {} is one way, response is ignored", pcode);
+      return false;
+    }
+    if (response_eof_ == true) {
+      PNRPC_LOG_WARN("rpc {} repeatedly set eof", pcode);
+      return false;
+    }
+    if (get_rpc_type() == RpcType::Simple || get_rpc_type() == RpcType::ClientSideStream) {
+      if (response_count_ >= 1) {
+        PNRPC_LOG_WARN("rpc {} response_count_ == {}", pcode, response_count_);
+      }
+    }
+    response_eof_ = eof;
+    response_count_ += 1;
+    return true;
+  }
+
+  // 在request_stream和response_stream之前构造，之后析构
+  FlowControl flow_control_;
   ClientToServerStream<request_t> request_stream;
   ServerToClientStream<response_t> response_stream;
   // 接收请求包的个数
@@ -258,7 +1007,8 @@ class RpcProcessor : public RpcProcessorBase {
   size_t response_count_;
 
   std::unique_ptr<request_t> first_requset_pkg_;
-  bool first_read_eof_;
+  // 进程内调用时回复写入这里，见RpcServer::CallLocal
+  response_t* local_response_;
 };
 
 }  // namespace pnrpc
\ No newline at end of file
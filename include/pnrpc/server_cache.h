@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "pnrpc/lru_cache.h"
+
+namespace pnrpc {
+
+struct ServerCacheOptions {
+  int64_t ttl_ms;
+  size_t max_bytes;
+};
+
+/*
+ * 服务端的结果缓存，用于声明为幂等的Simple类型rpc：
+ *  以序列化之后的请求为key，缓存序列化好的回复帧（包括长度字段），命中时直接写入socket，不需要构造processor和执行process()；
+ *  按照key的hash分成多个分片（分片数为不小于硬件线程数的2的幂），每个分片有自己的锁，减少多个io_context之间的竞争；
+ *  每个条目的代价为key与回复帧的字节数之和，max_bytes平均分配给每个分片。
+ */
+class ServerCache {
+ public:
+  using Frame = std::shared_ptr<const std::string>;
+
+  explicit ServerCache(const ServerCacheOptions& options) : ttl_(options.ttl_ms), mask_(shard_count() - 1) {
+    size_t shard_bytes = options.max_bytes / (mask_ + 1);
+    for (size_t i = 0; i <= mask_; ++i) {
+      shards_.push_back(std::make_unique<Shard>(shard_bytes));
+    }
+  }
+
+  ServerCache(const ServerCache&) = delete;
+  ServerCache& operator=(const ServerCache&) = delete;
+
+  Frame get(std::string_view request) {
+    Frame frame;
+    std::string key(request);
+    if (shard(key).get(key, frame) == Shard::State::Miss) {
+      return nullptr;
+    }
+    return frame;
+  }
+
+  void put(std::string_view request, Frame frame) {
+    std::string key(request);
+    size_t charge = key.size() + frame->size();
+    shard(key).put(key, std::move(frame), ttl_, {}, charge);
+  }
+
+  size_t size() const {
+    size_t result = 0;
+    for (auto& each : shards_) {
+      result += each->size();
+    }
+    return result;
+  }
+
+  size_t charge() const {
+    size_t result = 0;
+    for (auto& each : shards_) {
+      result += each->charge();
+    }
+    return result;
+  }
+
+ private:
+  using Shard = LruCache<std::string, Frame>;
+
+  static size_t shard_count() {
+    size_t count = 1;
+    while (count < std::thread::hardware_concurrency()) {
+      count <<= 1;
+    }
+    return count;
+  }
+
+  Shard& shard(const std::string& key) { return *shards_[std::hash<std::string>()(key) & mask_]; }
+
+  std::chrono::milliseconds ttl_;
+  size_t mask_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+}  // namespace pnrpc
@@ -0,0 +1,428 @@
+#pragma once
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "pnrpc/asio_version.h"
+#include "pnrpc/exception.h"
+#include "pnrpc/transport.h"
+
+namespace pnrpc {
+
+// 每个方向的环形缓冲区的默认大小，单位字节
+constexpr size_t default_shm_ring_size = 4 * 1024 * 1024;
+// 环形缓冲区的最小大小，保证第二个环形缓冲区的头部（位于第一个缓冲区的数据之后）满足RingHeader的对齐要求
+constexpr size_t min_shm_ring_size = 4096;
+
+/*
+ * 同一台机器上的进程之间基于共享内存的传输通道：
+ *  客户端创建一块共享内存（memfd）以及4个eventfd，通过unix domain socket（SCM_RIGHTS）发送给服务端；
+ *  共享内存中每个方向有一个单生产者单消费者的环形缓冲区，读写不需要系统调用，
+ *  只有当一端需要等待（缓冲区为空或者满）并且声明了等待时，另一端才通过eventfd唤醒它；
+ *  握手之后unix domain socket上不再有数据，它只用来感知对端关闭连接（包括进程退出）：等待eventfd的同时等待socket可读。
+ * 同一个连接上的读写协程运行在同一个线程中，与socket相同，ShmChannel不是线程安全的。
+ */
+class ShmChannel {
+ public:
+  ShmChannel(const ShmChannel&) = delete;
+  ShmChannel& operator=(const ShmChannel&) = delete;
+
+  ~ShmChannel() {
+    if (base_ != nullptr) {
+      ::munmap(base_, map_size_);
+    }
+    for (int fd : fds_) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+    }
+  }
+
+  // 客户端：socket已经连接到服务端的unix domain socket
+  static net::awaitable<std::shared_ptr<ShmChannel>> Connect(Socket& socket, size_t ring_size = default_shm_ring_size) {
+    auto channel = Create(ring_size);
+    co_await socket.async_wait(Socket::wait_write, net::use_awaitable);
+    channel->send_fds(socket);
+    co_return channel;
+  }
+
+  static std::shared_ptr<ShmChannel> ConnectSync(Socket& socket, size_t ring_size = default_shm_ring_size) {
+    auto channel = Create(ring_size);
+    socket.wait(Socket::wait_write);
+    channel->send_fds(socket);
+    return channel;
+  }
+
+  // 服务端：接收客户端发送的共享内存以及eventfd
+  static net::awaitable<std::shared_ptr<ShmChannel>> Accept(Socket& socket) {
+    co_await socket.async_wait(Socket::wait_read, net::use_awaitable);
+    std::shared_ptr<ShmChannel> channel(new ShmChannel(false));
+    channel->recv_fds(socket);
+    co_return channel;
+  }
+
+  template <typename ConstBufferSequence>
+  net::awaitable<void> async_write(Socket& peer, const ConstBufferSequence& bufs) {
+    for (auto it = net::buffer_sequence_begin(bufs); it != net::buffer_sequence_end(bufs); ++it) {
+      const char* data = static_cast<const char*>(it->data());
+      size_t size = it->size();
+      while (size > 0) {
+        size_t n = tx_.write_some(data, size);
+        if (n == 0) {
+          co_await async_wait_event(peer, tx_.header->writer_waiting, tx_space_fd(),
+                                    [this]() { return tx_.writable() != 0; });
+          continue;
+        }
+        notify_reader();
+        data += n;
+        size -= n;
+      }
+    }
+    co_return;
+  }
+
+  template <typename ConstBufferSequence>
+  void write(Socket& peer, const ConstBufferSequence& bufs) {
+    for (auto it = net::buffer_sequence_begin(bufs); it != net::buffer_sequence_end(bufs); ++it) {
+      const char* data = static_cast<const char*>(it->data());
+      size_t size = it->size();
+      while (size > 0) {
+        size_t n = tx_.write_some(data, size);
+        if (n == 0) {
+          wait_event(peer, tx_.header->writer_waiting, tx_space_fd(), [this]() { return tx_.writable() != 0; });
+          continue;
+        }
+        notify_reader();
+        data += n;
+        size -= n;
+      }
+    }
+  }
+
+  net::awaitable<void> async_read(Socket& peer, net::mutable_buffer buf) {
+    char* data = static_cast<char*>(buf.data());
+    size_t size = buf.size();
+    while (size > 0) {
+      size_t n = rx_.read_some(data, size);
+      if (n == 0) {
+        co_await async_wait_readable(peer);
+        continue;
+      }
+      notify_writer();
+      data += n;
+      size -= n;
+    }
+    co_return;
+  }
+
+  void read(Socket& peer, net::mutable_buffer buf) {
+    char* data = static_cast<char*>(buf.data());
+    size_t size = buf.size();
+    while (size > 0) {
+      size_t n = rx_.read_some(data, size);
+      if (n == 0) {
+        wait_event(peer, rx_.header->reader_waiting, rx_data_fd(), [this]() { return rx_.readable() != 0; });
+        continue;
+      }
+      notify_writer();
+      data += n;
+      size -= n;
+    }
+  }
+
+  // 等待对端写入数据，对端关闭连接时抛出异常
+  net::awaitable<void> async_wait_readable(Socket& peer) {
+    while (rx_.readable() == 0) {
+      co_await async_wait_event(peer, rx_.header->reader_waiting, rx_data_fd(),
+                                [this]() { return rx_.readable() != 0; });
+    }
+    co_return;
+  }
+
+ private:
+  // 环形缓冲区的头部，读写位置单调递增，分别只由消费者、生产者修改
+  struct RingHeader {
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) std::atomic<uint32_t> reader_waiting;
+    std::atomic<uint32_t> writer_waiting;
+  };
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free, "shm ring requires lock free atomics");
+  static_assert(min_shm_ring_size % alignof(RingHeader) == 0, "shm ring size must keep ring header aligned");
+
+  // 读写位置都在共享内存中，对端可以任意修改，因此每次访问都检查读写位置是否一致，不一致时抛出异常关闭连接，
+  // 保证memcpy不会越过映射的范围
+  struct Ring {
+    RingHeader* header = nullptr;
+    char* data = nullptr;
+    size_t capacity = 0;
+
+    size_t used(uint64_t head, uint64_t tail) const {
+      if (tail < head || tail - head > capacity) {
+        throw PnrpcException("inconsistent shm ring, head = " + std::to_string(head) + ", tail = " +
+                             std::to_string(tail));
+      }
+      return static_cast<size_t>(tail - head);
+    }
+
+    size_t readable() const {
+      uint64_t tail = header->tail.load(std::memory_order_acquire);
+      return used(header->head.load(std::memory_order_relaxed), tail);
+    }
+
+    size_t writable() const {
+      uint64_t head = header->head.load(std::memory_order_acquire);
+      return capacity - used(head, header->tail.load(std::memory_order_relaxed));
+    }
+
+    size_t write_some(const char* src, size_t size) {
+      uint64_t head = header->head.load(std::memory_order_acquire);
+      uint64_t tail = header->tail.load(std::memory_order_relaxed);
+      size_t n = std::min(size, capacity - used(head, tail));
+      size_t offset = tail & (capacity - 1);
+      size_t first = std::min(n, capacity - offset);
+      std::memcpy(data + offset, src, first);
+      std::memcpy(data, src + first, n - first);
+      header->tail.store(tail + n, std::memory_order_seq_cst);
+      return n;
+    }
+
+    size_t read_some(char* dst, size_t size) {
+      uint64_t tail = header->tail.load(std::memory_order_acquire);
+      uint64_t head = header->head.load(std::memory_order_relaxed);
+      size_t n = std::min(size, used(head, tail));
+      size_t offset = head & (capacity - 1);
+      size_t first = std::min(n, capacity - offset);
+      std::memcpy(dst, data + offset, first);
+      std::memcpy(dst + first, data, n - first);
+      header->head.store(head + n, std::memory_order_seq_cst);
+      return n;
+    }
+  };
+
+  // 共享内存的布局：[RingHeader A][A的数据][RingHeader B][B的数据]，客户端写A读B，服务端写B读A；
+  // fds_依次为 memfd、A的数据事件、A的空间事件、B的数据事件、B的空间事件
+  static constexpr size_t fd_count = 5;
+  static constexpr uint32_t handshake_magic = 0x70736D31;
+  // 映射之后对端不能再改变共享内存的大小，否则访问被截断的部分时会收到SIGBUS
+  static constexpr int required_seals = F_SEAL_SHRINK | F_SEAL_GROW;
+
+  explicit ShmChannel(bool client) : client_(client), base_(nullptr), map_size_(0) { fds_.fill(-1); }
+
+  static std::shared_ptr<ShmChannel> Create(size_t ring_size) {
+    std::shared_ptr<ShmChannel> channel(new ShmChannel(true));
+    size_t capacity = min_shm_ring_size;
+    while (capacity < ring_size) {
+      capacity <<= 1;
+    }
+    channel->fds_[0] = ::memfd_create("pnrpc_shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (channel->fds_[0] < 0) {
+      throw_errno("memfd_create");
+    }
+    if (::ftruncate(channel->fds_[0], static_cast<off_t>(2 * (sizeof(RingHeader) + capacity))) != 0) {
+      throw_errno("ftruncate");
+    }
+    if (::fcntl(channel->fds_[0], F_ADD_SEALS, required_seals | F_SEAL_SEAL) != 0) {
+      throw_errno("fcntl(F_ADD_SEALS)");
+    }
+    for (size_t i = 1; i < fd_count; ++i) {
+      channel->fds_[i] = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (channel->fds_[i] < 0) {
+        throw_errno("eventfd");
+      }
+    }
+    channel->map();
+    return channel;
+  }
+
+  void map() {
+    // 服务端不信任客户端发送的memfd，首先确认大小已经被封印
+    int seals = ::fcntl(fds_[0], F_GET_SEALS);
+    if (seals < 0) {
+      throw_errno("fcntl(F_GET_SEALS)");
+    }
+    if ((seals & required_seals) != required_seals) {
+      throw PnrpcException("shm channel memfd is not sealed : " + std::to_string(seals));
+    }
+    struct stat st;
+    if (::fstat(fds_[0], &st) != 0) {
+      throw_errno("fstat");
+    }
+    map_size_ = static_cast<size_t>(st.st_size);
+    size_t capacity = map_size_ / 2 - std::min(map_size_ / 2, sizeof(RingHeader));
+    if (capacity < min_shm_ring_size || (capacity & (capacity - 1)) != 0) {
+      throw PnrpcException("invalid shm channel size : " + std::to_string(map_size_));
+    }
+    base_ = ::mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fds_[0], 0);
+    if (base_ == MAP_FAILED) {
+      base_ = nullptr;
+      throw_errno("mmap");
+    }
+    // 新建的memfd内容为0，与atomic的初始状态一致
+    Ring a = make_ring(static_cast<char*>(base_), capacity);
+    Ring b = make_ring(static_cast<char*>(base_) + sizeof(RingHeader) + capacity, capacity);
+    tx_ = client_ ? a : b;
+    rx_ = client_ ? b : a;
+  }
+
+  static Ring make_ring(char* base, size_t capacity) {
+    Ring ring;
+    ring.header = reinterpret_cast<RingHeader*>(base);
+    ring.data = base + sizeof(RingHeader);
+    ring.capacity = capacity;
+    return ring;
+  }
+
+  int tx_data_fd() const { return client_ ? fds_[1] : fds_[3]; }
+  int tx_space_fd() const { return client_ ? fds_[2] : fds_[4]; }
+  int rx_data_fd() const { return client_ ? fds_[3] : fds_[1]; }
+  int rx_space_fd() const { return client_ ? fds_[4] : fds_[2]; }
+
+  void notify_reader() {
+    if (tx_.header->reader_waiting.load(std::memory_order_seq_cst) != 0) {
+      signal(tx_data_fd());
+    }
+  }
+
+  void notify_writer() {
+    if (rx_.header->writer_waiting.load(std::memory_order_seq_cst) != 0) {
+      signal(rx_space_fd());
+    }
+  }
+
+  static void signal(int fd) {
+    uint64_t one = 1;
+    [[maybe_unused]] auto n = ::write(fd, &one, sizeof(one));
+  }
+
+  static void drain(int fd) {
+    uint64_t value = 0;
+    [[maybe_unused]] auto n = ::read(fd, &value, sizeof(value));
+  }
+
+  // 声明等待之后再检查一次条件，与对端 修改读写位置之后检查等待标记 配合，不会丢失唤醒
+  template <typename Ready>
+  net::awaitable<void> async_wait_event(Socket& peer, std::atomic<uint32_t>& waiting, int event_fd, Ready ready) {
+    waiting.store(1, std::memory_order_seq_cst);
+    if (!ready()) {
+      using namespace net::experimental::awaitable_operators;
+      auto& event = event_descriptor(event_fd, co_await net::this_coro::executor);
+      // 读取eventfd的计数而不是async_wait：读操作会先尝试直接读取，在注册等待之前到达的唤醒不会丢失
+      uint64_t value = 0;
+      auto result = co_await (event.async_read_some(net::buffer(&value, sizeof(value)), net::use_awaitable) ||
+                              peer.async_wait(Socket::wait_read, net::use_awaitable));
+      if (result.index() == 1 && !ready()) {
+        waiting.store(0, std::memory_order_seq_cst);
+        throw system_error(net::error::eof, "shm channel is closed by peer");
+      }
+    }
+    waiting.store(0, std::memory_order_seq_cst);
+    co_return;
+  }
+
+  // 每个eventfd在通道的生命周期内只注册一次，连接被转移到其他io_context上之后重新注册
+  net::posix::stream_descriptor& event_descriptor(int event_fd, const net::any_io_executor& executor) {
+    size_t index = static_cast<size_t>(std::find(fds_.begin(), fds_.end(), event_fd) - fds_.begin());
+    auto& event = events_[index];
+    if (event == nullptr || event->get_executor() != executor) {
+      int fd = ::dup(event_fd);
+      if (fd < 0) {
+        throw_errno("dup");
+      }
+      event = std::make_unique<net::posix::stream_descriptor>(executor, fd);
+    }
+    return *event;
+  }
+
+  template <typename Ready>
+  void wait_event(Socket& peer, std::atomic<uint32_t>& waiting, int event_fd, Ready ready) {
+    waiting.store(1, std::memory_order_seq_cst);
+    while (!ready()) {
+      std::array<pollfd, 2> fds{pollfd{event_fd, POLLIN, 0}, pollfd{peer.native_handle(), POLLIN, 0}};
+      if (::poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR) {
+        waiting.store(0, std::memory_order_seq_cst);
+        throw_errno("poll");
+      }
+      drain(event_fd);
+      if (fds[1].revents != 0 && !ready()) {
+        waiting.store(0, std::memory_order_seq_cst);
+        throw system_error(net::error::eof, "shm channel is closed by peer");
+      }
+    }
+    waiting.store(0, std::memory_order_seq_cst);
+  }
+
+  void send_fds(Socket& socket) {
+    uint32_t magic = handshake_magic;
+    iovec iov{&magic, sizeof(magic)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * fd_count)];
+    std::memset(control, 0, sizeof(control));
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fd_count);
+    std::memcpy(CMSG_DATA(cmsg), fds_.data(), sizeof(int) * fd_count);
+    if (::sendmsg(socket.native_handle(), &msg, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(magic))) {
+      throw_errno("sendmsg");
+    }
+  }
+
+  void recv_fds(Socket& socket) {
+    uint32_t magic = 0;
+    iovec iov{&magic, sizeof(magic)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * fd_count)];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n = ::recvmsg(socket.native_handle(), &msg, MSG_CMSG_CLOEXEC);
+    if (n == 0) {
+      throw system_error(net::error::eof, "shm channel handshake");
+    }
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (n != static_cast<ssize_t>(sizeof(magic)) || cmsg == nullptr || cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(int) * fd_count)) {
+      throw PnrpcException("invalid shm channel handshake");
+    }
+    std::memcpy(fds_.data(), CMSG_DATA(cmsg), sizeof(int) * fd_count);
+    if (magic != handshake_magic) {
+      throw PnrpcException("invalid shm channel handshake magic");
+    }
+    map();
+  }
+
+  static void throw_errno(const char* what) {
+    throw system_error(error_code(errno, net::error::get_system_category()), what);
+  }
+
+  bool client_;
+  std::array<int, fd_count> fds_;
+  std::array<std::unique_ptr<net::posix::stream_descriptor>, fd_count> events_;
+  void* base_;
+  size_t map_size_;
+  Ring tx_;
+  Ring rx_;
+};
+
+}  // namespace pnrpc
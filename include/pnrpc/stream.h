@@ -1,20 +1,39 @@
 #pragma once
 
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <cerrno>
 #include <chrono>
+#include <deque>
+#include <functional>
 #include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <thread>
+#include <type_traits>
+#include <vector>
 
 #include "pnrpc/asio_version.h"
+#include "pnrpc/bandwidth_budget.h"
+#include "pnrpc/compression.h"
 #include "pnrpc/current_limiting.h"
 #include "pnrpc/exception.h"
+#include "pnrpc/file_region.h"
+#include "pnrpc/flow_control.h"
 #include "pnrpc/log.h"
+#include "pnrpc/memory_budget.h"
 #include "pnrpc/packager.h"
 #include "pnrpc/rpc_concept.h"
 #include "pnrpc/rpc_type_creator.h"
+#include "pnrpc/shm_channel.h"
+#include "pnrpc/timer_wheel.h"
+#include "pnrpc/transport.h"
 #include "pnrpc/util.h"
 
 namespace pnrpc {
@@ -25,102 +44,813 @@ namespace pnrpc {
  *  提供对流式数据的分包；
  *  记录在该socket上的一些统计数据（读写字节数、开始和结束的时间（todo））；
  *  支持同步阻塞式和协程式的接口；
- *  支持对读写操作的限流;
+ *  支持对读写操作的限流，以及与其他stream共享的带宽预算;
+ *  支持基于credit的流控，同一个socket上的读写两个stream绑定同一个FlowControl对象;
+ *  支持捕获模式：发送的数据帧被追加到指定的buffer而不是写入socket（用于批量请求）;
+ *  绑定了共享内存通道时数据读写共享内存中的环形缓冲区，socket只用来感知对端关闭连接，见ShmChannel;
+ *  支持限制读取的数据帧大小，以及在为数据帧分配内存之前申请与其他stream共享的内存预算;
+ *  支持压缩发送的数据帧，读取时自动解压，较大的数据帧在CompressionPool中压缩/解压;
  */
 class StreamBase {
  public:
-  StreamBase() : socket_(nullptr), write_bytes_(0), read_bytes_(0) {}
+  // 读取请求包时在分配内存之前调用，参数为请求包的pcode、长度以及压缩帧的长度（没有压缩时为0，
+  // 解压时压缩帧与原始数据同时占用内存），可以抛出异常拒绝该请求或者等待内存预算
+  using Admission = std::function<net::awaitable<void>(uint32_t pcode, size_t length, size_t compressed_length)>;
+
+  StreamBase()
+      : socket_(nullptr),
+        shm_(nullptr),
+        write_bytes_(0),
+        read_bytes_(0),
+        flow_control_(nullptr),
+        capture_(nullptr),
+        write_through_(false),
+        max_frame_size_(max_package_size),
+        compress_threshold_(0),
+        reject_compressed_(false),
+        partial_read_(false),
+        io_wheel_(nullptr),
+        io_timeout_(0) {}
+
+  void update_bind_socket(Socket* s, ShmChannel* shm = nullptr) {
+    socket_ = s;
+    shm_ = shm;
+  }
 
-  void update_bind_socket(net::ip::tcp::socket* s) { socket_ = s; }
+  // 开启捕获模式之后，发送的数据帧（包括长度字段）被追加到out中，不经过限流和流控；
+  // write_through为true时数据帧在被追加到out的同时照常写入socket（例如用于缓存回复）
+  void capture_to(std::string* out, bool write_through = false) {
+    capture_ = out;
+    write_through_ = write_through;
+  }
 
   void update_read_limiting(size_t up_water) { read_limiting_.update_up_water_level(up_water); }
 
   void update_write_limiting(size_t up_water) { write_limiting_.update_up_water_level(up_water); }
 
+  // 读写操作需要同时满足本stream的限流以及所有绑定的共享带宽预算
+  void add_read_budget(std::shared_ptr<BandwidthBudget> budget) {
+    if (budget != nullptr) {
+      read_budgets_.push_back(std::move(budget));
+    }
+  }
+
+  void add_write_budget(std::shared_ptr<BandwidthBudget> budget) {
+    if (budget != nullptr) {
+      write_budgets_.push_back(std::move(budget));
+    }
+  }
+
+  void bind_flow_control(FlowControl* fc) { flow_control_ = fc; }
+
+  // 在连接上实际读写的字节数（压缩之后的大小）
+  size_t get_write_bytes() const { return write_bytes_; }
+
+  size_t get_read_bytes() const { return read_bytes_; }
+
+  // 不小于threshold字节的数据帧压缩之后发送，0表示不压缩。捕获模式以及共享内存通道上的数据帧不压缩
+  void enable_compression(size_t threshold) { compress_threshold_ = threshold; }
+
+  // 没有开启压缩的rpc收到压缩帧时抛出异常
+  void reject_compressed_frames(bool reject) { reject_compressed_ = reject; }
+
+  // 协程式接口的每次读写在timeout内没有完成时关闭socket的读写两端，正在等待的读写以错误结束。
+  // 定时器挂在当前io_context的时间轮上，因此需要在stream被调度到执行它的io_context之后设置
+  void set_io_timeout(TimerWheel& wheel, std::chrono::milliseconds timeout) {
+    io_wheel_ = &wheel;
+    io_timeout_ = timeout;
+  }
+
+  // 读取的数据帧超过max_frame_size时抛出异常；budget不为空时协程式接口在为数据帧分配内存之前从中申请预算，
+  // 预算不足时暂停读取，申请的预算（以及current）在读取下一个数据帧或者本stream析构时归还
+  void limit_read_frame(size_t max_frame_size, std::shared_ptr<MemoryBudget> budget,
+                        MemoryBudget::Reservation current = {}) {
+    max_frame_size_ = std::min(max_frame_size, max_package_size);
+    memory_budget_ = std::move(budget);
+    frame_reservation_ = std::move(current);
+  }
+
+  // 扩大本端的接收窗口并立即将额外的credit授予对端
+  net::awaitable<void> enlarge_recv_window(size_t window) {
+    if (flow_control_ != nullptr) {
+      flow_control_->enlarge_recv_window(window);
+      co_await coro_flush_credit();
+    }
+    co_return;
+  }
+
+  void enlarge_recv_window_sync(size_t window) {
+    if (flow_control_ != nullptr) {
+      flow_control_->enlarge_recv_window(window);
+      flush_credit();
+    }
+  }
+
+  // 对于不经过本stream读取的数据帧（例如服务端的第一个请求包），需要手动计入接收窗口的消费量
+  void on_consume(size_t frame_bytes) {
+    if (flow_control_ != nullptr) {
+      flow_control_->on_consume(frame_bytes);
+    }
+  }
+
+  // 请求读取完毕之后由服务端调用：等待对端的控制帧，Credit帧被计入流控之后继续等待，
+  // 对端发送Cancel帧、关闭连接或者发送了非预期的数据帧时返回
+  net::awaitable<void> coro_watch_cancel() {
+    ReadingGuard guard(flow_control_);
+    try {
+      for (;;) {
+        co_await coro_wait_readable();
+        // 异步读取控制帧，对端只发送了半个帧时不会阻塞io线程。读取到一半时被取消的话连接上残留了半个帧，
+        // 通过partial_read()告知调用者关闭连接
+        partial_read_ = true;
+        char data[sizeof(uint32_t)];
+        co_await coro_read(net::buffer(data));
+        auto length = integralParse<uint32_t>(data);
+        if ((length & control_frame_bit) == 0) {
+          PNRPC_LOG_WARN("unexpected data frame after request eof");
+          co_return;
+        }
+        char body[max_control_frame_size];
+        size_t body_len = check_control_frame_length(length);
+        co_await coro_read(net::buffer(body, body_len));
+        partial_read_ = false;
+        read_bytes_ = read_bytes_ + sizeof(uint32_t) + body_len;
+        handle_control_frame(body, body_len);
+      }
+    } catch (system_error& e) {
+      // 对端发送了Cancel帧或者关闭了连接
+    }
+    co_return;
+  }
+
+  // coro_watch_cancel在读取帧的过程中结束（被取消或者读取到了非控制帧），连接上的数据已经不完整，不能继续使用
+  bool partial_read() const { return partial_read_; }
+
  protected:
-  net::awaitable<void> coro_send(const std::string& buf) {
-    std::string tmp;
-    uint32_t length = buf.size();
-    if (length >= max_package_size) {
-      throw PnrpcException("package is too large : " + std::to_string(length));
+  // 数据帧的格式为 长度(4字节) + 数据，开启限流时按照限流器的chunk_size分块发送，每一块发送之前等待令牌
+  net::awaitable<void> coro_send(const std::string& raw) {
+    std::optional<std::string> compressed;
+    if (should_compress(raw)) {
+      compressed = co_await coro_run_compression(raw.size(), [&raw]() { return CompressFrame(raw); });
     }
-    integralSeri(length, tmp);
-    tmp.append(buf);
-    size_t sleep_s = write_limiting_.calcualte_sleep_time(write_bytes_);
-    if (sleep_s != 0) {
-      net::steady_timer timer(co_await net::this_coro::executor, std::chrono::seconds(sleep_s));
-      co_await timer.async_wait(net::use_awaitable);
+    const std::string& buf = compressed.has_value() ? compressed.value() : raw;
+    char header[sizeof(uint32_t)];
+    seri_frame_length(buf, header, compressed.has_value() ? compressed_frame_bit : 0);
+    if (capture(header, buf) == true) {
+      co_return;
     }
-    co_await net::async_write(*socket_, net::buffer(tmp), net::use_awaitable);
-    write_bytes_ += tmp.size();
+    if (flow_control_ != nullptr) {
+      co_await coro_wait_credit();
+      co_await coro_acquire_write();
+      flow_control_->on_send(sizeof(header) + buf.size());
+    }
+    WritingGuard guard(flow_control_);
+    size_t offset = 0;
+    do {
+      size_t n = std::min(buf.size() - offset, chunk_size(write_limiting_, write_budgets_));
+      size_t header_len = offset == 0 ? sizeof(header) : 0;
+      co_await coro_wait(reserve(write_limiting_, write_budgets_, header_len + n));
+      std::array<net::const_buffer, 2> bufs{net::buffer(header, header_len), net::buffer(&buf[offset], n)};
+      co_await coro_write(bufs);
+      offset += n;
+      write_bytes_ += header_len + n;
+    } while (offset < buf.size());
+    co_await coro_write_pending_credit();
     co_return;
   }
 
-  void send(const std::string& buf) {
-    std::string tmp;
-    uint32_t length = buf.size();
-    if (length >= max_package_size) {
-      throw PnrpcException("package is too large : " + std::to_string(length));
+  void send(const std::string& raw) {
+    std::optional<std::string> compressed;
+    if (should_compress(raw)) {
+      compressed = CompressFrame(raw);
     }
-    integralSeri(length, tmp);
-    tmp.append(buf);
-    size_t sleep_s = write_limiting_.calcualte_sleep_time(write_bytes_);
-    if (sleep_s != 0) {
-      std::this_thread::sleep_for(std::chrono::seconds(sleep_s));
+    const std::string& buf = compressed.has_value() ? compressed.value() : raw;
+    char header[sizeof(uint32_t)];
+    seri_frame_length(buf, header, compressed.has_value() ? compressed_frame_bit : 0);
+    if (capture(header, buf) == true) {
+      return;
     }
-    net::write(*socket_, net::buffer(tmp));
-    write_bytes_ += tmp.size();
+    if (flow_control_ != nullptr) {
+      // 同步接口只会在一个线程中使用，credit不足时直接读取对端的控制帧
+      while (!flow_control_->can_send()) {
+        auto frame = read_frame();
+        if (frame.has_value()) {
+          flow_control_->stash(std::move(frame).value());
+        }
+      }
+      flow_control_->on_send(sizeof(header) + buf.size());
+    }
+    size_t offset = 0;
+    do {
+      size_t n = std::min(buf.size() - offset, chunk_size(write_limiting_, write_budgets_));
+      size_t header_len = offset == 0 ? sizeof(header) : 0;
+      std::this_thread::sleep_for(reserve(write_limiting_, write_budgets_, header_len + n));
+      std::array<net::const_buffer, 2> bufs{net::buffer(header, header_len), net::buffer(&buf[offset], n)};
+      write(bufs);
+      offset += n;
+      write_bytes_ += header_len + n;
+    } while (offset < buf.size());
+    flush_credit();
   }
 
   net::awaitable<std::string> coro_recv() {
+    std::optional<std::string> buf;
+    if (flow_control_ != nullptr) {
+      while (flow_control_->is_reading()) {
+        co_await coro_wait_flow_event();
+      }
+      if (flow_control_->has_stashed()) {
+        buf = flow_control_->take_stashed();
+      }
+    }
+    if (!buf.has_value()) {
+      ReadingGuard guard(flow_control_);
+      do {
+        buf = co_await coro_read_frame();
+      } while (!buf.has_value());
+    }
+    co_await coro_flush_credit();
+    co_return std::move(buf).value();
+  }
+
+  // 读取一个请求包，读取到长度和pcode之后先经过admit，再为请求包分配内存
+  net::awaitable<std::string> coro_recv(const Admission& admit) {
+    std::optional<std::string> buf;
+    do {
+      buf = co_await coro_read_frame(&admit);
+    } while (!buf.has_value());
+    co_return std::move(buf).value();
+  }
+
+  std::string recv() {
+    std::optional<std::string> buf;
+    if (flow_control_ != nullptr && flow_control_->has_stashed()) {
+      buf = flow_control_->take_stashed();
+    }
+    while (!buf.has_value()) {
+      buf = read_frame();
+    }
+    flush_credit();
+    return std::move(buf).value();
+  }
+
+  // 写入已经序列化好的数据帧（包括长度字段），不经过限流和流控
+  net::awaitable<void> coro_send_raw(const std::string& frames) {
+    co_await coro_write(net::buffer(frames));
+    write_bytes_ += frames.size();
+    co_return;
+  }
+
+  // 不经过流控直接发送一个数据帧，用于单向请求
+  net::awaitable<void> coro_send_direct(const std::string& raw) {
+    std::optional<std::string> compressed;
+    if (should_compress(raw)) {
+      compressed = co_await coro_run_compression(raw.size(), [&raw]() { return CompressFrame(raw); });
+    }
+    const std::string& buf = compressed.has_value() ? compressed.value() : raw;
+    char header[sizeof(uint32_t)];
+    seri_frame_length(buf, header, compressed.has_value() ? compressed_frame_bit : 0);
+    std::array<net::const_buffer, 2> bufs{net::buffer(header), net::buffer(buf)};
+    co_await coro_write(bufs);
+    write_bytes_ += sizeof(header) + buf.size();
+    co_return;
+  }
+
+  // 文件帧的格式为 长度(4字节，次高位为1) + eof(1字节) + 文件数据，文件数据通过sendfile从page cache直接写入socket。
+  // 与普通数据帧一样经过限流和流控；绑定了共享内存通道或者开启了捕获模式时读取文件之后发送普通的回复包
+  net::awaitable<void> coro_send_file(const FileRegion& region, uint64_t offset, size_t size, bool eof) {
+    if (shm_ != nullptr || capture_ != nullptr) {
+      std::string buf;
+      ResponsePackager<std::string> rp;
+      rp.seri_response_package(region.Read(offset, size), buf, RPC_OK, eof);
+      co_await coro_send(buf);
+      co_return;
+    }
+    std::string header;
+    integralSeri<uint32_t>(file_frame_bit | static_cast<uint32_t>(sizeof(uint8_t) + size), header);
+    integralSeri<uint8_t>(eof == true ? 1 : 0, header);
+    if (flow_control_ != nullptr) {
+      co_await coro_wait_credit();
+      co_await coro_acquire_write();
+      flow_control_->on_send(header.size() + size);
+    }
+    WritingGuard guard(flow_control_);
+    co_await coro_wait(reserve(write_limiting_, write_budgets_, header.size()));
+    co_await coro_write(net::buffer(header));
+    write_bytes_ += header.size();
+    size_t sent = 0;
+    while (sent < size) {
+      size_t n = std::min(size - sent, chunk_size(write_limiting_, write_budgets_));
+      co_await coro_wait(reserve(write_limiting_, write_budgets_, n));
+      co_await coro_sendfile(region.fd(), offset + sent, n);
+      sent += n;
+      write_bytes_ += n;
+    }
+    co_await coro_write_pending_credit();
+    co_return;
+  }
+
+  void send_direct(const std::string& raw) {
+    std::optional<std::string> compressed;
+    if (should_compress(raw)) {
+      compressed = CompressFrame(raw);
+    }
+    const std::string& buf = compressed.has_value() ? compressed.value() : raw;
+    char header[sizeof(uint32_t)];
+    seri_frame_length(buf, header, compressed.has_value() ? compressed_frame_bit : 0);
+    std::array<net::const_buffer, 2> bufs{net::buffer(header), net::buffer(buf)};
+    write(bufs);
+    write_bytes_ += sizeof(header) + buf.size();
+  }
+
+  net::awaitable<void> coro_send_control(ControlType type, uint32_t value = 0) {
+    std::string tmp;
+    seri_control_frame(type, value, tmp);
+    co_await coro_write(net::buffer(tmp));
+    write_bytes_ += tmp.size();
+    co_return;
+  }
+
+  void send_control(ControlType type, uint32_t value = 0) {
+    std::string tmp;
+    seri_control_frame(type, value, tmp);
+    write(net::buffer(tmp));
+    write_bytes_ += tmp.size();
+  }
+
+ private:
+  // 读取一个帧：数据帧返回其内容，控制帧在处理之后返回std::nullopt
+  net::awaitable<std::optional<std::string>> coro_read_frame(const Admission* admit = nullptr) {
     char data[sizeof(uint32_t)];
-    co_await net::async_read(*socket_, net::buffer(data), net::use_awaitable);
+    co_await coro_read(net::buffer(data));
     auto length = integralParse<uint32_t>(data);
-    if (length >= max_package_size) {
-      throw PnrpcException("package is too large : " + std::to_string(length));
+    if ((length & control_frame_bit) != 0) {
+      char body[max_control_frame_size];
+      size_t body_len = check_control_frame_length(length);
+      co_await coro_read(net::buffer(body, body_len));
+      read_bytes_ = read_bytes_ + sizeof(uint32_t) + body_len;
+      handle_control_frame(body, body_len);
+      co_return std::optional<std::string>();
     }
+    bool file_frame = (length & file_frame_bit) != 0;
+    bool compressed = (length & compressed_frame_bit) != 0;
+    length &= ~(file_frame_bit | compressed_frame_bit);
+    check_frame_length(length);
     std::string buf;
-    buf.resize(length);
-    size_t sleep_s = read_limiting_.calcualte_sleep_time(read_bytes_);
-    if (sleep_s != 0) {
-      net::steady_timer timer(co_await net::this_coro::executor, std::chrono::seconds(sleep_s));
-      co_await timer.async_wait(net::use_awaitable);
+    size_t offset = 0;
+    if (compressed == true) {
+      // 先读取压缩帧中不压缩的原始长度以及pcode，按照原始长度经过admit或者申请内存预算之后再分配压缩帧的内存
+      if (reject_compressed_ == true) {
+        throw PnrpcException("unexpected compressed frame");
+      }
+      if (length < compressed_frame_prefix) {
+        throw PnrpcException("invalid compressed frame length : " + std::to_string(length));
+      }
+      char prefix[compressed_frame_prefix];
+      co_await coro_wait(reserve(read_limiting_, read_budgets_, sizeof(data) + sizeof(prefix)));
+      co_await coro_read(net::buffer(prefix));
+      std::string_view view(prefix, sizeof(prefix));
+      size_t raw_size = CompressedFrameRawSize(view);
+      check_frame_length(raw_size);
+      co_await admit_frame(admit, CompressedFrameHead(view), raw_size, length);
+      buf.resize(length);
+      std::copy(prefix, prefix + sizeof(prefix), buf.begin());
+      offset = sizeof(prefix);
+    } else if (admit != nullptr) {
+      // 请求包以pcode开头，先读取pcode，经过admit之后再分配请求包的内存
+      if (length < sizeof(uint32_t)) {
+        throw PnrpcException("invalid request package length : " + std::to_string(length));
+      }
+      char head[sizeof(uint32_t)];
+      co_await coro_wait(reserve(read_limiting_, read_budgets_, sizeof(data) + sizeof(head)));
+      co_await coro_read(net::buffer(head));
+      co_await admit_frame(admit, integralParse<uint32_t>(head), length, 0);
+      buf.resize(length);
+      std::copy(head, head + sizeof(head), buf.begin());
+      offset = sizeof(head);
+    } else {
+      co_await admit_frame(nullptr, 0, length, 0);
+      buf.resize(length);
+    }
+    while (offset < length) {
+      size_t n = std::min(length - offset, chunk_size(read_limiting_, read_budgets_));
+      size_t header_len = offset == 0 ? sizeof(data) : 0;
+      co_await coro_wait(reserve(read_limiting_, read_budgets_, header_len + n));
+      co_await coro_read(net::buffer(&buf[offset], n));
+      offset += n;
     }
-    co_await net::async_read(*socket_, net::buffer(buf), net::use_awaitable);
     read_bytes_ = read_bytes_ + sizeof(uint32_t) + length;
+    on_frame_read(length, file_frame, buf);
+    if (compressed == true) {
+      size_t raw_size = CompressedFrameRawSize(buf);
+      buf = co_await coro_run_compression(raw_size, [&buf]() { return DecompressFrame(buf); });
+    }
     co_return buf;
   }
 
-  std::string recv() {
+  std::optional<std::string> read_frame() {
     char data[sizeof(uint32_t)];
-    net::read(*socket_, net::buffer(data));
+    read(net::buffer(data));
     auto length = integralParse<uint32_t>(data);
-    if (length >= max_package_size) {
-      throw PnrpcException("package is too large : " + std::to_string(length));
+    if ((length & control_frame_bit) != 0) {
+      char body[max_control_frame_size];
+      size_t body_len = check_control_frame_length(length);
+      read(net::buffer(body, body_len));
+      read_bytes_ = read_bytes_ + sizeof(uint32_t) + body_len;
+      handle_control_frame(body, body_len);
+      return std::optional<std::string>();
+    }
+    bool file_frame = (length & file_frame_bit) != 0;
+    bool compressed = (length & compressed_frame_bit) != 0;
+    length &= ~(file_frame_bit | compressed_frame_bit);
+    check_frame_length(length);
+    if (compressed == true && reject_compressed_ == true) {
+      throw PnrpcException("unexpected compressed frame");
     }
     std::string buf;
     buf.resize(length);
-    size_t sleep_s = read_limiting_.calcualte_sleep_time(read_bytes_);
-    if (sleep_s != 0) {
-      std::this_thread::sleep_for(std::chrono::seconds(sleep_s));
+    size_t offset = 0;
+    while (offset < length) {
+      size_t n = std::min(length - offset, chunk_size(read_limiting_, read_budgets_));
+      size_t header_len = offset == 0 ? sizeof(data) : 0;
+      std::this_thread::sleep_for(reserve(read_limiting_, read_budgets_, header_len + n));
+      read(net::buffer(&buf[offset], n));
+      offset += n;
     }
-    net::read(*socket_, net::buffer(buf));
     read_bytes_ = read_bytes_ + sizeof(uint32_t) + length;
+    on_frame_read(length, file_frame, buf);
+    if (compressed == true) {
+      if (buf.size() < compressed_frame_prefix) {
+        throw PnrpcException("invalid compressed frame length : " + std::to_string(buf.size()));
+      }
+      check_frame_length(CompressedFrameRawSize(buf));
+      buf = DecompressFrame(buf);
+    }
     return buf;
   }
 
- private:
-  net::ip::tcp::socket* socket_;
+  // 在分配数据帧的内存之前经过admit或者申请内存预算（替换上一个数据帧占用的预算），
+  // 压缩帧解压时与原始数据同时占用内存，因此两者都计入预算
+  net::awaitable<void> admit_frame(const Admission* admit, uint32_t pcode, size_t length, size_t compressed_length) {
+    if (admit != nullptr) {
+      co_await (*admit)(pcode, length, compressed_length);
+      co_return;
+    }
+    frame_reservation_.release();
+    if (memory_budget_ != nullptr) {
+      frame_reservation_ = co_await memory_budget_->Acquire(length + compressed_length);
+    }
+    co_return;
+  }
+
+  bool should_compress(const std::string& raw) const {
+    return compress_threshold_ != 0 && raw.size() >= compress_threshold_ && capture_ == nullptr && shm_ == nullptr;
+  }
+
+  void check_frame_length(size_t length) const {
+    if (length >= max_package_size || length > max_frame_size_) {
+      throw PnrpcException("package is too large : " + std::to_string(length));
+    }
+  }
+
+  // 数据帧在读取时计入接收窗口的消费量（按照其在连接上占用的字节数，与发送方的计算一致），文件帧被还原为普通的回复包
+  void on_frame_read(size_t length, bool file_frame, std::string& buf) {
+    if (flow_control_ != nullptr) {
+      flow_control_->on_consume(sizeof(uint32_t) + length);
+    }
+    if (file_frame == false) {
+      return;
+    }
+    if (buf.empty()) {
+      throw PnrpcException("invalid file frame");
+    }
+    bool eof = buf[0] != 0;
+    buf.erase(0, sizeof(uint8_t));
+    std::string package;
+    ResponsePackager<std::string> rp;
+    rp.seri_response_package(buf, package, RPC_OK, eof);
+    buf = std::move(package);
+  }
+
+  // sendfile在socket的发送缓冲区满时返回EAGAIN，此时等待socket可写
+  net::awaitable<void> coro_sendfile(int fd, uint64_t offset, size_t size) {
+    IoDeadline deadline(*this, write_timer_);
+    socket_->native_non_blocking(true);
+    auto off = static_cast<off_t>(offset);
+    while (size > 0) {
+      ssize_t n = ::sendfile(socket_->native_handle(), fd, &off, size);
+      if (n > 0) {
+        size -= static_cast<size_t>(n);
+        continue;
+      }
+      if (n == 0) {
+        throw PnrpcException("file is truncated while sending");
+      }
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        throw system_error(error_code(errno, net::error::get_system_category()), "sendfile");
+      }
+      co_await socket_->async_wait(Socket::wait_write, net::use_awaitable);
+    }
+    co_return;
+  }
+
+  // 读写连接：绑定了共享内存通道时读写环形缓冲区，否则读写socket
+  template <typename ConstBufferSequence>
+  net::awaitable<void> coro_write(const ConstBufferSequence& bufs) {
+    IoDeadline deadline(*this, write_timer_);
+    if (shm_ != nullptr) {
+      co_await shm_->async_write(*socket_, bufs);
+    } else {
+      co_await net::async_write(*socket_, bufs, net::use_awaitable);
+    }
+    co_return;
+  }
+
+  template <typename ConstBufferSequence>
+  void write(const ConstBufferSequence& bufs) {
+    if (shm_ != nullptr) {
+      shm_->write(*socket_, bufs);
+    } else {
+      net::write(*socket_, bufs);
+    }
+  }
+
+  net::awaitable<void> coro_read(net::mutable_buffer buf) {
+    IoDeadline deadline(*this, read_timer_);
+    if (shm_ != nullptr) {
+      co_await shm_->async_read(*socket_, buf);
+    } else {
+      co_await net::async_read(*socket_, buf, net::use_awaitable);
+    }
+    co_return;
+  }
+
+  void read(net::mutable_buffer buf) {
+    if (shm_ != nullptr) {
+      shm_->read(*socket_, buf);
+    } else {
+      net::read(*socket_, buf);
+    }
+  }
+
+  net::awaitable<void> coro_wait_readable() {
+    if (shm_ != nullptr) {
+      co_await shm_->async_wait_readable(*socket_);
+    } else {
+      co_await socket_->async_wait(Socket::wait_read, net::use_awaitable);
+    }
+    co_return;
+  }
+
+  // 在作用域内为一次读/写设置超时，见set_io_timeout。读写可能同时进行（例如监听cancel帧的同时写回复），因此各用一个定时器
+  class IoDeadline {
+   public:
+    IoDeadline(StreamBase& stream, std::unique_ptr<TimerWheel::Timer>& timer) : wheel_(stream.io_wheel_) {
+      if (wheel_ == nullptr) {
+        return;
+      }
+      if (timer == nullptr) {
+        timer = std::make_unique<TimerWheel::Timer>();
+      }
+      timer_ = timer.get();
+      int fd = stream.socket_->native_handle();
+      wheel_->Schedule(*timer_, stream.io_timeout_, [fd]() {
+        PNRPC_LOG_DEBUG("io timeout, close connection, fd = {}", fd);
+        ::shutdown(fd, SHUT_RDWR);
+      });
+    }
+
+    IoDeadline(const IoDeadline&) = delete;
+    IoDeadline& operator=(const IoDeadline&) = delete;
+
+    ~IoDeadline() {
+      if (wheel_ != nullptr) {
+        wheel_->Cancel(*timer_);
+      }
+    }
+
+   private:
+    TimerWheel* wheel_;
+    TimerWheel::Timer* timer_ = nullptr;
+  };
+
+  // 在作用域内标记本socket正在被读取/写入，离开作用域时（包括异常）清除标记并唤醒等待的协程
+  class ReadingGuard {
+   public:
+    explicit ReadingGuard(FlowControl* fc) : fc_(fc) {
+      if (fc_ != nullptr) {
+        fc_->set_reading(true);
+      }
+    }
+
+    ~ReadingGuard() {
+      if (fc_ != nullptr) {
+        fc_->set_reading(false);
+      }
+    }
+
+   private:
+    FlowControl* fc_;
+  };
+
+  class WritingGuard {
+   public:
+    explicit WritingGuard(FlowControl* fc) : fc_(fc) {}
+
+    ~WritingGuard() {
+      if (fc_ != nullptr) {
+        fc_->set_writing(false);
+      }
+    }
+
+   private:
+    FlowControl* fc_;
+  };
+
+  // 等待FlowControl的状态发生变化：被notify唤醒时正常返回，协程被取消时抛出异常
+  net::awaitable<void> coro_wait_flow_event() {
+    net::steady_timer timer(co_await net::this_coro::executor, net::steady_timer::time_point::max());
+    FlowControl::Waiter waiter{&timer, false};
+    flow_control_->add_waiter(&waiter);
+    error_code ec;
+    co_await timer.async_wait(net::redirect_error(net::use_awaitable, ec));
+    if (waiter.notified == false) {
+      flow_control_->remove_waiter(&waiter);
+      throw system_error(ec);
+    }
+    co_return;
+  }
+
+  // credit耗尽时等待对端的Credit控制帧。如果没有协程在读取socket（例如客户端流式rpc在发送完所有请求之前不会读取回复），
+  // 由发送方自己读取
+  net::awaitable<void> coro_wait_credit() {
+    while (!flow_control_->can_send()) {
+      if (flow_control_->is_reading()) {
+        co_await coro_wait_flow_event();
+        continue;
+      }
+      ReadingGuard guard(flow_control_);
+      auto frame = co_await coro_read_frame();
+      if (frame.has_value()) {
+        flow_control_->stash(std::move(frame).value());
+      }
+    }
+    co_return;
+  }
+
+  net::awaitable<void> coro_acquire_write() {
+    while (flow_control_->is_writing()) {
+      co_await coro_wait_flow_event();
+    }
+    flow_control_->set_writing(true);
+    co_return;
+  }
+
+  // 将累计的credit通过控制帧归还给对端，调用者需要持有写权限
+  net::awaitable<void> coro_write_pending_credit() {
+    while (flow_control_ != nullptr && flow_control_->has_pending_grant()) {
+      co_await coro_send_control(ControlType::Credit, flow_control_->take_pending_grant());
+    }
+    co_return;
+  }
+
+  net::awaitable<void> coro_flush_credit() {
+    if (flow_control_ == nullptr || !flow_control_->has_pending_grant()) {
+      co_return;
+    }
+    co_await coro_acquire_write();
+    WritingGuard guard(flow_control_);
+    co_await coro_write_pending_credit();
+    co_return;
+  }
+
+  void flush_credit() {
+    while (flow_control_ != nullptr && flow_control_->has_pending_grant()) {
+      send_control(ControlType::Credit, flow_control_->take_pending_grant());
+    }
+  }
+
+  static void seri_frame_length(const std::string& buf, char (&header)[sizeof(uint32_t)], uint32_t flags = 0) {
+    if (buf.size() >= max_package_size) {
+      throw PnrpcException("package is too large : " + std::to_string(buf.size()));
+    }
+    integralSeri<uint32_t>(flags | static_cast<uint32_t>(buf.size()), header);
+  }
+
+  // 返回true表示数据帧已经被捕获，不需要再写入socket
+  bool capture(const char (&header)[sizeof(uint32_t)], const std::string& buf) {
+    if (capture_ == nullptr) {
+      return false;
+    }
+    capture_->append(header, sizeof(header));
+    capture_->append(buf);
+    if (write_through_ == true) {
+      return false;
+    }
+    write_bytes_ += sizeof(header) + buf.size();
+    return true;
+  }
+
+  using Budgets = std::vector<std::shared_ptr<BandwidthBudget>>;
+
+  static size_t chunk_size(const CurrentLimiting& limiting, const Budgets& budgets) {
+    size_t chunk = limiting.chunk_size();
+    for (const auto& each : budgets) {
+      chunk = std::min(chunk, each->chunk_size());
+    }
+    return chunk;
+  }
+
+  static std::chrono::microseconds reserve(CurrentLimiting& limiting, const Budgets& budgets, size_t bytes) {
+    auto wait = limiting.reserve(bytes);
+    for (const auto& each : budgets) {
+      wait = std::max(wait, each->reserve(bytes));
+    }
+    return wait;
+  }
+
+  static net::awaitable<void> coro_wait(std::chrono::microseconds duration) {
+    if (duration.count() > 0) {
+      net::steady_timer timer(co_await net::this_coro::executor, duration);
+      co_await timer.async_wait(net::use_awaitable);
+    }
+    co_return;
+  }
+
+  // 控制帧的格式为 长度(4字节，最高位为1) + 类型(1字节) + 参数(Credit帧为4字节的credit)
+  static void seri_control_frame(ControlType type, uint32_t value, std::string& appender) {
+    bool has_value = type == ControlType::Credit;
+    uint32_t body_len = sizeof(uint8_t) + (has_value ? sizeof(uint32_t) : 0);
+    integralSeri<uint32_t>(control_frame_bit | body_len, appender);
+    integralSeri<uint8_t>(static_cast<uint8_t>(type), appender);
+    if (has_value) {
+      integralSeri<uint32_t>(value, appender);
+    }
+  }
+
+  static size_t check_control_frame_length(uint32_t length) {
+    size_t body_len = length & ~control_frame_bit;
+    if (body_len == 0 || body_len > max_control_frame_size) {
+      throw PnrpcException("invalid control frame length : " + std::to_string(body_len));
+    }
+    return body_len;
+  }
+
+  // 读到cancel帧说明对端放弃了本次调用，以operation_aborted错误结束当前的读操作；
+  // 读到credit帧则增加本端的可发送字节数，没有绑定流控的stream忽略credit帧
+  void handle_control_frame(const char* body, size_t len) {
+    auto type = static_cast<ControlType>(integralParse<uint8_t>(body, len));
+    switch (type) {
+      case ControlType::Cancel:
+        throw system_error(net::error::operation_aborted, "rpc cancelled by peer");
+      case ControlType::Credit:
+        if (flow_control_ != nullptr) {
+          flow_control_->on_credit(integralParse<uint32_t>(body + sizeof(uint8_t), len - sizeof(uint8_t)));
+        }
+        break;
+      default:
+        PNRPC_LOG_WARN("unknown control frame type : {}", static_cast<uint32_t>(type));
+    }
+  }
+
+  Socket* socket_;
+  ShmChannel* shm_;
   size_t write_bytes_;
   size_t read_bytes_;
   CurrentLimiting read_limiting_;
   CurrentLimiting write_limiting_;
+  Budgets read_budgets_;
+  Budgets write_budgets_;
+  FlowControl* flow_control_;
+  std::string* capture_;
+  bool write_through_;
+  size_t max_frame_size_;
+  std::shared_ptr<MemoryBudget> memory_budget_;
+  MemoryBudget::Reservation frame_reservation_;
+  size_t compress_threshold_;
+  bool reject_compressed_;
+  bool partial_read_;
+  TimerWheel* io_wheel_;
+  std::chrono::milliseconds io_timeout_;
+  // 只在开启了io超时时分配
+  std::unique_ptr<TimerWheel::Timer> read_timer_;
+  std::unique_ptr<TimerWheel::Timer> write_timer_;
 };
 
 template <typename RpcType>
 requires RpcTypeConcept<RpcType> || std::is_void<RpcType>::value class ClientToServerStream : public StreamBase {
  public:
-  explicit ClientToServerStream(uint32_t pcode) : StreamBase(), pcode_(pcode), read_eof_(false), send_eof_(false) {}
+  explicit ClientToServerStream(uint32_t pcode)
+      : StreamBase(), pcode_(pcode), read_eof_(false), send_eof_(false), timeout_ms_(0), accept_compressed_(false) {}
+
+  // 在下一个发送的请求包中携带超时时间（单位毫秒），用于服务端感知客户端的deadline
+  void set_timeout(uint32_t timeout_ms) { timeout_ms_ = timeout_ms; }
+
+  // 在请求包中告知服务端本端可以解压回复
+  void set_accept_compressed(bool accept) { accept_compressed_ = accept; }
 
   net::awaitable<void> Send(const RpcType& package, bool eof) {
     if (send_eof_ == true) {
@@ -130,7 +860,7 @@ requires RpcTypeConcept<RpcType> || std::is_void<RpcType>::value class ClientToS
     send_eof_ = eof;
     std::string buf;
     RequestPackager<RpcType> rp;
-    rp.seri_request_package(package, buf, pcode_, eof);
+    rp.seri_request_package(package, buf, make_header(eof));
     co_await coro_send(buf);
     co_return;
   }
@@ -143,62 +873,196 @@ requires RpcTypeConcept<RpcType> || std::is_void<RpcType>::value class ClientToS
     send_eof_ = eof;
     std::string buf;
     RequestPackager<RpcType> rp;
-    rp.seri_request_package(package, buf, pcode_, eof);
+    rp.seri_request_package(package, buf, make_header(eof));
     send(buf);
   }
 
-  net::awaitable<std::optional<RpcType>> Read() {
-    if (read_eof_ == true) {
-      co_return std::optional<RpcType>();
+  // 单向请求：每个请求包都是一次独立的调用，服务端不会授予credit，因此不经过流控，同一个stream可以连续发送
+  net::awaitable<void> SendOneWay(const RpcType& package) {
+    co_await coro_send_direct(seri_one_way(package));
+    co_return;
+  }
+
+  void SendOneWaySync(const RpcType& package) { send_direct(seri_one_way(package)); }
+
+  // 将多个元素打包在一个请求包中发送，eof作用于最后一个元素
+  net::awaitable<void> SendMany(std::span<const RpcType> packages, bool eof) {
+    if (send_eof_ == true) {
+      PNRPC_LOG_WARN("ClientToServerStream send package after send_eof");
+      co_return;
     }
-    std::string buf = co_await coro_recv();
+    send_eof_ = eof;
+    std::string buf;
     RequestPackager<RpcType> rp;
-    uint32_t pc;
-    auto pkg = rp.parse_request_package(buf, pc, read_eof_);
-    assert(pc == pcode_);
-    co_return pkg;
+    rp.seri_request_packages(packages, buf, make_header(eof));
+    co_await coro_send(buf);
+    co_return;
   }
 
-  std::optional<RpcType> ReadSync() {
-    if (read_eof_ == true) {
-      return std::optional<RpcType>();
+  void SendManySync(std::span<const RpcType> packages, bool eof) {
+    if (send_eof_ == true) {
+      PNRPC_LOG_WARN("ClientToServerStream send package after send_eof");
+      return;
     }
-    std::string buf = recv();
+    send_eof_ = eof;
+    std::string buf;
     RequestPackager<RpcType> rp;
-    uint32_t pc;
-    auto pkg = rp.parse_request_package(buf, pc, read_eof_);
-    assert(pc == pcode_);
-    return pkg;
+    rp.seri_request_packages(packages, buf, make_header(eof));
+    send(buf);
+  }
+
+  net::awaitable<std::optional<RpcType>> Read() {
+    while (pending_.empty() && read_eof_ == false) {
+      std::string buf = co_await coro_recv();
+      on_package(buf);
+    }
+    co_return take_pending();
+  }
+
+  std::optional<RpcType> ReadSync() {
+    while (pending_.empty() && read_eof_ == false) {
+      std::string buf = recv();
+      on_package(buf);
+    }
+    return take_pending();
+  }
+
+  // 读取至少一个、至多n个元素，只有在没有已经解析出来的元素时才会读取socket，返回空表示读取完毕
+  net::awaitable<std::vector<RpcType>> ReadMany(size_t n) {
+    std::vector<RpcType> packages;
+    auto first = co_await Read();
+    if (first.has_value()) {
+      packages.push_back(std::move(first).value());
+      TakePending(n - 1, packages);
+    }
+    co_return packages;
+  }
+
+  std::vector<RpcType> ReadManySync(size_t n) {
+    std::vector<RpcType> packages;
+    auto first = ReadSync();
+    if (first.has_value()) {
+      packages.push_back(std::move(first).value());
+      TakePending(n - 1, packages);
+    }
+    return packages;
+  }
+
+  // 不读取socket，从已经解析出来的元素中取出至多n个
+  void TakePending(size_t n, std::vector<RpcType>& packages) {
+    while (n > 0 && !pending_.empty()) {
+      packages.push_back(std::move(pending_.front()));
+      pending_.pop_front();
+      n -= 1;
+    }
+  }
+
+  // 服务端的第一个请求包由RpcServer读取，其中除第一个元素之外的部分交给本stream
+  void PushPending(std::vector<RpcType>&& packages, bool eof) {
+    for (auto& each : packages) {
+      pending_.push_back(std::move(each));
+    }
+    read_eof_ = eof;
+  }
+
+  // 通知服务端放弃本次rpc调用
+  net::awaitable<void> Cancel() {
+    send_eof_ = true;
+    co_await coro_send_control(ControlType::Cancel);
+    co_return;
+  }
+
+  void CancelSync() {
+    send_eof_ = true;
+    send_control(ControlType::Cancel);
   }
 
   uint32_t get_pcode() const { return pcode_; }
 
-  bool get_eof() const { return read_eof_; }
+  bool get_eof() const { return read_eof_ && pending_.empty(); }
+
+  // 复用连接发起新的调用之前重置上一次调用的状态
+  void reset() {
+    read_eof_ = false;
+    send_eof_ = false;
+    timeout_ms_ = 0;
+    pending_.clear();
+  }
 
  private:
+  RequestHeader make_header(bool eof) {
+    RequestHeader header;
+    header.pcode = pcode_;
+    header.eof = eof;
+    header.timeout_ms = timeout_ms_;
+    header.accept_compressed = accept_compressed_;
+    // 超时时间只需要在第一个请求包中携带
+    timeout_ms_ = 0;
+    return header;
+  }
+
+  std::string seri_one_way(const RpcType& package) {
+    RequestHeader header = make_header(true);
+    header.one_way = true;
+    std::string buf;
+    RequestPackager<RpcType> rp;
+    rp.seri_request_package(package, buf, header);
+    return buf;
+  }
+
+  void on_package(const std::string& buf) {
+    RequestPackager<RpcType> rp;
+    RequestHeader header;
+    PushPending(rp.parse_request_packages(buf, header), header.eof);
+    assert(header.pcode == pcode_);
+  }
+
+  std::optional<RpcType> take_pending() {
+    if (pending_.empty()) {
+      return std::optional<RpcType>();
+    }
+    std::optional<RpcType> pkg(std::move(pending_.front()));
+    pending_.pop_front();
+    return pkg;
+  }
+
   uint32_t pcode_;
   bool read_eof_;
   bool send_eof_;
+  uint32_t timeout_ms_;
+  bool accept_compressed_;
+  // 已经解析出来但是还没有被读取的元素
+  std::deque<RpcType> pending_;
 };
 
 template <>
 class ClientToServerStream<void> : public StreamBase {
  public:
-  explicit ClientToServerStream() : StreamBase(), pcode_(0), eof_(false) {}
+  explicit ClientToServerStream() : StreamBase(), header_() {}
 
   net::awaitable<std::string_view> Read(std::string& buf) {
     buf = co_await coro_recv();
     RequestPackager<void> rp;
-    co_return rp.parse_request_package(buf, pcode_, eof_);
+    co_return rp.parse_request_package(buf, header_);
   }
 
-  uint32_t get_pcode() const { return pcode_; }
+  // 读取到请求包的pcode和长度之后先经过admit（例如检查该rpc的请求大小限制、申请内存预算），再为请求包分配内存
+  net::awaitable<std::string_view> Read(std::string& buf, const Admission& admit) {
+    buf = co_await coro_recv(admit);
+    RequestPackager<void> rp;
+    co_return rp.parse_request_package(buf, header_);
+  }
+
+  const RequestHeader& get_header() const { return header_; }
+
+  uint32_t get_pcode() const { return header_.pcode; }
 
-  bool get_eof() const { return eof_; }
+  bool get_eof() const { return header_.eof; }
+
+  uint32_t get_timeout_ms() const { return header_.timeout_ms; }
 
  private:
-  uint32_t pcode_;
-  bool eof_;
+  RequestHeader header_;
 };
 
 template <typename RpcType>
@@ -207,6 +1071,13 @@ class ServerToClientStream : public StreamBase {
  public:
   explicit ServerToClientStream() : StreamBase(), read_eof_(false), send_eof_(false) {}
 
+  // 复用连接发起新的调用之前重置上一次调用的状态
+  void reset() {
+    read_eof_ = false;
+    send_eof_ = false;
+    pending_.clear();
+  }
+
   net::awaitable<void> Send(const RpcType& package, uint32_t ret_code, bool eof) {
     if (send_eof_ == true) {
       PNRPC_LOG_WARN("ServerToClientStream send package after send_eof");
@@ -232,36 +1103,137 @@ class ServerToClientStream : public StreamBase {
     send(buf);
   }
 
+  // 将多个元素打包在一个回复包中发送，eof作用于最后一个元素
+  net::awaitable<void> SendMany(std::span<const RpcType> packages, uint32_t ret_code, bool eof) {
+    if (send_eof_ == true) {
+      PNRPC_LOG_WARN("ServerToClientStream send package after send_eof");
+      co_return;
+    }
+    send_eof_ = eof;
+    std::string buf;
+    ResponsePackager<RpcType> rp;
+    rp.seri_response_packages(packages, buf, ret_code, eof);
+    co_await coro_send(buf);
+    co_return;
+  }
+
+  // 发送已经序列化好的回复包，eof需要与回复包中的eof一致
+  net::awaitable<void> SendSerialized(const std::string& package, bool eof) {
+    if (send_eof_ == true) {
+      PNRPC_LOG_WARN("ServerToClientStream send package after send_eof");
+      co_return;
+    }
+    send_eof_ = eof;
+    co_await coro_send(package);
+    co_return;
+  }
+
+  // 发送文件区间，按照file_frame_size分成多个回复包，eof作用于最后一个包
+  net::awaitable<void> SendFile(const FileRegion& region, bool eof) requires std::is_same_v<RpcType, std::string> {
+    if (send_eof_ == true) {
+      PNRPC_LOG_WARN("ServerToClientStream send package after send_eof");
+      co_return;
+    }
+    send_eof_ = eof;
+    uint64_t offset = region.offset();
+    uint64_t remaining = region.size();
+    do {
+      auto n = static_cast<size_t>(std::min<uint64_t>(remaining, file_frame_size));
+      remaining -= n;
+      co_await coro_send_file(region, offset, n, eof == true && remaining == 0);
+      offset += n;
+    } while (remaining > 0);
+    co_return;
+  }
+
+  // 出错时返回一个默认构造的回复，读取完毕时返回空
   net::awaitable<std::optional<RpcType>> Read(uint32_t& ret_code, std::string& err_msg) {
-    if (read_eof_ == true) {
-      co_return std::optional<RpcType>();
+    ret_code = RPC_OK;
+    while (pending_.empty() && read_eof_ == false) {
+      std::string buf = co_await coro_recv();
+      if (on_package(buf, ret_code, err_msg) == false) {
+        co_return std::optional<RpcType>(RpcType());
+      }
+    }
+    co_return take_pending();
+  }
+
+  std::optional<RpcType> ReadSync(uint32_t& ret_code, std::string& err_msg) {
+    ret_code = RPC_OK;
+    while (pending_.empty() && read_eof_ == false) {
+      std::string buf = recv();
+      if (on_package(buf, ret_code, err_msg) == false) {
+        return std::optional<RpcType>(RpcType());
+      }
     }
-    std::string buf = co_await coro_recv();
+    return take_pending();
+  }
+
+  // 读取至少一个、至多n个元素，只有在没有已经解析出来的元素时才会读取socket，出错或者读取完毕时返回空
+  net::awaitable<std::vector<RpcType>> ReadMany(size_t n, uint32_t& ret_code, std::string& err_msg) {
+    std::vector<RpcType> packages;
+    auto first = co_await Read(ret_code, err_msg);
+    if (ret_code == RPC_OK && first.has_value()) {
+      packages.push_back(std::move(first).value());
+      take_pending(n - 1, packages);
+    }
+    co_return packages;
+  }
+
+  std::vector<RpcType> ReadManySync(size_t n, uint32_t& ret_code, std::string& err_msg) {
+    std::vector<RpcType> packages;
+    auto first = ReadSync(ret_code, err_msg);
+    if (ret_code == RPC_OK && first.has_value()) {
+      packages.push_back(std::move(first).value());
+      take_pending(n - 1, packages);
+    }
+    return packages;
+  }
+
+ private:
+  // 解析回复包并将其中的元素加入pending_，回复包中是错误信息时返回false
+  bool on_package(const std::string& buf, uint32_t& ret_code, std::string& err_msg) {
     ResponsePackager<RpcType> rp;
     auto pkg = rp.parse_response_package(buf);
     ret_code = pkg.ret_code;
     err_msg = pkg.err_msg;
+    if (pkg.ret_code != RPC_OK) {
+      read_eof_ = true;
+      return false;
+    }
     read_eof_ = pkg.eof;
-    co_return std::move(pkg.response);
+    if (pkg.elements.has_value()) {
+      for (auto& each : pkg.elements.value()) {
+        pending_.push_back(std::move(each));
+      }
+    } else {
+      pending_.push_back(std::move(pkg.response));
+    }
+    return true;
   }
 
-  std::optional<RpcType> ReadSync(uint32_t ret_code, std::string& err_msg) {
-    if (read_eof_ == true) {
+  std::optional<RpcType> take_pending() {
+    if (pending_.empty()) {
       return std::optional<RpcType>();
     }
-    std::string buf = recv();
-    ResponsePackager<RpcType> rp;
-    auto pkg = rp.parse_response_package(buf);
-    ret_code = pkg.ret_code;
-    err_msg = pkg.err_msg;
-    read_eof_ = pkg.eof;
-    return std::move(pkg.response);
+    std::optional<RpcType> pkg(std::move(pending_.front()));
+    pending_.pop_front();
+    return pkg;
   }
 
- private:
-  net::ip::tcp::socket* socket_;
+  void take_pending(size_t n, std::vector<RpcType>& packages) {
+    while (n > 0 && !pending_.empty()) {
+      packages.push_back(std::move(pending_.front()));
+      pending_.pop_front();
+      n -= 1;
+    }
+  }
+
+  Socket* socket_;
   bool read_eof_;
   bool send_eof_;
+  // 已经解析出来但是还没有被读取的元素
+  std::deque<RpcType> pending_;
 };
 
 class ErrorStream : public StreamBase {
@@ -276,4 +1248,23 @@ class ErrorStream : public StreamBase {
     co_return;
   }
 };
+
+// 收发已经序列化好的数据帧，例如批量请求与回复（见RpcServer::HandleBatch）以及缓存的回复
+class RawStream : public StreamBase {
+ public:
+  explicit RawStream() : StreamBase() {}
+
+  net::awaitable<void> Send(const std::string& payload) {
+    co_await coro_send(payload);
+    co_return;
+  }
+
+  // frames由一个或多个 长度(4字节) + 数据帧 组成
+  net::awaitable<void> SendFrames(const std::string& frames) {
+    co_await coro_send_raw(frames);
+    co_return;
+  }
+
+  net::awaitable<std::string> Read() { co_return co_await coro_recv(); }
+};
 }  // namespace pnrpc
\ No newline at end of file
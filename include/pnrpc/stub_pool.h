@@ -0,0 +1,81 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "pnrpc/asio_version.h"
+#include "pnrpc/endpoint.h"
+
+namespace pnrpc {
+
+// 可以依次发起多次调用的stub（Simple类型），空闲时可以通过is_reusable检查连接是否仍然可用
+template <typename Stub>
+concept ReusableStub = requires(Stub& stub) {
+  requires Stub::reusable;
+  { stub.is_reusable() } -> std::convertible_to<bool>;
+  stub.clear_deadline();
+};
+
+/*
+ * 按照后端缓存已经建立连接的stub，避免每次调用都重新建立连接：
+ *  acquire优先取出该后端空闲的stub，连接已经被对端关闭的stub被丢弃，没有可用的stub时建立新的连接（失败时抛出system_error）；
+ *  调用成功（连接上没有残留的数据）之后通过release归还，每个后端最多缓存max_idle个空闲的stub，多余的stub连同连接被关闭；
+ *  调用失败、被取消以及不能复用的stub（流式rpc）不归还，析构时关闭连接。
+ * 一个stub同时只被一个调用使用，同一个后端上并发的调用会各自建立连接。不是线程安全的，需要在同一个io_context的线程中使用。
+ */
+template <typename Stub>
+class StubPool {
+ public:
+  using Handle = std::unique_ptr<Stub>;
+
+  explicit StubPool(net::io_context& io, size_t max_idle = 8) : io_(io), max_idle_(max_idle) {}
+
+  StubPool(const StubPool&) = delete;
+  StubPool& operator=(const StubPool&) = delete;
+
+  net::awaitable<Handle> acquire(const Endpoint& ep) {
+    if constexpr (ReusableStub<Stub>) {
+      auto it = idle_.find(ep.to_string());
+      while (it != idle_.end() && !it->second.empty()) {
+        Handle stub = std::move(it->second.back());
+        it->second.pop_back();
+        if (stub->is_reusable()) {
+          co_return stub;
+        }
+      }
+    }
+    auto stub = std::make_unique<Stub>(io_, ep.ip, ep.port);
+    co_await stub->async_connect();
+    co_return stub;
+  }
+
+  void release(const Endpoint& ep, Handle stub) {
+    if constexpr (ReusableStub<Stub>) {
+      auto& idle = idle_[ep.to_string()];
+      if (idle.size() < max_idle_) {
+        stub->clear_deadline();
+        idle.push_back(std::move(stub));
+      }
+    }
+  }
+
+  // 后端被移除时关闭其空闲的连接
+  void remove(const Endpoint& ep) { idle_.erase(ep.to_string()); }
+
+  size_t idle_count(const Endpoint& ep) const {
+    auto it = idle_.find(ep.to_string());
+    return it == idle_.end() ? 0 : it->second.size();
+  }
+
+ private:
+  net::io_context& io_;
+  size_t max_idle_;
+  std::unordered_map<std::string, std::vector<Handle>> idle_;
+};
+
+}  // namespace pnrpc
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "pnrpc/asio_version.h"
+#include "pnrpc/util.h"
+
+namespace pnrpc {
+
+// 时间轮的精度
+constexpr std::chrono::milliseconds timer_wheel_tick(10);
+
+/*
+ * 分层时间轮，每个io_context一个（asio service，见TimerWheel::Of），用于空闲连接的回收以及rpc的deadline：
+ *  第0层256个槽，每个槽一个tick；第1~3层各64个槽，每个槽覆盖下一层的一整圈，超出范围的定时器放在最高层并在到期时重新放入；
+ *  定时器通过侵入式双向链表挂在槽上，插入、取消、重新设置都是O(1)的；
+ *  整个时间轮只使用一个steady_timer驱动，有定时器时每个tick唤醒一次，不会向asio的定时器堆中为每个定时器插入一项。
+ * 所有接口以及回调都在io_context的线程中执行，不是线程安全的。
+ */
+class TimerWheel : public net::execution_context::service {
+  struct Node {
+    Node* prev = nullptr;
+    Node* next = nullptr;
+  };
+
+ public:
+  using key_type = TimerWheel;
+  static inline net::execution_context::id id;
+
+  // 定时器由使用者持有，析构时自动取消
+  class Timer : private Node {
+    friend class TimerWheel;
+
+   public:
+    Timer() : wheel_(nullptr), expire_tick_(0) {}
+
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    ~Timer() {
+      if (wheel_ != nullptr) {
+        wheel_->Cancel(*this);
+      }
+    }
+
+    bool pending() const { return wheel_ != nullptr; }
+
+   private:
+    TimerWheel* wheel_;
+    uint64_t expire_tick_;
+    std::function<void()> callback_;
+  };
+
+  explicit TimerWheel(net::io_context& io)
+      : net::execution_context::service(io),
+        driver_(io),
+        start_(std::chrono::steady_clock::now()),
+        current_(0),
+        count_(0),
+        running_(false) {
+    init_slot(root_);
+    for (auto& level : levels_) {
+      init_slot(level);
+    }
+  }
+
+  static TimerWheel& Of(net::io_context& io) { return net::use_service<TimerWheel>(io); }
+
+  // 在deadline（向上取整到tick）时执行callback，timer已经设置时重新设置
+  void Schedule(Timer& timer, Deadline deadline, std::function<void()> callback) {
+    if (timer.pending()) {
+      unlink(&timer);
+    } else {
+      if (count_ == 0) {
+        // 没有定时器时时间轮不转动，首先追上当前时间
+        current_ = std::max(current_, tick_of(std::chrono::steady_clock::now()));
+      }
+      timer.wheel_ = this;
+      count_ += 1;
+    }
+    auto since_start = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - start_).count();
+    auto tick = std::chrono::duration_cast<std::chrono::nanoseconds>(timer_wheel_tick).count();
+    timer.expire_tick_ = since_start <= 0 ? 0 : static_cast<uint64_t>((since_start + tick - 1) / tick);
+    timer.callback_ = std::move(callback);
+    add(timer);
+    arm();
+  }
+
+  void Schedule(Timer& timer, std::chrono::milliseconds delay, std::function<void()> callback) {
+    Schedule(timer, std::chrono::steady_clock::now() + delay, std::move(callback));
+  }
+
+  void Cancel(Timer& timer) {
+    if (!timer.pending()) {
+      return;
+    }
+    unlink(&timer);
+    timer.wheel_ = nullptr;
+    timer.callback_ = nullptr;
+    count_ -= 1;
+  }
+
+  // 协程等待到deadline，等待被取消（例如awaitable operators中另一个分支先完成）时抛出operation_aborted
+  net::awaitable<void> Wait(Deadline deadline) {
+    Timer timer;
+    auto initiate = [this, &timer, deadline]<typename Handler>(Handler&& handler) {
+      auto shared_handler = std::make_shared<std::decay_t<Handler>>(std::forward<Handler>(handler));
+      auto slot = net::get_associated_cancellation_slot(*shared_handler);
+      auto complete = [shared_handler](error_code ec) {
+        auto ex = net::get_associated_executor(*shared_handler);
+        net::post(ex, [shared_handler, ec]() mutable { (*shared_handler)(ec); });
+      };
+      if (slot.is_connected()) {
+        slot.assign([this, &timer, complete](auto) {
+          if (timer.pending()) {
+            Cancel(timer);
+            complete(net::error::operation_aborted);
+          }
+        });
+      }
+      Schedule(timer, deadline, [slot, complete]() mutable {
+        slot.clear();
+        complete(error_code());
+      });
+    };
+    auto token = net::use_awaitable_t<>();
+    co_await net::async_initiate<net::use_awaitable_t<>, void(error_code)>(std::move(initiate), token);
+    co_return;
+  }
+
+  size_t size() const { return count_; }
+
+ private:
+  static constexpr int root_bits = 8;
+  static constexpr int level_bits = 6;
+  static constexpr uint64_t root_size = uint64_t(1) << root_bits;
+  static constexpr uint64_t level_size = uint64_t(1) << level_bits;
+  static constexpr uint64_t max_span = uint64_t(1) << (root_bits + 3 * level_bits);
+
+  template <size_t N>
+  static void init_slot(std::array<Node, N>& slots) {
+    for (auto& each : slots) {
+      each.prev = &each;
+      each.next = &each;
+    }
+  }
+
+  static void unlink(Node* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = nullptr;
+    node->next = nullptr;
+  }
+
+  static void push_back(Node& slot, Node* node) {
+    node->prev = slot.prev;
+    node->next = &slot;
+    slot.prev->next = node;
+    slot.prev = node;
+  }
+
+  // 将slot中的节点全部转移到list中
+  static void splice(Node& slot, Node& list) {
+    list.prev = &list;
+    list.next = &list;
+    if (slot.next == &slot) {
+      return;
+    }
+    list.next = slot.next;
+    list.prev = slot.prev;
+    list.next->prev = &list;
+    list.prev->next = &list;
+    slot.prev = &slot;
+    slot.next = &slot;
+  }
+
+  uint64_t tick_of(std::chrono::steady_clock::time_point tp) const {
+    if (tp <= start_) {
+      return 0;
+    }
+    return static_cast<uint64_t>((tp - start_) / timer_wheel_tick);
+  }
+
+  // 按照到期时间距离当前tick的远近选择所在的层，超出范围的定时器放在最高层的最远处
+  void add(Timer& timer) {
+    uint64_t expire = std::max(timer.expire_tick_, current_);
+    uint64_t span = expire - current_;
+    if (span >= max_span) {
+      expire = current_ + max_span - 1;
+      span = max_span - 1;
+    }
+    Node* node = &timer;
+    if (span < root_size) {
+      push_back(root_[expire & (root_size - 1)], node);
+      return;
+    }
+    for (int i = 0; i < 3; ++i) {
+      if (span < (uint64_t(1) << (root_bits + (i + 1) * level_bits)) || i == 2) {
+        push_back(levels_[i][(expire >> (root_bits + i * level_bits)) & (level_size - 1)], node);
+        return;
+      }
+    }
+  }
+
+  // 将上一层的一个槽中的定时器重新放入下一层，返回槽的下标，为0时说明上一层也转过了一圈
+  uint64_t cascade(int level) {
+    uint64_t index = (current_ >> (root_bits + level * level_bits)) & (level_size - 1);
+    Node list;
+    splice(levels_[level][index], list);
+    while (list.next != &list) {
+      Node* node = list.next;
+      unlink(node);
+      add(*static_cast<Timer*>(node));
+    }
+    return index;
+  }
+
+  void run_tick() {
+    uint64_t index = current_ & (root_size - 1);
+    if (index == 0 && cascade(0) == 0 && cascade(1) == 0) {
+      cascade(2);
+    }
+    Node list;
+    splice(root_[index], list);
+    // 先推进current_，回调中设置的已经到期的定时器在下一个tick执行，而不是被放入已经取出的槽中
+    uint64_t tick = current_;
+    current_ += 1;
+    while (list.next != &list) {
+      auto* timer = static_cast<Timer*>(list.next);
+      unlink(timer);
+      if (timer->expire_tick_ > tick) {
+        // 超出范围而被放在最高层的定时器
+        add(*timer);
+        continue;
+      }
+      timer->wheel_ = nullptr;
+      count_ -= 1;
+      // 回调可能重新设置或者析构timer
+      auto callback = std::move(timer->callback_);
+      timer->callback_ = nullptr;
+      callback();
+    }
+  }
+
+  void arm() {
+    if (running_ == true || count_ == 0) {
+      return;
+    }
+    running_ = true;
+    driver_.expires_at(start_ + timer_wheel_tick * current_);
+    driver_.async_wait([this](error_code ec) {
+      running_ = false;
+      if (ec) {
+        return;
+      }
+      uint64_t target = tick_of(std::chrono::steady_clock::now());
+      while (current_ <= target && count_ != 0) {
+        run_tick();
+      }
+      if (count_ == 0) {
+        current_ = std::max(current_, target + 1);
+      }
+      arm();
+    });
+  }
+
+  // io_context析构时丢弃所有未到期的定时器，首先将它们标记为未设置，因为销毁回调可能会析构timer本身
+  void shutdown() override {
+    std::vector<std::function<void()>> callbacks;
+    auto drain = [&callbacks](Node& slot) {
+      while (slot.next != &slot) {
+        auto* timer = static_cast<Timer*>(slot.next);
+        unlink(timer);
+        timer->wheel_ = nullptr;
+        callbacks.push_back(std::move(timer->callback_));
+      }
+    };
+    for (auto& slot : root_) {
+      drain(slot);
+    }
+    for (auto& level : levels_) {
+      for (auto& slot : level) {
+        drain(slot);
+      }
+    }
+    count_ = 0;
+    callbacks.clear();
+  }
+
+  net::steady_timer driver_;
+  std::chrono::steady_clock::time_point start_;
+  // 下一个需要处理的tick
+  uint64_t current_;
+  size_t count_;
+  bool running_;
+  std::array<Node, root_size> root_;
+  std::array<std::array<Node, level_size>, 3> levels_;
+};
+
+}  // namespace pnrpc
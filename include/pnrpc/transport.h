@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "pnrpc/asio_version.h"
+#include "pnrpc/resolver_cache.h"
+
+namespace pnrpc {
+
+// 所有连接都使用generic stream socket，因此stream、server以及stub可以同时用于TCP和unix domain socket
+using Socket = net::generic::stream_protocol::socket;
+
+// 以"unix:"开头的地址表示unix domain socket，其后为socket文件的路径，此时端口被忽略
+constexpr std::string_view unix_address_prefix = "unix:";
+
+inline bool is_unix_address(std::string_view ip) { return ip.starts_with(unix_address_prefix); }
+
+inline std::string unix_path(std::string_view ip) { return std::string(ip.substr(unix_address_prefix.size())); }
+
+// 以"shm:"开头的地址表示共享内存通道，其后为握手使用的unix domain socket文件的路径，见ShmChannel
+constexpr std::string_view shm_address_prefix = "shm:";
+
+inline bool is_shm_address(std::string_view ip) { return ip.starts_with(shm_address_prefix); }
+
+inline std::string shm_path(std::string_view ip) { return std::string(ip.substr(shm_address_prefix.size())); }
+
+// 地址为"inproc:"时stub直接调用本进程中注册的rpc，不建立连接，见RpcServer::CallLocal
+constexpr std::string_view inproc_address = "inproc:";
+
+inline bool is_inproc_address(std::string_view ip) { return ip == inproc_address; }
+
+// TCP地址的解析经过ResolverCache，数字形式的ip不需要解析，域名的解析结果会被缓存
+inline net::awaitable<Socket::endpoint_type> async_connect_to(Socket& socket, const std::string& ip, uint16_t port) {
+  if (is_unix_address(ip) || is_shm_address(ip)) {
+    auto path = is_unix_address(ip) ? unix_path(ip) : shm_path(ip);
+    Socket::endpoint_type ep{net::local::stream_protocol::endpoint(path)};
+    co_await socket.async_connect(ep, net::use_awaitable);
+    co_return ep;
+  }
+  auto eps = co_await ResolverCache::Instance().async_resolve(ip, port);
+  co_return co_await net::async_connect(socket, eps, net::use_awaitable);
+}
+
+inline Socket::endpoint_type connect_to(Socket& socket, const std::string& ip, uint16_t port) {
+  if (is_unix_address(ip) || is_shm_address(ip)) {
+    auto path = is_unix_address(ip) ? unix_path(ip) : shm_path(ip);
+    Socket::endpoint_type ep{net::local::stream_protocol::endpoint(path)};
+    socket.connect(ep);
+    return ep;
+  }
+  auto eps = ResolverCache::Instance().resolve(ip, port);
+  return net::connect(socket, eps);
+}
+
+}  // namespace pnrpc
@@ -1,9 +1,12 @@
 #pragma once
 
 #include <chrono>
+#include <cstdint>
 #include <cstring>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "pnrpc/exception.h"
 
@@ -14,11 +17,32 @@ enum class RpcType : uint8_t {
   ServerSideStream,
   ClientSideStream,
   BidirectStream,
+  // 单向rpc：客户端发送请求之后立即返回，服务端不回复任何数据
+  OneWay,
 };
 
 // 16MB
 constexpr size_t max_package_size = 16 * 1024 * 1024;
 
+// 长度字段的最高位为1表示控制帧，控制帧不携带rpc的请求/回复数据，由stream层直接处理。
+// 数据帧的长度不会超过max_package_size，因此最高位总是0。
+constexpr uint32_t control_frame_bit = 0x80000000;
+
+// 长度字段的次高位为1表示文件帧，内容为 eof(1字节) + 文件数据，接收方将其还原为普通的回复包，见FileRegion
+constexpr uint32_t file_frame_bit = 0x40000000;
+
+// 长度字段的第三高位为1表示压缩帧，内容为 原始长度(4字节) + lz4 block，接收方将其解压为原始的数据帧，见compression.h
+constexpr uint32_t compressed_frame_bit = 0x20000000;
+
+constexpr size_t max_control_frame_size = 64;
+
+enum class ControlType : uint8_t {
+  // 客户端放弃本次rpc调用，服务端收到后取消正在执行的rpc处理函数
+  Cancel = 0x01,
+  // 接收方归还/授予发送方的credit，参数为4字节的字节数
+  Credit = 0x02,
+};
+
 }  // namespace pnrpc
 
 class Endian {
@@ -101,18 +125,104 @@ inline uint32_t ParsePcode(const char*& ptr, size_t& len) {
   return pcode;
 }
 
-inline void eofSeri(bool eof, std::string& appender) {
-  uint8_t flag = eof == 0;
-  size_t old_size = appender.size();
-  appender.resize(old_size + sizeof(flag));
-  memcpy(&appender[old_size], &flag, sizeof(flag));
+// 请求包头部flag字段的各个bit。
+// bit0为0表示eof（与只有eof字段的旧格式兼容），其余bit标识对应的可选字段是否存在。
+constexpr uint8_t request_flag_not_eof = 0x01;
+constexpr uint8_t request_flag_timeout = 0x02;
+// 请求包中打包了多个流式元素，数据部分由多个 长度(4字节) + 元素 组成，eof作用于最后一个元素
+constexpr uint8_t request_flag_elements = 0x04;
+// 单向请求，服务端不回复（包括错误信息），连接上可以连续发送多个单向请求
+constexpr uint8_t request_flag_one_way = 0x08;
+// 客户端可以解压回复，开启了压缩的rpc只在请求携带这个标记时压缩回复
+constexpr uint8_t request_flag_accept_compressed = 0x10;
+
+// 请求包头部：pcode(4字节) + flag(1字节) + 可选字段
+struct RequestHeader {
+  uint32_t pcode = 0;
+  bool eof = false;
+  // 客户端剩余的超时时间，单位毫秒，0表示未设置
+  uint32_t timeout_ms = 0;
+  bool elements = false;
+  bool one_way = false;
+  bool accept_compressed = false;
+};
+
+inline void requestHeaderSeri(const RequestHeader& header, std::string& appender) {
+  pcodeSeri(header.pcode, appender);
+  uint8_t flag = header.eof == true ? 0 : request_flag_not_eof;
+  if (header.timeout_ms != 0) {
+    flag |= request_flag_timeout;
+  }
+  if (header.elements == true) {
+    flag |= request_flag_elements;
+  }
+  if (header.one_way == true) {
+    flag |= request_flag_one_way;
+  }
+  if (header.accept_compressed == true) {
+    flag |= request_flag_accept_compressed;
+  }
+  integralSeri<uint8_t>(flag, appender);
+  if (header.timeout_ms != 0) {
+    integralSeri<uint32_t>(header.timeout_ms, appender);
+  }
 }
 
-inline bool ParseEofFlag(const char*& ptr, size_t& len) {
-  uint8_t eof = integralParse<uint8_t>(ptr, len);
+inline RequestHeader ParseRequestHeader(const char*& ptr, size_t& len) {
+  RequestHeader header;
+  header.pcode = ParsePcode(ptr, len);
+  uint8_t flag = integralParse<uint8_t>(ptr, len);
   ptr += sizeof(uint8_t);
   len -= sizeof(uint8_t);
-  return eof == 0;
+  header.eof = (flag & request_flag_not_eof) == 0;
+  header.elements = (flag & request_flag_elements) != 0;
+  header.one_way = (flag & request_flag_one_way) != 0;
+  header.accept_compressed = (flag & request_flag_accept_compressed) != 0;
+  if ((flag & request_flag_timeout) != 0) {
+    header.timeout_ms = integralParse<uint32_t>(ptr, len);
+    ptr += sizeof(uint32_t);
+    len -= sizeof(uint32_t);
+  }
+  return header;
+}
+
+// 批量请求使用的保留pcode，用户注册的rpc不能使用
+constexpr uint32_t batch_pcode = 0xFFFFFFFF;
+
+// 将frame按照 长度(4字节) + 数据 的格式添加到appender后面，批量请求和回复由多个这样的子帧拼接而成
+inline void subFrameSeri(std::string_view frame, std::string& appender) {
+  integralSeri<uint32_t>(static_cast<uint32_t>(frame.size()), appender);
+  appender.append(frame);
+}
+
+inline std::vector<std::string_view> ParseSubFrames(std::string_view buf) {
+  std::vector<std::string_view> frames;
+  const char* ptr = buf.data();
+  size_t len = buf.size();
+  while (len > 0) {
+    auto frame_len = integralParse<uint32_t>(ptr, len);
+    ptr += sizeof(uint32_t);
+    len -= sizeof(uint32_t);
+    if (frame_len > len) {
+      throw pnrpc::PnrpcException("invalid sub frame length : " + std::to_string(frame_len));
+    }
+    frames.emplace_back(ptr, frame_len);
+    ptr += frame_len;
+    len -= frame_len;
+  }
+  return frames;
+}
+
+using Deadline = std::chrono::steady_clock::time_point;
+
+// 计算距离deadline的剩余时间（毫秒，向上取整），已经超时则返回0
+inline uint32_t remainingMs(Deadline deadline) {
+  auto now = std::chrono::steady_clock::now();
+  if (now >= deadline) {
+    return 0;
+  }
+  auto ms = std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+  return ms > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(ms);
 }
 
 class Timer {
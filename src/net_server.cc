@@ -1,20 +1,61 @@
 #include "pnrpc/net_server.h"
 
+#include <sys/socket.h>
+#include <unistd.h>
+
 #include "pnrpc/exception.h"
+#include "pnrpc/timer_wheel.h"
 
 namespace pnrpc {
 
-net::awaitable<void> work(net::ip::tcp::socket socket, net::io_context& io) {
+// 对端关闭连接或者放弃调用导致的错误，只需要结束work协程即可
+static bool is_peer_gone(const system_error& e) {
+  return e.code() == net::error::eof || e.code() == net::error::operation_aborted ||
+         e.code() == net::error::connection_reset || e.code() == net::error::broken_pipe;
+}
+
+net::awaitable<void> work(Socket socket, net::io_context& io, bool shm) {
   try {
+    std::shared_ptr<ShmChannel> channel;
+    if (shm == true) {
+      channel = co_await ShmChannel::Accept(socket);
+    }
+    // 在idle_timeout内没有读取到完整的请求包时关闭socket的读写两端，正在等待的读操作（包括共享内存通道上对端关闭的检测）
+    // 会以eof结束，work协程随之退出。socket在rpc绑定的io_context之间转移时fd不变，因此在回调中直接使用fd
+    auto idle_timeout = RpcServer::Instance().GetIdleTimeout();
+    TimerWheel::Timer idle_timer;
     for (;;) {
-      auto handle_info = co_await RpcServer::Instance().HandleRequest(io, std::move(socket));
+      if (idle_timeout.count() != 0) {
+        int fd = socket.native_handle();
+        TimerWheel::Of(io).Schedule(idle_timer, idle_timeout, [fd]() {
+          PNRPC_LOG_DEBUG("close idle connection, fd = {}", fd);
+          ::shutdown(fd, SHUT_RDWR);
+        });
+      }
+      if (channel == nullptr) {
+        // 首先等待socket可读，空闲的连接只持有work协程的帧，HandleRequest的协程帧、stream的状态以及请求包的内存
+        // 在数据到达之后才分配。已经有数据可读（例如客户端连续发送请求）时不等待，避免多一次reactor调度
+        error_code ec;
+        if (socket.available(ec) == 0) {
+          co_await socket.async_wait(Socket::wait_read, net::use_awaitable);
+        }
+      }
+      auto* timer = idle_timeout.count() != 0 ? &idle_timer : nullptr;
+      auto handle_info = co_await RpcServer::Instance().HandleRequest(io, std::move(socket), channel.get(), timer);
       socket = std::move(*handle_info.socket);
+      if (handle_info.bind_ctx != &io) {
+        // rpc在绑定的io_context上执行完毕，回到io上继续处理本连接（包括操作io的时间轮）
+        co_await net::dispatch(io, net::use_awaitable);
+      }
       PNRPC_LOG_DEBUG("handle request, pcode = {}, ret_code = {}, process_ms = {}, err_msg = {}, io = {}",
                       handle_info.pcode, handle_info.ret_code, handle_info.process_ms, handle_info.err_msg,
                       static_cast<void*>(handle_info.bind_ctx));
+      if (handle_info.close_connection == true) {
+        break;
+      }
     }
   } catch (system_error& e) {
-    if (e.code() == net::error::eof) {
+    if (is_peer_gone(e)) {
       // PNRPC_LOG_ERROR("connection is closed by peer");
     } else {
       PNRPC_LOG_WARN("asio exception : {}", e.what());
@@ -30,25 +71,41 @@ net::awaitable<void> work(net::ip::tcp::socket socket, net::io_context& io) {
   }
 }
 
+// 按照轮询的方式将连接分派给handle_io，没有handle_io时在io上处理
+static void dispatch_connection(Socket socket, bool shm, net::io_context& io,
+                                std::vector<std::unique_ptr<net::io_context>>& handle_io, size_t& handle_io_index) {
+  if (handle_io.empty()) {
+    net::co_spawn(io, work(std::move(socket), io, shm), net::detached);
+    return;
+  }
+  net::io_context& hio = *handle_io[handle_io_index];
+  net::co_spawn(hio, work(rebind_ctx(std::move(socket), hio), hio, shm), net::detached);
+  handle_io_index += 1;
+  if (handle_io_index >= handle_io.size()) {
+    handle_io_index = 0;
+  }
+}
+
 net::awaitable<void> listener(const std::string& ip, uint16_t port, net::io_context& io,
                               std::vector<std::unique_ptr<net::io_context>>& handle_io) {
   auto executor = co_await net::this_coro::executor;
+  size_t handle_io_index = 0;
+  if (is_unix_address(ip) || is_shm_address(ip)) {
+    bool shm = is_shm_address(ip);
+    auto path = shm ? shm_path(ip) : unix_path(ip);
+    // 删除上一次运行残留的socket文件，否则bind会失败
+    ::unlink(path.c_str());
+    net::local::stream_protocol::acceptor acceptor(executor, net::local::stream_protocol::endpoint(path));
+    for (;;) {
+      Socket socket(co_await acceptor.async_accept(net::use_awaitable));
+      dispatch_connection(std::move(socket), shm, io, handle_io, handle_io_index);
+    }
+  }
   net::ip::tcp::endpoint ep(net::ip::address::from_string(ip), port);
   net::ip::tcp::acceptor acceptor(executor, ep);
-  size_t handle_io_index = 0;
   for (;;) {
-    net::ip::tcp::socket socket = co_await acceptor.async_accept(net::use_awaitable);
-    if (handle_io.empty()) {
-      net::co_spawn(executor, work(std::move(socket), io), net::detached);
-    } else {
-      // 按照轮询的方式将请求分派给handle_io。
-      net::io_context& hio = *handle_io[handle_io_index];
-      net::co_spawn(hio, work(rebind_ctx(std::move(socket), hio), hio), net::detached);
-      handle_io_index += 1;
-      if (handle_io_index >= handle_io.size()) {
-        handle_io_index = 0;
-      }
-    }
+    Socket socket(co_await acceptor.async_accept(net::use_awaitable));
+    dispatch_connection(std::move(socket), false, io, handle_io, handle_io_index);
   }
 }
 
@@ -0,0 +1,14 @@
+#include "pnrpc/bandwidth_budget.h"
+
+#include <chrono>
+
+#include "gtest/gtest.h"
+
+TEST(bandwidth_budget, shared) {
+  // 1000字节/秒，桶容量100字节，两个stream交替预定100字节的块，等待时间依次增加100毫秒
+  pnrpc::BandwidthBudget budget(1000, 100);
+  EXPECT_EQ(budget.reserve(100).count(), 0);
+  EXPECT_NEAR(budget.reserve(100).count(), 100000, 5000);
+  EXPECT_NEAR(budget.reserve(100).count(), 200000, 5000);
+  EXPECT_NEAR(budget.reserve(100).count(), 300000, 5000);
+}
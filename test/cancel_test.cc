@@ -0,0 +1,72 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "pnrpc/rpc_declare.h"
+
+using namespace std::chrono_literals;
+
+static bool slow_echo_aborted = false;
+
+RPC_DECLARE(SlowEcho, std::string, std::string, 0xA501, pnrpc::RpcType::Simple, OVERRIDE_PROCESS)
+
+pnrpc::net::awaitable<void> RPCSlowEcho::process() {
+  auto request = co_await get_request_arg();
+  pnrpc::net::steady_timer timer(co_await pnrpc::net::this_coro::executor, 10s);
+  try {
+    co_await timer.async_wait(pnrpc::net::use_awaitable);
+  } catch (pnrpc::system_error& e) {
+    slow_echo_aborted = e.code() == pnrpc::net::error::operation_aborted;
+    throw;
+  }
+  co_await set_response_arg(request.value(), true);
+  co_return;
+}
+
+// 客户端在请求发出之后等待50ms放弃调用，close为true时直接关闭连接，否则发送cancel帧
+static void RunAbandonedCall(bool close) {
+  REGISTER_RPC(SlowEcho)
+  slow_echo_aborted = false;
+  std::string address = "unix:/tmp/pnrpc_cancel_test.sock";
+  ::unlink(pnrpc::unix_path(address).c_str());
+  pnrpc::net::io_context io;
+  pnrpc::net::local::stream_protocol::acceptor acceptor(
+      io, pnrpc::net::local::stream_protocol::endpoint(pnrpc::unix_path(address)));
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        pnrpc::Socket socket(co_await acceptor.async_accept(pnrpc::net::use_awaitable));
+        auto handle_info = co_await pnrpc::RpcServer::Instance().HandleRequest(io, std::move(socket));
+        EXPECT_EQ(handle_info.ret_code, RPC_CANCELLED);
+        EXPECT_TRUE(handle_info.close_connection);
+      },
+      pnrpc::net::detached);
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        using namespace pnrpc::net::experimental::awaitable_operators;
+        auto stub = std::make_unique<RPCSlowEchoSTUB>(io, address, 0);
+        co_await stub->async_connect();
+        std::string response;
+        pnrpc::net::steady_timer timer(io, 50ms);
+        auto result = co_await (stub->rpc_call_coro("hello", response) || timer.async_wait(pnrpc::net::use_awaitable));
+        EXPECT_EQ(result.index(), 1);
+        if (close == false) {
+          co_await stub->cancel();
+        }
+        stub.reset();
+      },
+      pnrpc::net::detached);
+  auto start = std::chrono::steady_clock::now();
+  io.run();
+  EXPECT_LT(std::chrono::steady_clock::now() - start, 5s);
+  EXPECT_TRUE(slow_echo_aborted);
+  ::unlink(pnrpc::unix_path(address).c_str());
+}
+
+TEST(cancel, cancel_frame) { RunAbandonedCall(false); }
+
+TEST(cancel, peer_close) { RunAbandonedCall(true); }
@@ -0,0 +1,80 @@
+#include "pnrpc/chunked.h"
+
+#include <unistd.h>
+
+#include <deque>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+TEST(chunked, write_and_read) {
+  std::string message(10000, '\0');
+  for (size_t i = 0; i < message.size(); ++i) {
+    message[i] = static_cast<char>(i % 251);
+  }
+  std::deque<std::string> chunks;
+  bool eof = false;
+  pnrpc::ChunkWriter writer(
+      [&](const std::string& chunk, bool e) -> pnrpc::net::awaitable<void> {
+        EXPECT_FALSE(eof);
+        EXPECT_LE(chunk.size(), 4096);
+        chunks.push_back(chunk);
+        eof = e;
+        co_return;
+      },
+      4096);
+  pnrpc::ChunkReader reader([&]() -> pnrpc::net::awaitable<std::optional<std::string>> {
+    if (chunks.empty()) {
+      co_return std::optional<std::string>();
+    }
+    std::string chunk = std::move(chunks.front());
+    chunks.pop_front();
+    co_return chunk;
+  });
+  std::string received;
+  pnrpc::net::io_context io;
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        co_await writer.Write(std::string_view(message).substr(0, 100));
+        co_await writer.Write(std::string_view(message).substr(100));
+        co_await writer.Close();
+        EXPECT_EQ(chunks.size(), 3);
+        // 先按字节读取，再逐块读取剩余的部分
+        char buf[10];
+        size_t n = co_await reader.Read(buf, sizeof(buf));
+        received.append(buf, n);
+        while (true) {
+          auto chunk = co_await reader.ReadChunk();
+          if (!chunk.has_value()) {
+            break;
+          }
+          received += chunk.value();
+        }
+        EXPECT_EQ(co_await reader.Read(buf, sizeof(buf)), 0);
+      },
+      pnrpc::net::detached);
+  io.run();
+  EXPECT_TRUE(eof);
+  EXPECT_TRUE(reader.eof());
+  EXPECT_EQ(received, message);
+}
+
+TEST(chunked, mapped_file) {
+  std::string path = "/tmp/pnrpc_chunked_test.bin";
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << "hello world";
+  }
+  auto file = pnrpc::MappedFile::Open(path);
+  EXPECT_EQ(file.size(), 11);
+  EXPECT_EQ(file.view(), "hello world");
+  auto moved = std::move(file);
+  EXPECT_EQ(moved.view(), "hello world");
+  EXPECT_EQ(file.size(), 0);
+  EXPECT_THROW(pnrpc::MappedFile::Open("/tmp/pnrpc_chunked_not_exist"), pnrpc::system_error);
+  ::unlink(path.c_str());
+}
@@ -0,0 +1,61 @@
+#include "pnrpc/coalescing.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+
+TEST(coalescing, all) {
+  pnrpc::net::io_context io;
+  pnrpc::Coalescer coalescer;
+  pnrpc::Coalescer::Ticket leader;
+  coalescer.join("request", leader);
+  EXPECT_TRUE(leader.is_leader());
+  int shared = 0;
+  for (int i = 0; i < 2; ++i) {
+    pnrpc::net::co_spawn(
+        io,
+        [&]() -> pnrpc::net::awaitable<void> {
+          pnrpc::Coalescer::Ticket ticket;
+          coalescer.join("request", ticket);
+          EXPECT_FALSE(ticket.is_leader());
+          auto frames = co_await pnrpc::Coalescer::wait(ticket, std::nullopt);
+          if (frames != nullptr && *frames == "frames") {
+            ++shared;
+          }
+        },
+        pnrpc::net::detached);
+  }
+  io.run_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(shared, 0);
+  leader.publish(std::make_shared<const std::string>("frames"));
+  EXPECT_EQ(coalescer.size(), 0);
+  io.restart();
+  io.run();
+  EXPECT_EQ(shared, 2);
+}
+
+TEST(coalescing, leader_failed) {
+  pnrpc::net::io_context io;
+  pnrpc::Coalescer coalescer;
+  bool woken = false;
+  {
+    pnrpc::Coalescer::Ticket leader;
+    coalescer.join("request", leader);
+    pnrpc::net::co_spawn(
+        io,
+        [&]() -> pnrpc::net::awaitable<void> {
+          pnrpc::Coalescer::Ticket ticket;
+          coalescer.join("request", ticket);
+          auto frames = co_await pnrpc::Coalescer::wait(ticket, std::nullopt);
+          woken = frames == nullptr;
+        },
+        pnrpc::net::detached);
+    io.run_for(std::chrono::milliseconds(50));
+  }
+  // leader没有发布结果就结束时，等待者被唤醒并自行执行
+  io.restart();
+  io.run();
+  EXPECT_TRUE(woken);
+}
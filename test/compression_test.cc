@@ -0,0 +1,133 @@
+#include "pnrpc/compression.h"
+
+#include <string>
+#include <utility>
+
+#include "gtest/gtest.h"
+#include "pnrpc/stream.h"
+
+namespace {
+
+std::string MakeText(size_t size) {
+  std::string text;
+  while (text.size() < size) {
+    text.append("pnrpc compression test " + std::to_string(text.size() % 97) + "\n");
+  }
+  text.resize(size);
+  return text;
+}
+
+}  // namespace
+
+TEST(compression, frame) {
+  std::string raw = MakeText(64 * 1024);
+  auto frame = pnrpc::CompressFrame(raw);
+  ASSERT_TRUE(frame.has_value());
+  EXPECT_LT(frame->size(), raw.size());
+  EXPECT_EQ(pnrpc::CompressedFrameRawSize(frame.value()), raw.size());
+  // 原始数据的前4个字节（请求包的pcode）不压缩
+  EXPECT_EQ(pnrpc::CompressedFrameHead(frame.value()), integralParse<uint32_t>(raw.data(), raw.size()));
+  EXPECT_EQ(pnrpc::DecompressFrame(frame.value()), raw);
+  // 压缩之后没有变小的数据不压缩
+  EXPECT_FALSE(pnrpc::CompressFrame("abc").has_value());
+  frame->resize(frame->size() / 2);
+  EXPECT_THROW(pnrpc::DecompressFrame(frame.value()), pnrpc::PnrpcException);
+}
+
+TEST(compression, stream) {
+  pnrpc::net::io_context io;
+  pnrpc::net::local::stream_protocol::socket s1(io), s2(io);
+  pnrpc::net::local::connect_pair(s1, s2);
+  pnrpc::Socket client(std::move(s1));
+  pnrpc::Socket server(std::move(s2));
+  // 小于threshold的请求不压缩，大于offload_compression_size的请求在CompressionPool中压缩和解压
+  std::string small = MakeText(100);
+  std::string large = MakeText(pnrpc::offload_compression_size * 2);
+  pnrpc::ClientToServerStream<std::string> request_stream(7);
+  request_stream.update_bind_socket(&client);
+  request_stream.enable_compression(1024);
+  request_stream.set_accept_compressed(true);
+  size_t wire_bytes = 0;
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        co_await request_stream.Send(small, false);
+        co_await request_stream.Send(large, true);
+        wire_bytes = request_stream.get_write_bytes();
+      },
+      pnrpc::net::detached);
+  std::string first;
+  std::optional<std::string> second;
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        pnrpc::ClientToServerStream<void> ctss;
+        ctss.update_bind_socket(&server);
+        std::string buf;
+        first = std::string(co_await ctss.Read(buf));
+        EXPECT_TRUE(ctss.get_header().accept_compressed);
+        pnrpc::ClientToServerStream<std::string> stream(7);
+        stream.update_bind_socket(&server);
+        second = co_await stream.Read();
+      },
+      pnrpc::net::detached);
+  io.run();
+  EXPECT_EQ(first, small);
+  ASSERT_TRUE(second.has_value());
+  EXPECT_EQ(second.value(), large);
+  EXPECT_LT(wire_bytes, large.size() / 2);
+}
+
+TEST(compression, admission) {
+  pnrpc::net::io_context io;
+  pnrpc::net::local::stream_protocol::socket s1(io), s2(io), s3(io), s4(io);
+  pnrpc::net::local::connect_pair(s1, s2);
+  pnrpc::net::local::connect_pair(s3, s4);
+  pnrpc::Socket client(std::move(s1));
+  pnrpc::Socket server(std::move(s2));
+  std::string text = MakeText(64 * 1024);
+  pnrpc::ClientToServerStream<std::string> request_stream(7);
+  request_stream.update_bind_socket(&client);
+  request_stream.enable_compression(1024);
+  request_stream.SendSync(text, false);
+  request_stream.SendSync(text, true);
+
+  auto budget = std::make_shared<pnrpc::MemoryBudget>(1024 * 1024);
+  size_t in_use = 0;
+  bool too_large = false;
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        pnrpc::ClientToServerStream<std::string> stream(7);
+        stream.update_bind_socket(&server);
+        // 压缩帧在分配内存之前按照原始长度以及压缩帧的长度申请预算
+        stream.limit_read_frame(text.size() * 2, budget);
+        auto first = co_await stream.Read();
+        EXPECT_EQ(first, text);
+        in_use = budget->in_use();
+        // 压缩帧同样受原始长度的限制
+        stream.limit_read_frame(text.size() / 2, budget);
+        try {
+          co_await stream.Read();
+        } catch (pnrpc::PnrpcException&) {
+          too_large = true;
+        }
+      },
+      pnrpc::net::detached);
+  io.run();
+  EXPECT_GT(in_use, text.size());
+  EXPECT_LT(in_use, text.size() * 2);
+  EXPECT_TRUE(too_large);
+
+  // 没有开启压缩的rpc不接收压缩帧
+  pnrpc::Socket client2(std::move(s3));
+  pnrpc::Socket server2(std::move(s4));
+  pnrpc::ClientToServerStream<std::string> request_stream2(7);
+  request_stream2.update_bind_socket(&client2);
+  request_stream2.enable_compression(1024);
+  request_stream2.SendSync(text, true);
+  pnrpc::ClientToServerStream<std::string> stream(7);
+  stream.update_bind_socket(&server2);
+  stream.reject_compressed_frames(true);
+  EXPECT_THROW(stream.ReadSync(), pnrpc::PnrpcException);
+}
@@ -0,0 +1,54 @@
+#include "pnrpc/consistent_hash.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+TEST(consistent_hash, remap) {
+  pnrpc::HashRing ring;
+  for (uint16_t port = 1; port <= 4; ++port) {
+    ring.add({"127.0.0.1", port});
+  }
+  std::vector<size_t> before;
+  for (int i = 0; i < 1000; ++i) {
+    before.push_back(ring.pick("key" + std::to_string(i)));
+    EXPECT_EQ(before.back(), ring.pick("key" + std::to_string(i)));
+  }
+  // 移除一个后端之后，只有原来映射到该后端的key被重新映射
+  ring.remove({"127.0.0.1", 2});
+  size_t removed = 1;
+  EXPECT_FALSE(ring.is_alive(removed));
+  for (int i = 0; i < 1000; ++i) {
+    size_t now = ring.pick("key" + std::to_string(i));
+    EXPECT_NE(now, removed);
+    if (before[i] != removed) {
+      EXPECT_EQ(now, before[i]);
+    }
+  }
+  // 重新加入之后恢复原来的映射
+  ring.add({"127.0.0.1", 2});
+  EXPECT_TRUE(ring.is_alive(removed));
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(ring.pick("key" + std::to_string(i)), before[i]);
+  }
+}
+
+TEST(consistent_hash, bounded_load) {
+  pnrpc::HashRing ring(160, 1.25);
+  for (uint16_t port = 1; port <= 4; ++port) {
+    ring.add({"127.0.0.1", port});
+  }
+  // 同一个热点key的并发请求超过负载上限之后会溢出到其他后端
+  size_t owner = ring.pick("hot");
+  std::vector<size_t> load(4, 0);
+  for (int i = 0; i < 100; ++i) {
+    size_t index = ring.pick("hot");
+    ring.on_start(index);
+    load[index] += 1;
+  }
+  for (size_t i = 0; i < 4; ++i) {
+    EXPECT_LE(load[i], 32);
+  }
+  EXPECT_GT(load[owner], 0);
+}
@@ -7,13 +7,25 @@
 
 TEST(current_limiting, all) {
   pnrpc::CurrentLimiting cl;
-  EXPECT_EQ(cl.calcualte_sleep_time(100), 0);
-  // 更新限流20字节/秒，如果当前写入了100字节，那么需要sleep 5秒
-  cl.update_up_water_level(20);
-  EXPECT_EQ(cl.calcualte_sleep_time(100), 5);
+  EXPECT_EQ(cl.reserve(100).count(), 0);
+  // 更新限流20字节/秒，桶容量20字节：前20字节不需要等待，之后再写入100字节需要等待5秒
+  cl.update_up_water_level(20, 20);
+  EXPECT_EQ(cl.reserve(20).count(), 0);
+  EXPECT_NEAR(cl.reserve(100).count(), 5000000, 10000);
   std::this_thread::sleep_for(std::chrono::seconds(3));
-  // 在3秒之后再计算sleep时间，需要sleep 3秒
-  EXPECT_EQ(cl.calcualte_sleep_time(100), 2);
+  // 3秒之后再写入0字节，还需要等待2秒
+  EXPECT_NEAR(cl.reserve(0).count(), 2000000, 10000);
   cl.update_up_water_level(200);
-  EXPECT_EQ(cl.calcualte_sleep_time(100), 0);
-}
\ No newline at end of file
+  EXPECT_EQ(cl.reserve(20).count(), 0);
+}
+
+TEST(current_limiting, smooth) {
+  // 1000字节/秒，桶容量100字节：chunk_size不会小于min_chunk_size，
+  // 这里直接每次预留100字节，每次的等待时间都是100毫秒，而不是按秒停顿
+  pnrpc::CurrentLimiting cl(1000, 100);
+  EXPECT_EQ(cl.chunk_size(), pnrpc::CurrentLimiting::min_chunk_size);
+  EXPECT_EQ(cl.reserve(100).count(), 0);
+  EXPECT_NEAR(cl.reserve(100).count(), 100000, 5000);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  EXPECT_NEAR(cl.reserve(100).count(), 100000, 5000);
+}
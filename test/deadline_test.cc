@@ -0,0 +1,100 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "pnrpc/rpc_declare.h"
+
+using namespace std::chrono_literals;
+
+static bool deadline_processed = false;
+
+// 绑定到单独的io_context上执行，测试通过推迟运行该io_context使请求在调度之前超时
+static pnrpc::net::io_context deadline_io;
+
+RPC_DECLARE(DeadlineEcho, std::string, std::string, 0xA401, pnrpc::RpcType::Simple, OVERRIDE_PROCESS OVERRIDE_BIND)
+
+pnrpc::net::io_context* RPCDeadlineEcho::bind_io_context(void*) { return &deadline_io; }
+
+pnrpc::net::awaitable<void> RPCDeadlineEcho::process() {
+  deadline_processed = true;
+  auto request = co_await get_request_arg();
+  co_await set_response_arg(request.value(), true);
+  co_return;
+}
+
+TEST(deadline, header) {
+  RequestHeader header;
+  header.pcode = 0xA401;
+  header.eof = true;
+  header.timeout_ms = 1500;
+  std::string buf;
+  requestHeaderSeri(header, buf);
+  buf.append("x");
+
+  const char* ptr = buf.data();
+  size_t len = buf.size();
+  auto parsed = ParseRequestHeader(ptr, len);
+  EXPECT_EQ(parsed.pcode, 0xA401);
+  EXPECT_TRUE(parsed.eof);
+  EXPECT_EQ(parsed.timeout_ms, 1500);
+  ASSERT_EQ(len, 1);
+  EXPECT_EQ(*ptr, 'x');
+
+  // 没有设置超时时间时不携带该字段
+  header.timeout_ms = 0;
+  header.eof = false;
+  buf.clear();
+  requestHeaderSeri(header, buf);
+  EXPECT_EQ(buf.size(), sizeof(uint32_t) + sizeof(uint8_t));
+  ptr = buf.data();
+  len = buf.size();
+  parsed = ParseRequestHeader(ptr, len);
+  EXPECT_FALSE(parsed.eof);
+  EXPECT_EQ(parsed.timeout_ms, 0);
+  EXPECT_EQ(len, 0);
+}
+
+TEST(deadline, exceeded_before_dispatch) {
+  REGISTER_RPC(DeadlineEcho)
+  deadline_processed = false;
+  std::string address = "unix:/tmp/pnrpc_deadline_test.sock";
+  ::unlink(pnrpc::unix_path(address).c_str());
+  pnrpc::net::io_context io;
+  pnrpc::net::local::stream_protocol::acceptor acceptor(
+      io, pnrpc::net::local::stream_protocol::endpoint(pnrpc::unix_path(address)));
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        pnrpc::Socket socket(co_await acceptor.async_accept(pnrpc::net::use_awaitable));
+        auto handle_info = co_await pnrpc::RpcServer::Instance().HandleRequest(io, std::move(socket));
+        EXPECT_EQ(handle_info.ret_code, RPC_DEADLINE_EXCEEDED);
+      },
+      pnrpc::net::detached);
+  int ret_code = -1;
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        RPCDeadlineEchoSTUB stub(io, address, 0);
+        co_await stub.async_connect();
+        stub.set_timeout(10ms);
+        std::string response;
+        ret_code = co_await stub.rpc_call_coro("hello", response);
+      },
+      pnrpc::net::detached);
+  // 请求在deadline之后才被调度到绑定的io_context上，不会执行process()
+  auto work = pnrpc::net::make_work_guard(deadline_io);
+  std::thread slow([]() {
+    std::this_thread::sleep_for(50ms);
+    deadline_io.run();
+  });
+  io.run();
+  work.reset();
+  slow.join();
+  deadline_io.restart();
+  EXPECT_EQ(ret_code, RPC_DEADLINE_EXCEEDED);
+  EXPECT_FALSE(deadline_processed);
+  ::unlink(pnrpc::unix_path(address).c_str());
+}
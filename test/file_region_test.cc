@@ -0,0 +1,78 @@
+#include "pnrpc/file_region.h"
+
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+#include "pnrpc/flow_control.h"
+#include "pnrpc/stream.h"
+
+static std::string write_file(const std::string& path, size_t size) {
+  std::string content(size, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    content[i] = static_cast<char>(i % 251);
+  }
+  std::ofstream out(path, std::ios::binary);
+  out << content;
+  return content;
+}
+
+TEST(file_region, open) {
+  std::string path = "/tmp/pnrpc_file_region_test.bin";
+  auto content = write_file(path, 1000);
+  auto region = pnrpc::FileRegion::Open(path, 100);
+  EXPECT_EQ(region.offset(), 100);
+  EXPECT_EQ(region.size(), 900);
+  EXPECT_EQ(region.Read(100, 10), content.substr(100, 10));
+  EXPECT_THROW(pnrpc::FileRegion::Open(path, 100, 1000), pnrpc::PnrpcException);
+  EXPECT_THROW(pnrpc::FileRegion::Open("/tmp/pnrpc_file_region_not_exist"), pnrpc::system_error);
+  ::unlink(path.c_str());
+}
+
+TEST(file_region, send_file) {
+  std::string path = "/tmp/pnrpc_file_region_test.bin";
+  // 大于file_frame_size，分成多个回复包发送
+  auto content = write_file(path, pnrpc::file_frame_size + 1000);
+  std::string address = "/tmp/pnrpc_file_region_test.sock";
+  ::unlink(address.c_str());
+  pnrpc::net::io_context io;
+  pnrpc::net::local::stream_protocol::acceptor acceptor(io, pnrpc::net::local::stream_protocol::endpoint(address));
+  pnrpc::Socket client(io);
+  pnrpc::connect_to(client, "unix:" + address, 0);
+  pnrpc::Socket server(acceptor.accept());
+
+  // 客户端的接收窗口大于整个文件，服务端不需要等待credit
+  pnrpc::FlowControl server_fc;
+  pnrpc::FlowControl client_fc;
+  client_fc.enlarge_recv_window(2 * content.size());
+  server_fc.on_credit(static_cast<uint32_t>(2 * content.size()));
+  pnrpc::ServerToClientStream<std::string> sender;
+  sender.update_bind_socket(&server);
+  sender.bind_flow_control(&server_fc);
+  auto region = pnrpc::FileRegion::Open(path);
+  pnrpc::net::co_spawn(io, sender.SendFile(region, true), pnrpc::net::detached);
+
+  std::string received;
+  std::thread reader([&]() {
+    pnrpc::ServerToClientStream<std::string> receiver;
+    receiver.update_bind_socket(&client);
+    receiver.bind_flow_control(&client_fc);
+    uint32_t ret_code = 0;
+    std::string err_msg;
+    while (true) {
+      auto response = receiver.ReadSync(ret_code, err_msg);
+      if (ret_code != RPC_OK || !response.has_value()) {
+        break;
+      }
+      received += response.value();
+    }
+  });
+  io.run();
+  reader.join();
+  EXPECT_EQ(received, content);
+  ::unlink(path.c_str());
+  ::unlink(address.c_str());
+}
@@ -0,0 +1,69 @@
+#include "pnrpc/flow_control.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "pnrpc/rpc_declare.h"
+
+RPC_DECLARE(FlowEcho, std::string, std::string, 0xA301, pnrpc::RpcType::Simple, OVERRIDE_PROCESS)
+
+pnrpc::net::awaitable<void> RPCFlowEcho::process() {
+  auto request = co_await get_request_arg();
+  co_await set_response_arg(request.value(), true);
+  co_return;
+}
+
+TEST(flow_control, reset) {
+  pnrpc::FlowControl fc;
+  fc.enlarge_recv_window(2 * pnrpc::default_stream_window);
+  EXPECT_EQ(fc.take_pending_grant(), pnrpc::default_stream_window);
+  fc.on_send(pnrpc::default_stream_window);
+  EXPECT_FALSE(fc.can_send());
+  // 重置之后恢复初始的credit，扩大的接收窗口重新授予对端
+  fc.reset();
+  EXPECT_TRUE(fc.can_send());
+  EXPECT_EQ(fc.take_pending_grant(), pnrpc::default_stream_window);
+}
+
+// 同一个stub发送的请求总量超过初始的credit，每次调用都重新开始计算
+TEST(flow_control, reused_stub) {
+  REGISTER_RPC(FlowEcho)
+  std::string address = "unix:/tmp/pnrpc_flow_control_test.sock";
+  ::unlink(pnrpc::unix_path(address).c_str());
+  pnrpc::net::io_context io;
+  pnrpc::net::local::stream_protocol::acceptor acceptor(
+      io, pnrpc::net::local::stream_protocol::endpoint(pnrpc::unix_path(address)));
+  constexpr int calls = 8;
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        pnrpc::Socket socket(co_await acceptor.async_accept(pnrpc::net::use_awaitable));
+        for (int i = 0; i < calls; ++i) {
+          auto handle_info = co_await pnrpc::RpcServer::Instance().HandleRequest(io, std::move(socket));
+          EXPECT_EQ(handle_info.ret_code, RPC_OK);
+          socket = std::move(*handle_info.socket);
+        }
+      },
+      pnrpc::net::detached);
+  int finished = 0;
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        RPCFlowEchoSTUB stub(io, address, 0);
+        co_await stub.async_connect();
+        std::string request(64 * 1024, 'a');
+        for (int i = 0; i < calls; ++i) {
+          std::string response;
+          EXPECT_EQ(co_await stub.rpc_call_coro(request, response), RPC_OK);
+          EXPECT_EQ(response, request);
+          finished += 1;
+        }
+      },
+      pnrpc::net::detached);
+  io.run_for(std::chrono::seconds(10));
+  EXPECT_EQ(finished, calls);
+  ::unlink(pnrpc::unix_path(address).c_str());
+}
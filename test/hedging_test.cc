@@ -0,0 +1,36 @@
+#include "pnrpc/hedging.h"
+
+#include <chrono>
+
+#include "gtest/gtest.h"
+
+TEST(hedging, retry_budget) {
+  pnrpc::RetryBudget budget(0.1, 2);
+  EXPECT_FALSE(budget.try_withdraw());
+  // 每10个正常请求允许一个额外的请求
+  for (int i = 0; i < 10; ++i) {
+    budget.deposit();
+  }
+  EXPECT_TRUE(budget.try_withdraw());
+  EXPECT_FALSE(budget.try_withdraw());
+  // 令牌数量有上限
+  for (int i = 0; i < 100; ++i) {
+    budget.deposit();
+  }
+  EXPECT_TRUE(budget.try_withdraw());
+  EXPECT_TRUE(budget.try_withdraw());
+  EXPECT_FALSE(budget.try_withdraw());
+}
+
+TEST(hedging, latency_tracker) {
+  pnrpc::LatencyTracker tracker(100);
+  for (int i = 1; i <= 100; ++i) {
+    tracker.record(std::chrono::microseconds(i));
+  }
+  EXPECT_EQ(tracker.quantile(0.95).count(), 96);
+  // 只保留最近的100个样本
+  for (int i = 0; i < 100; ++i) {
+    tracker.record(std::chrono::microseconds(1000));
+  }
+  EXPECT_EQ(tracker.quantile(0.5).count(), 1000);
+}
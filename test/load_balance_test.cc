@@ -0,0 +1,48 @@
+#include "pnrpc/load_balance.h"
+
+#include <chrono>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using namespace std::chrono_literals;
+
+TEST(load_balance, p2c) {
+  pnrpc::LoadBalancer lb({{"127.0.0.1", 1}, {"127.0.0.1", 2}});
+  // 只有两个后端时每次都会比较这两个后端，总是选择在途请求更少的一个
+  lb.on_start(0);
+  EXPECT_EQ(lb.pick(), 1);
+  lb.on_start(1);
+  lb.on_start(1);
+  EXPECT_EQ(lb.pick(), 0);
+  // 延迟更高的后端即使在途请求更少也会被避开
+  lb.on_finish(1, 1ms, true);
+  lb.on_finish(1, 1ms, true);
+  lb.on_finish(0, 100ms, true);
+  EXPECT_EQ(lb.pick(), 1);
+}
+
+TEST(load_balance, eject) {
+  pnrpc::BalanceOptions options;
+  options.max_failures = 2;
+  pnrpc::LoadBalancer lb({{"127.0.0.1", 1}, {"127.0.0.1", 2}, {"127.0.0.1", 3}, {"127.0.0.1", 4}}, options);
+  for (int i = 0; i < 2; ++i) {
+    lb.on_start(0);
+    lb.on_finish(0, 1ms, false);
+  }
+  EXPECT_TRUE(lb.is_ejected(0));
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_NE(lb.pick(), 0);
+  }
+  for (int i = 0; i < 2; ++i) {
+    lb.on_start(1);
+    lb.on_finish(1, 1ms, false);
+  }
+  EXPECT_TRUE(lb.is_ejected(1));
+  // 最多摘除一半的后端
+  for (int i = 0; i < 2; ++i) {
+    lb.on_start(2);
+    lb.on_finish(2, 1ms, false);
+  }
+  EXPECT_FALSE(lb.is_ejected(2));
+}
@@ -0,0 +1,66 @@
+#include <string>
+
+#include "gtest/gtest.h"
+#include "pnrpc/rpc_declare.h"
+
+static const char* moved_response_data = nullptr;
+
+RPC_DECLARE(LocalEcho, std::string, std::string, 0xA001, pnrpc::RpcType::Simple, OVERRIDE_PROCESS)
+RPC_DECLARE(LocalStream, std::string, std::string, 0xA002, pnrpc::RpcType::ServerSideStream)
+
+pnrpc::net::awaitable<void> RPCLocalEcho::process() {
+  auto request = co_await get_request_arg();
+  if (request.value() == "missing") {
+    co_await set_error_response(RPC_NOT_FOUND, "not found");
+    co_return;
+  }
+  if (request.value() == "large") {
+    std::string response(1024, 'x');
+    moved_response_data = response.data();
+    co_await set_response_arg(std::move(response), true);
+    co_return;
+  }
+  co_await set_response_arg(request.value() + " world", true);
+  co_return;
+}
+
+TEST(local_call, all) {
+  REGISTER_RPC(LocalEcho)
+  pnrpc::net::io_context io;
+  int ret_code = -1;
+  std::string response;
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        RPCLocalEchoSTUB stub(io, std::string(pnrpc::inproc_address), 0);
+        co_await stub.async_connect();
+        ret_code = co_await stub.rpc_call_coro(std::string("hello"), response);
+      },
+      pnrpc::net::detached);
+  io.run();
+  EXPECT_EQ(ret_code, RPC_OK);
+  EXPECT_EQ(response, "hello world");
+  // 同步接口
+  RPCLocalEchoSTUB stub(io, std::string(pnrpc::inproc_address), 0);
+  std::string sync_response;
+  EXPECT_EQ(stub.rpc_call("hi", sync_response), RPC_OK);
+  EXPECT_EQ(sync_response, "hi world");
+  // 处理函数回复的错误码返回给调用者
+  EXPECT_EQ(stub.rpc_call("missing", sync_response), RPC_NOT_FOUND);
+}
+
+TEST(local_call, move_response) {
+  REGISTER_RPC(LocalEcho)
+  pnrpc::net::io_context io;
+  RPCLocalEchoSTUB stub(io, std::string(pnrpc::inproc_address), 0);
+  std::string response;
+  EXPECT_EQ(stub.rpc_call("large", response), RPC_OK);
+  // 回复被移动给调用者，没有拷贝
+  EXPECT_EQ(response.size(), 1024);
+  EXPECT_EQ(response.data(), moved_response_data);
+}
+
+TEST(local_call, reject_stream) {
+  pnrpc::net::io_context io;
+  EXPECT_THROW(RPCLocalStreamSTUB(io, std::string(pnrpc::inproc_address), 0), pnrpc::PnrpcException);
+}
@@ -0,0 +1,43 @@
+#include "pnrpc/lru_cache.h"
+
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+using namespace std::chrono_literals;
+
+TEST(lru_cache, evict) {
+  using State = pnrpc::LruCache<std::string, int>::State;
+  pnrpc::LruCache<std::string, int> cache(2);
+  int value = 0;
+  cache.put("a", 1, 10s);
+  cache.put("b", 2, 10s);
+  // 访问a之后b成为最久没有被访问的条目
+  EXPECT_EQ(cache.get("a", value), State::Fresh);
+  EXPECT_EQ(value, 1);
+  cache.put("c", 3, 10s);
+  EXPECT_EQ(cache.get("b", value), State::Miss);
+  EXPECT_EQ(cache.size(), 2);
+  // 按照代价淘汰
+  cache.put("d", 4, 10s, 0ms, 2);
+  EXPECT_EQ(cache.size(), 1);
+  EXPECT_EQ(cache.charge(), 2);
+}
+
+TEST(lru_cache, stale) {
+  using State = pnrpc::LruCache<std::string, int>::State;
+  pnrpc::LruCache<std::string, int> cache(10);
+  int value = 0;
+  cache.put("a", 1, 50ms, 100ms);
+  std::this_thread::sleep_for(80ms);
+  bool refresh = false;
+  EXPECT_EQ(cache.get("a", value, &refresh), State::Stale);
+  EXPECT_TRUE(refresh);
+  // 只有一个调用者负责刷新
+  EXPECT_EQ(cache.get("a", value, &refresh), State::Stale);
+  EXPECT_FALSE(refresh);
+  std::this_thread::sleep_for(100ms);
+  EXPECT_EQ(cache.get("a", value), State::Miss);
+}
@@ -0,0 +1,104 @@
+#include "pnrpc/memory_budget.h"
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "pnrpc/stream.h"
+
+TEST(memory_budget, acquire_release) {
+  pnrpc::net::io_context io;
+  pnrpc::MemoryBudget budget(100);
+  std::vector<int> order;
+  pnrpc::MemoryBudget::Reservation first;
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        first = co_await budget.Acquire(80);
+        order.push_back(1);
+      },
+      pnrpc::net::detached);
+  // 预算不足时按照先来先服务的顺序等待，后面的小请求不能插队
+  for (int i = 2; i <= 3; ++i) {
+    pnrpc::net::co_spawn(
+        io,
+        [&, i]() -> pnrpc::net::awaitable<void> {
+          auto reservation = co_await budget.Acquire(i == 2 ? 50 : 10);
+          order.push_back(i);
+        },
+        pnrpc::net::detached);
+  }
+  io.run_for(std::chrono::milliseconds(50));
+  EXPECT_EQ(order, std::vector<int>({1}));
+  EXPECT_EQ(budget.in_use(), 80);
+  EXPECT_EQ(budget.waiting(), 2);
+  first.release();
+  io.restart();
+  io.run();
+  EXPECT_EQ(order, std::vector<int>({1, 2, 3}));
+  EXPECT_EQ(budget.in_use(), 0);
+}
+
+TEST(memory_budget, larger_than_capacity) {
+  pnrpc::net::io_context io;
+  pnrpc::MemoryBudget budget(100);
+  bool acquired = false;
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        auto reservation = co_await budget.Acquire(1000);
+        acquired = true;
+        EXPECT_EQ(reservation.bytes(), 100);
+      },
+      pnrpc::net::detached);
+  io.run();
+  EXPECT_TRUE(acquired);
+  EXPECT_EQ(budget.in_use(), 0);
+}
+
+TEST(memory_budget, admission) {
+  pnrpc::net::io_context io;
+  pnrpc::net::local::stream_protocol::socket s1(io), s2(io);
+  pnrpc::net::local::connect_pair(s1, s2);
+  pnrpc::Socket client(std::move(s1));
+  pnrpc::Socket server(std::move(s2));
+  pnrpc::ClientToServerStream<std::string> request_stream(7);
+  request_stream.update_bind_socket(&client);
+  request_stream.SendSync(std::string(64, 'a'), false);
+  request_stream.SendSync(std::string(2048, 'b'), true);
+
+  pnrpc::MemoryBudget budget(1024);
+  uint32_t admitted_pcode = 0;
+  bool too_large = false;
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        pnrpc::ClientToServerStream<void> ctss;
+        ctss.update_bind_socket(&server);
+        pnrpc::MemoryBudget::Reservation reservation;
+        pnrpc::StreamBase::Admission admit = [&](uint32_t pcode, size_t length,
+                                                 size_t compressed_length) -> pnrpc::net::awaitable<void> {
+          admitted_pcode = pcode;
+          reservation = co_await budget.Acquire(length + compressed_length);
+        };
+        std::string buf;
+        co_await ctss.Read(buf, admit);
+        EXPECT_EQ(budget.in_use(), buf.size());
+        // 后续的请求包超过限制时在分配内存之前抛出异常
+        pnrpc::ClientToServerStream<std::string> stream(7);
+        stream.update_bind_socket(&server);
+        stream.limit_read_frame(1024, nullptr);
+        try {
+          co_await stream.Read();
+        } catch (pnrpc::PnrpcException&) {
+          too_large = true;
+        }
+      },
+      pnrpc::net::detached);
+  io.run();
+  EXPECT_EQ(admitted_pcode, 7);
+  EXPECT_TRUE(too_large);
+  EXPECT_EQ(budget.in_use(), 0);
+}
@@ -0,0 +1,55 @@
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "pnrpc/rpc_declare.h"
+
+static std::vector<std::string> received;
+
+RPC_DECLARE(Report, std::string, std::string, 0xA101, pnrpc::RpcType::OneWay, OVERRIDE_PROCESS)
+
+pnrpc::net::awaitable<void> RPCReport::process() {
+  auto request = co_await get_request_arg();
+  received.push_back(request.value());
+  co_return;
+}
+
+TEST(one_way, remote) {
+  REGISTER_RPC(Report)
+  received.clear();
+  std::string address = "unix:/tmp/pnrpc_one_way_test.sock";
+  ::unlink(pnrpc::unix_path(address).c_str());
+  pnrpc::net::io_context io;
+  pnrpc::net::local::stream_protocol::acceptor acceptor(
+      io, pnrpc::net::local::stream_protocol::endpoint(pnrpc::unix_path(address)));
+  // 同一个stub连续发送多个请求，不等待回复
+  RPCReportSTUB stub(io, address, 0);
+  stub.connect();
+  EXPECT_EQ(stub.rpc_call("a"), RPC_OK);
+  EXPECT_EQ(stub.rpc_call("b"), RPC_OK);
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        pnrpc::Socket socket(co_await acceptor.async_accept(pnrpc::net::use_awaitable));
+        for (int i = 0; i < 2; ++i) {
+          auto handle_info = co_await pnrpc::RpcServer::Instance().HandleRequest(io, std::move(socket));
+          EXPECT_EQ(handle_info.ret_code, RPC_OK);
+          socket = std::move(*handle_info.socket);
+        }
+      },
+      pnrpc::net::detached);
+  io.run();
+  EXPECT_EQ(received, (std::vector<std::string>{"a", "b"}));
+  ::unlink(pnrpc::unix_path(address).c_str());
+}
+
+TEST(one_way, local) {
+  REGISTER_RPC(Report)
+  received.clear();
+  pnrpc::net::io_context io;
+  RPCReportSTUB stub(io, std::string(pnrpc::inproc_address), 0);
+  EXPECT_EQ(stub.rpc_call("c"), RPC_OK);
+  EXPECT_EQ(received, std::vector<std::string>{"c"});
+}
@@ -0,0 +1,69 @@
+#include "pnrpc/packager.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+TEST(packager, request_elements) {
+  pnrpc::RequestPackager<uint32_t> rp;
+  std::vector<uint32_t> nums{1, 2, 3};
+  RequestHeader header;
+  header.pcode = 0x04;
+  header.eof = true;
+  std::string buf;
+  rp.seri_request_packages(nums, buf, header);
+
+  RequestHeader parsed;
+  auto packages = rp.parse_request_packages(buf, parsed);
+  EXPECT_EQ(parsed.pcode, 0x04);
+  EXPECT_TRUE(parsed.eof);
+  EXPECT_TRUE(parsed.elements);
+  EXPECT_EQ(packages, nums);
+
+  // 单个元素的请求包
+  buf.clear();
+  header.eof = false;
+  rp.seri_request_package(4, buf, header);
+  packages = rp.parse_request_packages(buf, parsed);
+  EXPECT_FALSE(parsed.eof);
+  EXPECT_FALSE(parsed.elements);
+  EXPECT_EQ(packages, std::vector<uint32_t>{4});
+}
+
+TEST(packager, request_one_way) {
+  pnrpc::RequestPackager<uint32_t> rp;
+  RequestHeader header;
+  header.pcode = 0x05;
+  header.eof = true;
+  header.one_way = true;
+  std::string buf;
+  rp.seri_request_package(5, buf, header);
+
+  RequestHeader parsed;
+  auto packages = rp.parse_request_packages(buf, parsed);
+  EXPECT_TRUE(parsed.eof);
+  EXPECT_TRUE(parsed.one_way);
+  EXPECT_EQ(packages, std::vector<uint32_t>{5});
+}
+
+TEST(packager, response_elements) {
+  pnrpc::ResponsePackager<std::string> rp;
+  std::vector<std::string> responses{"a", "", "ccc"};
+  std::string buf;
+  rp.seri_response_packages(responses, buf, RPC_OK, false);
+
+  auto ri = rp.parse_response_package(buf);
+  EXPECT_EQ(ri.ret_code, RPC_OK);
+  EXPECT_FALSE(ri.eof);
+  ASSERT_TRUE(ri.elements.has_value());
+  EXPECT_EQ(ri.elements.value(), responses);
+
+  // 单个元素的回复包
+  buf.clear();
+  rp.seri_response_package("d", buf, RPC_OK, true);
+  ri = rp.parse_response_package(buf);
+  EXPECT_TRUE(ri.eof);
+  EXPECT_FALSE(ri.elements.has_value());
+  EXPECT_EQ(ri.response, "d");
+}
@@ -0,0 +1,73 @@
+#include "pnrpc/pubsub.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+struct FakeProcessor {
+  std::vector<std::string> packages;
+  bool eof = false;
+
+  pnrpc::net::awaitable<void> set_serialized_response(const std::string& package, bool) {
+    // 发送之后回复包会被释放，保存一份拷贝
+    packages.push_back(package);
+    co_return;
+  }
+
+  pnrpc::net::awaitable<void> set_response_arg(const std::string&, bool e) {
+    eof = e;
+    co_return;
+  }
+};
+
+}  // namespace
+
+TEST(pubsub, fan_out) {
+  pnrpc::net::io_context io;
+  pnrpc::Topic<std::string> topic;
+  FakeProcessor p1, p2;
+  pnrpc::net::co_spawn(io, topic.Serve(p1), pnrpc::net::detached);
+  pnrpc::net::co_spawn(io, topic.Serve(p2), pnrpc::net::detached);
+  io.run_for(std::chrono::milliseconds(20));
+  EXPECT_EQ(topic.subscriber_count(), 2);
+  EXPECT_EQ(topic.Publish("event"), 2);
+  io.restart();
+  io.run_for(std::chrono::milliseconds(20));
+  // 两个订阅者收到同一个序列化之后的回复包
+  ASSERT_EQ(p1.packages.size(), 1);
+  ASSERT_EQ(p2.packages.size(), 1);
+  EXPECT_EQ(p1.packages[0], p2.packages[0]);
+  auto ri = pnrpc::ResponsePackager<std::string>().parse_response_package(p1.packages[0]);
+  EXPECT_EQ(ri.ret_code, RPC_OK);
+  EXPECT_EQ(ri.response, "event");
+  topic.Close();
+  io.restart();
+  io.run();
+  EXPECT_TRUE(p1.eof);
+  EXPECT_TRUE(p2.eof);
+  EXPECT_EQ(topic.subscriber_count(), 0);
+  EXPECT_EQ(topic.Publish("event"), 0);
+}
+
+TEST(pubsub, slow_subscriber) {
+  pnrpc::net::io_context io;
+  pnrpc::Topic<std::string> topic(2);
+  FakeProcessor p;
+  pnrpc::net::co_spawn(io, topic.Serve(p), pnrpc::net::detached);
+  io.run_for(std::chrono::milliseconds(20));
+  for (int i = 0; i < 5; ++i) {
+    topic.Publish(std::to_string(i));
+  }
+  EXPECT_EQ(topic.dropped(), 3);
+  topic.Close();
+  io.restart();
+  io.run();
+  // 队列满之后丢弃最早的事件，保留最新的两个
+  ASSERT_EQ(p.packages.size(), 2);
+  EXPECT_EQ(pnrpc::ResponsePackager<std::string>().parse_response_package(p.packages[0]).response, "3");
+  EXPECT_EQ(pnrpc::ResponsePackager<std::string>().parse_response_package(p.packages[1]).response, "4");
+}
@@ -0,0 +1,79 @@
+#include "pnrpc/resolver_cache.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+TEST(resolver_cache, resolve) {
+  auto& cache = pnrpc::ResolverCache::Instance();
+  auto eps = cache.resolve("127.0.0.1", 44444);
+  ASSERT_EQ(eps.size(), 1);
+  EXPECT_EQ(eps[0].address().to_string(), "127.0.0.1");
+  EXPECT_EQ(eps[0].port(), 44444);
+
+  // 注入解析函数，不依赖测试环境的dns
+  cache.clear();
+  int resolved = 0;
+  cache.set_resolver([&resolved](const std::string& host, uint16_t port) {
+    EXPECT_EQ(host, "pnrpc.test");
+    resolved += 1;
+    return pnrpc::ResolverCache::Endpoints{{pnrpc::net::ip::make_address("127.0.0.2"), port}};
+  });
+  eps = cache.resolve("pnrpc.test", 44444);
+  ASSERT_EQ(eps.size(), 1);
+  EXPECT_EQ(eps[0].address().to_string(), "127.0.0.2");
+  EXPECT_EQ(cache.resolve("pnrpc.test", 44444), eps);
+  EXPECT_EQ(resolved, 1);
+  cache.set_resolver(nullptr);
+}
+
+TEST(resolver_cache, refresh_failed) {
+  auto& cache = pnrpc::ResolverCache::Instance();
+  cache.clear();
+  cache.set_ttl(std::chrono::milliseconds(0));
+  cache.set_refresh_backoff(std::chrono::hours(1));
+  int resolved = 0;
+  bool fail = false;
+  cache.set_resolver([&](const std::string&, uint16_t port) {
+    resolved += 1;
+    if (fail == true) {
+      throw pnrpc::system_error(pnrpc::net::error::host_not_found);
+    }
+    return pnrpc::ResolverCache::Endpoints{{pnrpc::net::ip::make_address("127.0.0.2"), port}};
+  });
+
+  // 同步接口：刷新失败时返回旧的结果，退避期间不再解析
+  auto eps = cache.resolve("pnrpc.test", 44444);
+  fail = true;
+  EXPECT_EQ(cache.resolve("pnrpc.test", 44444), eps);
+  EXPECT_EQ(resolved, 2);
+  EXPECT_EQ(cache.resolve("pnrpc.test", 44444), eps);
+  EXPECT_EQ(resolved, 2);
+
+  // 协程接口：后台刷新失败之后同样退避
+  cache.clear();
+  fail = false;
+  resolved = 0;
+  pnrpc::net::io_context io;
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        eps = co_await cache.async_resolve("pnrpc.test", 44444);
+        fail = true;
+        EXPECT_EQ(co_await cache.async_resolve("pnrpc.test", 44444), eps);
+        // 等待后台刷新结束
+        pnrpc::net::steady_timer timer(co_await pnrpc::net::this_coro::executor, std::chrono::milliseconds(10));
+        co_await timer.async_wait(pnrpc::net::use_awaitable);
+        EXPECT_EQ(resolved, 2);
+        EXPECT_EQ(co_await cache.async_resolve("pnrpc.test", 44444), eps);
+        EXPECT_EQ(resolved, 2);
+      },
+      pnrpc::net::detached);
+  io.run();
+  EXPECT_EQ(resolved, 2);
+
+  cache.set_resolver(nullptr);
+  cache.set_ttl(std::chrono::seconds(30));
+  cache.set_refresh_backoff(std::chrono::seconds(1));
+  cache.clear();
+}
@@ -0,0 +1,146 @@
+#include "pnrpc/rpc_batch.h"
+
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "pnrpc/rpc_declare.h"
+
+RPC_DECLARE(BatchEcho, std::string, std::string, 0xA201, pnrpc::RpcType::Simple, OVERRIDE_PROCESS)
+
+// 先到的请求后完成，检查回复仍然按照请求的顺序返回；"fail"抛出异常，"none"没有回复
+pnrpc::net::awaitable<void> RPCBatchEcho::process() {
+  auto request = co_await get_request_arg();
+  if (request.value() == "fail") {
+    throw pnrpc::PnrpcException("batch echo failed");
+  }
+  if (request.value() == "none") {
+    co_return;
+  }
+  auto delay = std::chrono::milliseconds(request.value() == "a" ? 30 : request.value() == "b" ? 10 : 0);
+  pnrpc::net::steady_timer timer(co_await pnrpc::net::this_coro::executor, delay);
+  co_await timer.async_wait(pnrpc::net::use_awaitable);
+  co_await set_response_arg(request.value(), true);
+  co_return;
+}
+
+namespace {
+
+// 处理连接上的请求直到对端关闭连接，handled记录处理的批量请求个数
+pnrpc::net::awaitable<void> Serve(pnrpc::net::io_context& io, pnrpc::net::local::stream_protocol::acceptor& acceptor,
+                                  int& handled) {
+  pnrpc::Socket socket(co_await acceptor.async_accept(pnrpc::net::use_awaitable));
+  try {
+    for (;;) {
+      auto handle_info = co_await pnrpc::RpcServer::Instance().HandleRequest(io, std::move(socket));
+      EXPECT_EQ(handle_info.pcode, batch_pcode);
+      handled += 1;
+      socket = std::move(*handle_info.socket);
+    }
+  } catch (pnrpc::system_error&) {
+  }
+  co_return;
+}
+
+}  // namespace
+
+TEST(rpc_batch, stub) {
+  REGISTER_RPC(BatchEcho)
+  std::string address = "unix:/tmp/pnrpc_rpc_batch_test.sock";
+  ::unlink(pnrpc::unix_path(address).c_str());
+  pnrpc::net::io_context io;
+  pnrpc::net::local::stream_protocol::acceptor acceptor(
+      io, pnrpc::net::local::stream_protocol::endpoint(pnrpc::unix_path(address)));
+  int handled = 0;
+  pnrpc::net::co_spawn(io, Serve(io, acceptor, handled), pnrpc::net::detached);
+
+  // 凑满4个调用之后立即发送，4个调用在一个批量请求中
+  auto window = std::chrono::milliseconds(50);
+  auto client = std::make_unique<pnrpc::RpcBatchStub<RPCBatchEchoSTUB>>(io, address, 0, 4, window);
+  std::vector<std::string> requests{"a", "fail", "b", "none", "c"};
+  std::vector<std::string> responses(requests.size());
+  std::vector<int> ret_codes(requests.size(), -1);
+  int finished = 0;
+  for (size_t i = 0; i < requests.size(); ++i) {
+    pnrpc::net::co_spawn(
+        io,
+        [&, i]() -> pnrpc::net::awaitable<void> {
+          ret_codes[i] = co_await client->rpc_call_coro(requests[i], responses[i]);
+          // 所有调用完成之后关闭连接，结束服务端的协程
+          if (++finished == static_cast<int>(requests.size())) {
+            client.reset();
+          }
+        },
+        pnrpc::net::detached);
+  }
+  io.run();
+  EXPECT_EQ(ret_codes, (std::vector<int>{RPC_OK, RPC_NO_RESPONSE, RPC_OK, RPC_NO_RESPONSE, RPC_OK}));
+  EXPECT_EQ(responses[0], "a");
+  EXPECT_EQ(responses[2], "b");
+  EXPECT_EQ(responses[4], "c");
+  // 前4个调用凑满一批，第5个调用在窗口到期之后单独成为一批
+  EXPECT_EQ(handled, 2);
+  ::unlink(pnrpc::unix_path(address).c_str());
+}
+
+TEST(rpc_batch, mixed_pcode) {
+  REGISTER_RPC(BatchEcho)
+  pnrpc::net::io_context io;
+  pnrpc::net::local::stream_protocol::socket s1(io), s2(io);
+  pnrpc::net::local::connect_pair(s1, s2);
+  pnrpc::Socket client(std::move(s1));
+  pnrpc::Socket server(std::move(s2));
+
+  // 批量请求中包含未注册的pcode、超过一个包的子请求以及正常的调用，错误只影响对应的子请求
+  std::string payload;
+  RequestHeader batch_header;
+  batch_header.pcode = batch_pcode;
+  batch_header.eof = true;
+  requestHeaderSeri(batch_header, payload);
+  auto append = [&payload](uint32_t pcode, bool eof, const std::string& request) {
+    RequestHeader header;
+    header.pcode = pcode;
+    header.eof = eof;
+    std::string frame;
+    pnrpc::RequestPackager<std::string> rp;
+    rp.seri_request_package(request, frame, header);
+    subFrameSeri(frame, payload);
+  };
+  append(0xA201, true, "a");
+  append(0xA2FF, true, "x");
+  append(0xA201, false, "y");
+  append(0xA201, true, "c");
+
+  std::vector<std::string> responses;
+  std::vector<uint32_t> ret_codes;
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        auto handle_info = co_await pnrpc::RpcServer::Instance().HandleRequest(io, std::move(server));
+        EXPECT_EQ(handle_info.ret_code, RPC_OK);
+      },
+      pnrpc::net::detached);
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        pnrpc::RawStream rs;
+        rs.update_bind_socket(&client);
+        co_await rs.Send(payload);
+        std::string buf = co_await rs.Read();
+        for (auto frame : ParseSubFrames(buf)) {
+          pnrpc::ResponsePackager<std::string> rp;
+          auto ri = rp.parse_response_package(std::string(frame));
+          ret_codes.push_back(ri.ret_code);
+          responses.push_back(ri.ret_code == RPC_OK ? ri.response : ri.err_msg);
+        }
+      },
+      pnrpc::net::detached);
+  io.run();
+  EXPECT_EQ(ret_codes, (std::vector<uint32_t>{RPC_OK, RPC_INVALID_PCODE, RPC_UNSUPPORTED, RPC_OK}));
+  ASSERT_EQ(responses.size(), 4);
+  EXPECT_EQ(responses[0], "a");
+  EXPECT_EQ(responses[3], "c");
+}
@@ -0,0 +1,33 @@
+#include "pnrpc/server_cache.h"
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+TEST(server_cache, all) {
+  pnrpc::ServerCache cache(pnrpc::ServerCacheOptions{100, 1 << 20});
+  EXPECT_EQ(cache.get("request"), nullptr);
+  cache.put("request", std::make_shared<const std::string>("frame"));
+  auto frame = cache.get("request");
+  ASSERT_NE(frame, nullptr);
+  EXPECT_EQ(*frame, "frame");
+  EXPECT_EQ(cache.charge(), std::string("requestframe").size());
+  // 过期之后不再命中
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  EXPECT_EQ(cache.get("request"), nullptr);
+  EXPECT_EQ(cache.size(), 0);
+}
+
+TEST(server_cache, memory_limit) {
+  pnrpc::ServerCache cache(pnrpc::ServerCacheOptions{10000, 1 << 20});
+  // 超过分片容量的回复帧不会被缓存
+  cache.put("request", std::make_shared<const std::string>(2 << 20, 'a'));
+  EXPECT_EQ(cache.get("request"), nullptr);
+  for (int i = 0; i < 4096; ++i) {
+    cache.put(std::to_string(i), std::make_shared<const std::string>(1024, 'a'));
+  }
+  EXPECT_LE(cache.charge(), 1 << 20);
+}
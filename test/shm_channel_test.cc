@@ -0,0 +1,89 @@
+#include "pnrpc/shm_channel.h"
+
+#include <unistd.h>
+
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+struct ShmPair {
+  explicit ShmPair(const std::string& path, size_t ring_size)
+      : acceptor(io, pnrpc::net::local::stream_protocol::endpoint(path)), client_socket(io), server_socket(io) {
+    pnrpc::connect_to(client_socket, "shm:" + path, 0);
+    server_socket = pnrpc::Socket(acceptor.accept());
+    client = pnrpc::ShmChannel::ConnectSync(client_socket, ring_size);
+    auto future = pnrpc::net::co_spawn(io, pnrpc::ShmChannel::Accept(server_socket), pnrpc::net::use_future);
+    io.run();
+    server = future.get();
+  }
+
+  pnrpc::net::io_context io;
+  pnrpc::net::local::stream_protocol::acceptor acceptor;
+  pnrpc::Socket client_socket;
+  pnrpc::Socket server_socket;
+  std::shared_ptr<pnrpc::ShmChannel> client;
+  std::shared_ptr<pnrpc::ShmChannel> server;
+};
+
+}  // namespace
+
+TEST(shm_channel, address) {
+  EXPECT_TRUE(pnrpc::is_shm_address("shm:/tmp/pnrpc.sock"));
+  EXPECT_FALSE(pnrpc::is_shm_address("unix:/tmp/pnrpc.sock"));
+  EXPECT_EQ(pnrpc::shm_path("shm:/tmp/pnrpc.sock"), "/tmp/pnrpc.sock");
+}
+
+TEST(shm_channel, read_write) {
+  std::string path = "/tmp/pnrpc_shm_channel_test.sock";
+  ::unlink(path.c_str());
+  ShmPair pair(path, 4096);
+  // 数据大于环形缓冲区时写端需要等待读端
+  std::string request(100 * 1024, '\0');
+  for (size_t i = 0; i < request.size(); ++i) {
+    request[i] = static_cast<char>(i % 251);
+  }
+  std::thread writer([&]() {
+    pair.client->write(pair.client_socket, pnrpc::net::buffer(request));
+    std::string response(4, '\0');
+    pair.client->read(pair.client_socket, pnrpc::net::buffer(response));
+    EXPECT_EQ(response, "pong");
+  });
+  std::string buf(request.size(), '\0');
+  pair.server->read(pair.server_socket, pnrpc::net::buffer(buf));
+  EXPECT_EQ(buf, request);
+  pair.server->write(pair.server_socket, pnrpc::net::buffer(std::string("pong")));
+  writer.join();
+  ::unlink(path.c_str());
+}
+
+TEST(shm_channel, peer_closed) {
+  std::string path = "/tmp/pnrpc_shm_channel_test.sock";
+  ::unlink(path.c_str());
+  ShmPair pair(path, 4096);
+  pair.client->write(pair.client_socket, pnrpc::net::buffer(std::string("ping")));
+  pair.client_socket.close();
+  // 对端关闭之前写入的数据仍然可以读到，之后的读抛出eof
+  std::string buf(4, '\0');
+  pair.server->read(pair.server_socket, pnrpc::net::buffer(buf));
+  EXPECT_EQ(buf, "ping");
+  EXPECT_THROW(pair.server->read(pair.server_socket, pnrpc::net::buffer(buf)), pnrpc::system_error);
+  ::unlink(path.c_str());
+}
+
+TEST(shm_channel, small_ring) {
+  std::string path = "/tmp/pnrpc_shm_channel_test.sock";
+  ::unlink(path.c_str());
+  // 小于min_shm_ring_size的大小被调整为min_shm_ring_size，第二个环形缓冲区的头部仍然是对齐的
+  ShmPair pair(path, 16);
+  std::string message(1000, 'x');
+  pair.server->write(pair.server_socket, pnrpc::net::buffer(message));
+  std::string buf(message.size(), '\0');
+  pair.client->read(pair.client_socket, pnrpc::net::buffer(buf));
+  EXPECT_EQ(buf, message);
+  ::unlink(path.c_str());
+}
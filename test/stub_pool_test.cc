@@ -0,0 +1,99 @@
+#include "pnrpc/stub_pool.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+int connected = 0;
+
+// 只记录建立连接的次数，alive为false表示连接已经被对端关闭
+struct FakeStub {
+  static constexpr bool reusable = true;
+
+  FakeStub(pnrpc::net::io_context&, const std::string&, uint16_t) {}
+
+  pnrpc::net::awaitable<void> async_connect() {
+    connected += 1;
+    co_return;
+  }
+
+  bool is_reusable() const { return alive; }
+
+  void clear_deadline() { deadline_cleared = true; }
+
+  bool alive = true;
+  bool deadline_cleared = false;
+};
+
+// 流式rpc的stub不能复用
+struct FakeStreamStub {
+  FakeStreamStub(pnrpc::net::io_context&, const std::string&, uint16_t) {}
+
+  pnrpc::net::awaitable<void> async_connect() {
+    connected += 1;
+    co_return;
+  }
+};
+
+template <typename Pool>
+typename Pool::Handle Acquire(pnrpc::net::io_context& io, Pool& pool, const pnrpc::Endpoint& ep) {
+  typename Pool::Handle stub;
+  pnrpc::net::co_spawn(
+      io, [&]() -> pnrpc::net::awaitable<void> { stub = co_await pool.acquire(ep); }, pnrpc::net::detached);
+  io.restart();
+  io.run();
+  return stub;
+}
+
+}  // namespace
+
+TEST(stub_pool, reuse) {
+  connected = 0;
+  pnrpc::net::io_context io;
+  pnrpc::StubPool<FakeStub> pool(io, 2);
+  pnrpc::Endpoint ep{"127.0.0.1", 1};
+  auto a = Acquire(io, pool, ep);
+  auto b = Acquire(io, pool, ep);
+  auto c = Acquire(io, pool, ep);
+  EXPECT_EQ(connected, 3);
+  FakeStub* raw = a.get();
+  pool.release(ep, std::move(a));
+  pool.release(ep, std::move(b));
+  // 超过max_idle的stub被关闭
+  pool.release(ep, std::move(c));
+  EXPECT_EQ(pool.idle_count(ep), 2);
+  EXPECT_TRUE(raw->deadline_cleared);
+
+  // 复用空闲的连接，不重新建立连接
+  auto d = Acquire(io, pool, ep);
+  EXPECT_EQ(connected, 3);
+  EXPECT_EQ(pool.idle_count(ep), 1);
+
+  // 对端已经关闭的连接被丢弃
+  auto f = Acquire(io, pool, ep);
+  d->alive = false;
+  f->alive = false;
+  pool.release(ep, std::move(d));
+  pool.release(ep, std::move(f));
+  auto e = Acquire(io, pool, ep);
+  EXPECT_TRUE(e->alive);
+  EXPECT_EQ(connected, 4);
+
+  // 后端被移除时关闭空闲的连接
+  pool.release(ep, std::move(e));
+  pool.remove(ep);
+  EXPECT_EQ(pool.idle_count(ep), 0);
+}
+
+TEST(stub_pool, not_reusable) {
+  connected = 0;
+  pnrpc::net::io_context io;
+  pnrpc::StubPool<FakeStreamStub> pool(io);
+  pnrpc::Endpoint ep{"127.0.0.1", 1};
+  pool.release(ep, Acquire(io, pool, ep));
+  EXPECT_EQ(pool.idle_count(ep), 0);
+  Acquire(io, pool, ep);
+  EXPECT_EQ(connected, 2);
+}
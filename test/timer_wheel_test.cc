@@ -0,0 +1,96 @@
+#include "pnrpc/timer_wheel.h"
+
+#include <chrono>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "pnrpc/stream.h"
+
+TEST(timer_wheel, schedule_cancel) {
+  pnrpc::net::io_context io;
+  auto& wheel = pnrpc::TimerWheel::Of(io);
+  EXPECT_EQ(&wheel, &pnrpc::TimerWheel::Of(io));
+  std::vector<int> fired;
+  pnrpc::TimerWheel::Timer t1, t2, t3, t4;
+  wheel.Schedule(t1, std::chrono::milliseconds(50), [&]() { fired.push_back(1); });
+  wheel.Schedule(t2, std::chrono::milliseconds(20), [&]() { fired.push_back(2); });
+  wheel.Schedule(t3, std::chrono::milliseconds(30), [&]() { fired.push_back(3); });
+  EXPECT_EQ(wheel.size(), 3);
+  wheel.Cancel(t3);
+  // 重新设置已经设置的定时器
+  wheel.Schedule(t1, std::chrono::milliseconds(10), [&]() { fired.push_back(1); });
+  {
+    pnrpc::TimerWheel::Timer t5;
+    wheel.Schedule(t5, std::chrono::milliseconds(10), [&]() { fired.push_back(5); });
+  }
+  // 已经到期的deadline在下一个tick执行，回调中可以设置新的定时器
+  wheel.Schedule(t4, std::chrono::steady_clock::now() - std::chrono::seconds(1), [&]() {
+    fired.push_back(4);
+    wheel.Schedule(t4, std::chrono::milliseconds(0), [&]() { fired.push_back(6); });
+  });
+  EXPECT_EQ(wheel.size(), 3);
+  auto start = std::chrono::steady_clock::now();
+  io.run();
+  EXPECT_EQ(fired, std::vector<int>({4, 6, 1, 2}));
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(20));
+  EXPECT_EQ(wheel.size(), 0);
+  EXPECT_FALSE(t1.pending());
+}
+
+TEST(timer_wheel, cascade) {
+  pnrpc::net::io_context io;
+  auto& wheel = pnrpc::TimerWheel::Of(io);
+  // 超过第0层一圈（256个tick）的定时器放在第1层，到期之前被重新放入第0层
+  pnrpc::TimerWheel::Timer timer;
+  auto deadline = std::chrono::steady_clock::now() + pnrpc::timer_wheel_tick * 300;
+  std::chrono::steady_clock::time_point fired;
+  wheel.Schedule(timer, deadline, [&]() { fired = std::chrono::steady_clock::now(); });
+  io.run();
+  EXPECT_GE(fired, deadline);
+  EXPECT_LT(fired, deadline + std::chrono::milliseconds(200));
+}
+
+TEST(timer_wheel, wait) {
+  pnrpc::net::io_context io;
+  bool done = false;
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(30);
+        co_await pnrpc::TimerWheel::Of(io).Wait(deadline);
+        done = std::chrono::steady_clock::now() >= deadline;
+      },
+      pnrpc::net::detached);
+  io.run();
+  EXPECT_TRUE(done);
+}
+
+TEST(timer_wheel, stream_io_timeout) {
+  pnrpc::net::io_context io;
+  pnrpc::net::local::stream_protocol::socket s1(io), s2(io);
+  pnrpc::net::local::connect_pair(s1, s2);
+  pnrpc::Socket client(std::move(s1));
+  pnrpc::Socket server(std::move(s2));
+  // 对端只发送了半个请求包，读取在超时之后以错误结束，而不是一直等待
+  char partial[] = {0, 0, 1, 0, 'a'};
+  pnrpc::net::write(client, pnrpc::net::buffer(partial));
+  bool timeout = false;
+  auto start = std::chrono::steady_clock::now();
+  pnrpc::net::co_spawn(
+      io,
+      [&]() -> pnrpc::net::awaitable<void> {
+        pnrpc::ClientToServerStream<std::string> stream(7);
+        stream.update_bind_socket(&server);
+        stream.set_io_timeout(pnrpc::TimerWheel::Of(io), std::chrono::milliseconds(50));
+        try {
+          co_await stream.Read();
+        } catch (pnrpc::system_error&) {
+          timeout = true;
+        }
+      },
+      pnrpc::net::detached);
+  io.run();
+  EXPECT_TRUE(timeout);
+  EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(50));
+  EXPECT_EQ(pnrpc::TimerWheel::Of(io).size(), 0);
+}
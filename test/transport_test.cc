@@ -0,0 +1,47 @@
+#include "pnrpc/transport.h"
+
+#include <unistd.h>
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "pnrpc/rebind_ctx.h"
+
+TEST(transport, address) {
+  EXPECT_TRUE(pnrpc::is_unix_address("unix:/tmp/pnrpc.sock"));
+  EXPECT_FALSE(pnrpc::is_unix_address("127.0.0.1"));
+  EXPECT_EQ(pnrpc::unix_path("unix:/tmp/pnrpc.sock"), "/tmp/pnrpc.sock");
+}
+
+TEST(transport, unix_socket) {
+  std::string address = "unix:/tmp/pnrpc_transport_test.sock";
+  ::unlink(pnrpc::unix_path(address).c_str());
+  pnrpc::net::io_context io;
+  pnrpc::net::local::stream_protocol::acceptor acceptor(
+      io, pnrpc::net::local::stream_protocol::endpoint(pnrpc::unix_path(address)));
+  pnrpc::Socket client(io);
+  pnrpc::connect_to(client, address, 0);
+  pnrpc::Socket server(acceptor.accept());
+  // 连接可以在io_context之间迁移
+  pnrpc::net::io_context other;
+  server = pnrpc::rebind_ctx(std::move(server), other);
+  pnrpc::net::write(client, pnrpc::net::buffer(std::string("ping")));
+  std::string buf(4, '\0');
+  pnrpc::net::read(server, pnrpc::net::buffer(buf));
+  EXPECT_EQ(buf, "ping");
+  ::unlink(pnrpc::unix_path(address).c_str());
+}
+
+TEST(transport, tcp_socket) {
+  pnrpc::net::io_context io;
+  pnrpc::net::ip::tcp::acceptor acceptor(io, pnrpc::net::ip::tcp::endpoint(pnrpc::net::ip::address_v4::loopback(), 0));
+  pnrpc::Socket client(io);
+  pnrpc::connect_to(client, "127.0.0.1", acceptor.local_endpoint().port());
+  pnrpc::Socket server(acceptor.accept());
+  pnrpc::net::io_context other;
+  server = pnrpc::rebind_ctx(std::move(server), other);
+  pnrpc::net::write(server, pnrpc::net::buffer(std::string("pong")));
+  std::string buf(4, '\0');
+  pnrpc::net::read(client, pnrpc::net::buffer(buf));
+  EXPECT_EQ(buf, "pong");
+}